@@ -0,0 +1,63 @@
+#ifndef CPPPROJECT_ARENA_H
+#define CPPPROJECT_ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace cc {
+// Bump allocator for objects that live as long as the arena itself. Memory
+// is handed out from fixed-size blocks and released all at once; destructors
+// of objects created with make() are never run.
+class arena {
+public:
+  static constexpr size_t k_block_size = 64 * 1024;
+
+  arena() = default;
+  arena(const arena &) = delete;
+  arena &operator=(const arena &) = delete;
+  arena(arena &&) = default;
+  arena &operator=(arena &&) = default;
+
+  void *allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+    size_t offset = (m_used + align - 1) & ~(align - 1);
+    if (m_blocks.empty() || offset + size > m_capacity) {
+      grow(size + align);
+      offset = (m_used + align - 1) & ~(align - 1);
+    }
+    m_used = offset + size;
+    return m_blocks.back().get() + offset;
+  }
+
+  template <typename T, typename... Args> T *make(Args &&...args) {
+    return new (allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+  }
+
+  std::string_view copy(std::string_view s) {
+    auto *dst = static_cast<char *>(allocate(s.size(), 1));
+    std::memcpy(dst, s.data(), s.size());
+    return {dst, s.size()};
+  }
+
+private:
+  void grow(size_t min_size) {
+    m_capacity = std::max(k_block_size, min_size);
+    // Blocks start max_align_t aligned, which covers every type allocated
+    // through make().
+    m_blocks.push_back(std::make_unique_for_overwrite<std::byte[]>(m_capacity));
+    m_used = 0;
+  }
+
+  std::vector<std::unique_ptr<std::byte[]>> m_blocks;
+  size_t m_used = 0;
+  size_t m_capacity = 0;
+};
+} // namespace cc
+
+#endif // CPPPROJECT_ARENA_H
@@ -0,0 +1,678 @@
+#include "codegen.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "lexer.h"
+
+namespace cc::x86_64 {
+namespace {
+constexpr reg k_pool[] = {rax, rcx, rdx, rsi, rdi, r8, r9, r10, r11};
+constexpr reg k_arg_regs[] = {rdi, rsi, rdx, rcx, r8, r9};
+
+uint32_t bit(reg r) { return 1u << r; }
+
+unsigned size_of(qual_type type) {
+  return type->m_kind == type_kind::pointer ? 8 : type->m_size;
+}
+
+int64_t truncate(int64_t v, qual_type type) {
+  switch (size_of(type)) {
+  case 1:
+    return type->is_signed() ? int64_t(int8_t(v)) : int64_t(uint8_t(v));
+  case 2:
+    return int16_t(v);
+  case 4:
+    return int32_t(v);
+  default:
+    return v;
+  }
+}
+
+bool is_comparison(int op) {
+  return op == EQ_OP || op == NE_OP || op == '<' || op == '>' ||
+         op == LE_OP || op == GE_OP;
+}
+
+cond condition(int op, bool is_unsigned) {
+  switch (op) {
+  case EQ_OP:
+    return cc_e;
+  case NE_OP:
+    return cc_ne;
+  case '<':
+    return is_unsigned ? cc_b : cc_l;
+  case '>':
+    return is_unsigned ? cc_a : cc_g;
+  case LE_OP:
+    return is_unsigned ? cc_be : cc_le;
+  default:
+    return is_unsigned ? cc_ae : cc_ge;
+  }
+}
+} // namespace
+
+codegen::codegen(object_module &module)
+    : m_module(module), m_asm(module.section(section_id::text)) {}
+
+void codegen::begin_function(std::string_view name, bool global) {
+  m_function = m_module.symbol(name);
+  m_function_global = global;
+  m_function_start = m_asm.pos();
+  m_asm.push(rbp);
+  m_asm.mov(rbp, rsp);
+  m_frame_patch = m_asm.sub_rsp();
+  m_frame_size = 0;
+  m_labels.clear();
+  m_fixups.clear();
+  m_return = new_label();
+}
+
+int32_t codegen::param(unsigned index, qual_type type) {
+  if (index >= std::size(k_arg_regs)) {
+    throw std::runtime_error("More than 6 parameters are not supported");
+  }
+  int32_t slot = local(type);
+  m_asm.store(rbp, slot, k_arg_regs[index], size_of(type));
+  return slot;
+}
+
+void codegen::end_function() {
+  // Falling off the end returns 0, which is what main needs.
+  m_asm.mov_imm(rax, 0);
+  place(m_return);
+  m_asm.leave();
+  m_asm.ret();
+  m_asm.patch_imm32(m_frame_patch, (m_frame_size + 15) & ~15);
+  m_module.define(m_function, section_id::text, m_function_start,
+                  m_asm.pos() - m_function_start, m_function_global, true);
+  if (!m_fixups.empty() || !m_stack.empty()) {
+    throw std::logic_error("unbalanced code generation");
+  }
+}
+
+int32_t codegen::local(qual_type type) {
+  return frame_slot(std::max<uint64_t>(type->m_size, 1),
+                    std::max<uint32_t>(type->m_align, 1));
+}
+
+int32_t codegen::frame_slot(uint64_t size, uint64_t align) {
+  uint64_t frame = (m_frame_size + size + align - 1) & ~(align - 1);
+  if (frame > INT32_MAX / 2) {
+    throw std::runtime_error("Stack frame too large");
+  }
+  m_frame_size = static_cast<int32_t>(frame);
+  return -m_frame_size;
+}
+
+void codegen::global_variable(std::string_view name, qual_type type,
+                              bool global, std::optional<int64_t> init) {
+  m_module.define_object(m_module.symbol(name), type->m_size, type->m_align,
+                         global, init);
+}
+
+void codegen::finish() { m_module.resolve_local_relocations(); }
+
+void codegen::push(const value &v) {
+  // Only the top of the stack may live in the flags, since nearly every
+  // instruction clobbers them.
+  if (!m_stack.empty() && m_stack.back().m_kind == kind::flags) {
+    load(m_stack.back());
+  }
+  m_stack.push_back(v);
+}
+
+void codegen::push_int(int64_t value, qual_type type) {
+  push({.m_kind = kind::imm, .m_imm = value, .m_type = type});
+}
+
+void codegen::push_local(int32_t slot, qual_type type) {
+  push({.m_kind = kind::frame, .m_lvalue = true, .m_imm = slot,
+        .m_type = type});
+}
+
+void codegen::push_global(std::string_view name, qual_type type,
+                          bool external) {
+  push({.m_kind = kind::global,
+        .m_lvalue = true,
+        .m_external = external,
+        .m_symbol = m_module.symbol(name),
+        .m_type = type});
+}
+
+void codegen::push_function(std::string_view name, qual_type type) {
+  push({.m_kind = kind::global,
+        .m_symbol = m_module.symbol(name),
+        .m_type = type});
+}
+
+void codegen::push_string(std::string_view bytes, qual_type type) {
+  push({.m_kind = kind::global,
+        .m_symbol = m_module.add_string(bytes),
+        .m_type = type});
+}
+
+void codegen::pop() { m_stack.pop_back(); }
+
+std::optional<int64_t> codegen::pop_constant() {
+  const value &v = m_stack.back();
+  if (v.m_kind != kind::imm) {
+    return std::nullopt;
+  }
+  int64_t imm = v.m_imm;
+  m_stack.pop_back();
+  return imm;
+}
+
+void codegen::dup() {
+  value &top = m_stack.back();
+  if (top.m_kind == kind::reg || top.m_kind == kind::flags) {
+    spill(top);
+  }
+  push(value(m_stack.back()));
+}
+
+void codegen::swap() {
+  if (m_stack.back().m_kind == kind::flags) {
+    load(m_stack.back());
+  }
+  std::swap(m_stack.back(), m_stack[m_stack.size() - 2]);
+}
+
+uint32_t codegen::used_regs() const {
+  uint32_t used = 0;
+  for (const value &v : m_stack) {
+    if (v.m_kind == kind::reg) {
+      used |= bit(v.m_reg);
+    }
+  }
+  return used;
+}
+
+reg codegen::alloc(uint32_t avoid) {
+  uint32_t used = used_regs() | avoid;
+  for (reg r : k_pool) {
+    if (!(used & bit(r))) {
+      return r;
+    }
+  }
+  for (value &v : m_stack) {
+    if (v.m_kind == kind::reg && !(avoid & bit(v.m_reg))) {
+      reg r = v.m_reg;
+      spill(v);
+      return r;
+    }
+  }
+  throw std::logic_error("out of registers");
+}
+
+void codegen::spill(value &v) {
+  if (v.m_kind == kind::flags) {
+    load(v);
+  }
+  if (v.m_kind == kind::reg) {
+    int32_t slot = frame_slot(8, 8);
+    m_asm.store(rbp, slot, v.m_reg, 8);
+    v.m_kind = kind::spill;
+    v.m_imm = slot;
+  }
+}
+
+void codegen::spill_all() {
+  for (value &v : m_stack) {
+    spill(v);
+  }
+}
+
+// Frees `r` by moving its current user to another register.
+void codegen::take(reg r, uint32_t avoid) {
+  for (value &v : m_stack) {
+    if (v.m_kind == kind::reg && v.m_reg == r) {
+      reg other = alloc(avoid | bit(r));
+      m_asm.mov(other, r);
+      v.m_reg = other;
+    }
+  }
+}
+
+reg codegen::load(value &v, uint32_t avoid) {
+  reg r = v.m_kind == kind::reg ? v.m_reg : alloc(avoid);
+  load_to(v, r);
+  return r;
+}
+
+void codegen::load_to(value &v, reg r) {
+  unsigned size = size_of(v.m_type);
+  bool is_signed = v.m_type->is_signed();
+  switch (v.m_kind) {
+  case kind::imm:
+    m_asm.mov_imm(r, v.m_imm);
+    break;
+  case kind::reg:
+    if (v.m_lvalue) {
+      m_asm.load(r, v.m_reg, 0, size, is_signed);
+    } else if (v.m_reg != r) {
+      m_asm.mov(r, v.m_reg);
+    }
+    break;
+  case kind::frame:
+    if (v.m_lvalue) {
+      m_asm.load(r, rbp, v.m_imm, size, is_signed);
+    } else {
+      m_asm.lea(r, rbp, v.m_imm);
+    }
+    break;
+  case kind::global:
+    symbol_address(v, r);
+    if (v.m_lvalue) {
+      m_asm.load(r, r, 0, size, is_signed);
+    }
+    break;
+  case kind::spill:
+    m_asm.load(r, rbp, v.m_imm, 8, false);
+    if (v.m_lvalue) {
+      m_asm.load(r, r, 0, size, is_signed);
+    }
+    break;
+  case kind::flags:
+    m_asm.setcc(v.m_cond, r);
+    m_asm.movzx8(r, r);
+    break;
+  }
+  v.m_kind = kind::reg;
+  v.m_lvalue = false;
+  v.m_reg = r;
+}
+
+void codegen::symbol_address(const value &v, reg r) {
+  size_t at = v.m_external ? m_asm.load_rip(r) : m_asm.lea_rip(r);
+  m_module.add_relocation({section_id::text, at, v.m_symbol,
+                           v.m_external ? reloc_type::gotpcrel
+                                        : reloc_type::pc32,
+                           -4});
+}
+
+codegen::mem codegen::lvalue_mem(value &v, uint32_t avoid) {
+  switch (v.m_kind) {
+  case kind::frame:
+    return {rbp, static_cast<int32_t>(v.m_imm)};
+  case kind::reg:
+    return {v.m_reg, 0};
+  case kind::global:
+  case kind::spill: {
+    reg r = alloc(avoid);
+    if (v.m_kind == kind::global) {
+      symbol_address(v, r);
+    } else {
+      m_asm.load(r, rbp, v.m_imm, 8, false);
+    }
+    v.m_kind = kind::reg;
+    v.m_reg = r;
+    return {r, 0};
+  }
+  default:
+    throw std::logic_error("not an lvalue");
+  }
+}
+
+void codegen::normalize(reg r, qual_type type) {
+  unsigned size = size_of(type);
+  if (size >= 8) {
+    return;
+  }
+  if (size == 1 && !type->is_signed()) {
+    m_asm.movzx8(r, r);
+  } else {
+    m_asm.movsx(r, r, size);
+  }
+}
+
+bool codegen::try_fold(int op, qual_type type) {
+  value &a = m_stack[m_stack.size() - 2];
+  value &b = m_stack.back();
+  if (a.m_kind != kind::imm || b.m_kind != kind::imm) {
+    return false;
+  }
+  int64_t x = a.m_imm;
+  int64_t y = b.m_imm;
+  int64_t result;
+  switch (op) {
+  case '+':
+    result = int64_t(uint64_t(x) + uint64_t(y));
+    break;
+  case '-':
+    result = int64_t(uint64_t(x) - uint64_t(y));
+    break;
+  case '*':
+    result = int64_t(uint64_t(x) * uint64_t(y));
+    break;
+  case '/':
+  case '%':
+    // Left for run time, like the division itself would be.
+    if (y == 0 || (x == INT64_MIN && y == -1)) {
+      return false;
+    }
+    result = op == '/' ? x / y : x % y;
+    break;
+  case '&':
+    result = x & y;
+    break;
+  case '|':
+    result = x | y;
+    break;
+  case '^':
+    result = x ^ y;
+    break;
+  case LEFT_OP:
+    result = int64_t(uint64_t(x) << (y & 63));
+    break;
+  case RIGHT_OP:
+    result = x >> (y & 63);
+    break;
+  case EQ_OP:
+    result = x == y;
+    break;
+  case NE_OP:
+    result = x != y;
+    break;
+  case '<':
+    result = x < y;
+    break;
+  case '>':
+    result = x > y;
+    break;
+  case LE_OP:
+    result = x <= y;
+    break;
+  case GE_OP:
+    result = x >= y;
+    break;
+  default:
+    throw std::logic_error("unknown binary operator");
+  }
+  a.m_imm = truncate(result, type);
+  a.m_type = type;
+  m_stack.pop_back();
+  return true;
+}
+
+void codegen::binary(int op, qual_type type) {
+  if (try_fold(op, type)) {
+    return;
+  }
+  if (m_stack.back().m_kind == kind::flags) {
+    load(m_stack.back());
+  }
+  value &a = m_stack[m_stack.size() - 2];
+  value &b = m_stack.back();
+  uint32_t b_regs = b.m_kind == kind::reg ? bit(b.m_reg) : 0;
+
+  if (op == '/' || op == '%') {
+    // idiv takes the dividend in rdx:rax and leaves the quotient in rax and
+    // the remainder in rdx.
+    reg rb = load(b, bit(rax) | bit(rdx));
+    if (rb == rax || rb == rdx) {
+      reg other = alloc(bit(rax) | bit(rdx));
+      m_asm.mov(other, rb);
+      b.m_reg = rb = other;
+    }
+    if (a.m_lvalue || a.m_kind != kind::reg || a.m_reg != rax) {
+      take(rax, bit(rb));
+      load_to(a, rax);
+    }
+    take(rdx, bit(rax) | bit(rb));
+    m_asm.cqo();
+    m_asm.idiv(rb);
+    a.m_reg = op == '/' ? rax : rdx;
+  } else if (op == LEFT_OP || op == RIGHT_OP) {
+    shift_op shift = op == LEFT_OP ? shift_shl : shift_sar;
+    if (b.m_kind == kind::imm) {
+      reg ra = load(a, 0);
+      m_asm.shift_imm(shift, ra, b.m_imm & 63);
+    } else {
+      // A variable count has to be in cl.
+      if (b.m_lvalue || b.m_kind != kind::reg || b.m_reg != rcx) {
+        take(rcx, b_regs);
+        load_to(b, rcx);
+      }
+      reg ra = load(a, bit(rcx));
+      m_asm.shift(shift, ra);
+    }
+  } else {
+    reg ra = load(a, b_regs);
+    bool is_unsigned = a.m_type->m_kind == type_kind::pointer ||
+                       b.m_type->m_kind == type_kind::pointer;
+    alu_op alu;
+    switch (op) {
+    case '+':
+      alu = alu_add;
+      break;
+    case '-':
+      alu = alu_sub;
+      break;
+    case '&':
+      alu = alu_and;
+      break;
+    case '|':
+      alu = alu_or;
+      break;
+    case '^':
+      alu = alu_xor;
+      break;
+    default:
+      alu = alu_cmp;
+      break;
+    }
+    if (b.m_kind == kind::imm && b.m_imm >= INT32_MIN &&
+        b.m_imm <= INT32_MAX) {
+      if (op == '*') {
+        m_asm.imul_imm(ra, static_cast<int32_t>(b.m_imm));
+      } else {
+        m_asm.alu_imm(alu, ra, static_cast<int32_t>(b.m_imm));
+      }
+    } else {
+      reg rb = load(b, bit(ra));
+      if (op == '*') {
+        m_asm.imul(ra, rb);
+      } else {
+        m_asm.alu(alu, ra, rb);
+      }
+    }
+    if (is_comparison(op)) {
+      a.m_kind = kind::flags;
+      a.m_cond = condition(op, is_unsigned);
+      a.m_type = type;
+      m_stack.pop_back();
+      return;
+    }
+  }
+  a.m_type = type;
+  normalize(a.m_reg, type);
+  m_stack.pop_back();
+}
+
+void codegen::unary(int op, qual_type type) {
+  value &v = m_stack.back();
+  if (v.m_kind == kind::imm) {
+    v.m_imm = truncate(op == '-'   ? int64_t(0 - uint64_t(v.m_imm))
+                       : op == '~' ? ~v.m_imm
+                                   : int64_t(v.m_imm == 0),
+                       type);
+    v.m_type = type;
+    return;
+  }
+  if (op == '!' && v.m_kind == kind::flags) {
+    v.m_cond = invert(v.m_cond);
+    return;
+  }
+  reg r = load(v);
+  if (op == '!') {
+    m_asm.test(r, r);
+    v.m_kind = kind::flags;
+    v.m_cond = cc_e;
+  } else {
+    if (op == '-') {
+      m_asm.neg(r);
+    } else {
+      m_asm.not_(r);
+    }
+    normalize(r, type);
+  }
+  v.m_type = type;
+}
+
+void codegen::cast(qual_type type) {
+  value &v = m_stack.back();
+  if (type->m_kind == type_kind::void_) {
+    v.m_type = type;
+    return;
+  }
+  if (v.m_kind == kind::imm) {
+    v.m_imm = truncate(v.m_imm, type);
+  } else if (v.m_lvalue || size_of(type) < size_of(v.m_type) ||
+             v.m_kind == kind::flags) {
+    reg r = load(v);
+    if (size_of(type) < size_of(v.m_type)) {
+      normalize(r, type);
+    }
+  }
+  v.m_type = type;
+}
+
+void codegen::assign() {
+  if (m_stack.back().m_kind == kind::flags) {
+    load(m_stack.back());
+  }
+  value &target = m_stack[m_stack.size() - 2];
+  value &v = m_stack.back();
+  qual_type type = target.m_type;
+  reg r = load(v, target.m_kind == kind::reg ? bit(target.m_reg) : 0);
+  if (size_of(type) < size_of(v.m_type)) {
+    normalize(r, type);
+  }
+  mem m = lvalue_mem(target, bit(r));
+  m_asm.store(m.m_base, m.m_disp, r, size_of(type));
+  target = {.m_kind = kind::reg, .m_reg = r, .m_type = type};
+  m_stack.pop_back();
+}
+
+void codegen::address(qual_type type) {
+  value &v = m_stack.back();
+  if (!v.m_lvalue) {
+    throw std::logic_error("address of an rvalue");
+  }
+  v.m_lvalue = false;
+  v.m_type = type;
+}
+
+void codegen::deref(qual_type type) {
+  value &v = m_stack.back();
+  if (v.m_lvalue || v.m_kind == kind::imm || v.m_kind == kind::flags) {
+    load(v);
+  }
+  v.m_lvalue = true;
+  v.m_type = type;
+}
+
+void codegen::call(unsigned argc, qual_type result) {
+  if (argc > std::size(k_arg_regs)) {
+    throw std::runtime_error("More than 6 arguments are not supported");
+  }
+  size_t base = m_stack.size() - argc - 1;
+  const value &fn = m_stack[base];
+  if (fn.m_kind != kind::global || fn.m_lvalue) {
+    throw std::runtime_error("Indirect calls are not supported");
+  }
+  uint32_t symbol = fn.m_symbol;
+  // Everything is caller-saved, so nothing may stay in a register across
+  // the call. Spilling the arguments too leaves every argument register
+  // free to be loaded directly.
+  spill_all();
+  for (unsigned i = 0; i < argc; ++i) {
+    load_to(m_stack[base + 1 + i], k_arg_regs[i]);
+  }
+  // %al holds the number of vector registers used by a variadic call.
+  m_asm.mov_imm(rax, 0);
+  size_t at = m_asm.call();
+  m_module.add_relocation(
+      {section_id::text, at, symbol, reloc_type::plt32, -4});
+  m_stack.resize(base);
+  if (result->m_kind == type_kind::void_) {
+    push_int(0, result);
+  } else {
+    push({.m_kind = kind::reg, .m_reg = rax, .m_type = result});
+    normalize(rax, result);
+  }
+}
+
+codegen::label codegen::new_label() {
+  m_labels.push_back(-1);
+  return m_labels.size() - 1;
+}
+
+void codegen::jump_to(size_t at, label l) {
+  if (m_labels[l] >= 0) {
+    m_asm.patch_rel32(at, m_labels[l]);
+  } else {
+    m_fixups.emplace_back(l, at);
+  }
+}
+
+// Control flow joins see the stack with every value in memory, so both
+// sides of a join agree on where values live.
+void codegen::place(label l) {
+  spill_all();
+  m_labels[l] = m_asm.pos();
+  std::erase_if(m_fixups, [&](const auto &fixup) {
+    if (fixup.first != l) {
+      return false;
+    }
+    m_asm.patch_rel32(fixup.second, m_labels[l]);
+    return true;
+  });
+}
+
+void codegen::jump(label l) {
+  spill_all();
+  jump_to(m_asm.jmp(), l);
+}
+
+void codegen::branch(bool when, label l) {
+  value cond_value = m_stack.back();
+  m_stack.pop_back();
+  spill_all();
+  m_stack.push_back(cond_value);
+  value &v = m_stack.back();
+  if (v.m_kind == kind::imm) {
+    bool taken = (v.m_imm != 0) == when;
+    m_stack.pop_back();
+    if (taken) {
+      jump(l);
+    }
+    return;
+  }
+  cond c;
+  if (v.m_kind == kind::flags) {
+    c = v.m_cond;
+  } else {
+    reg r = load(v);
+    m_asm.test(r, r);
+    c = cc_ne;
+  }
+  m_stack.pop_back();
+  jump_to(m_asm.jcc(when ? c : invert(c)), l);
+}
+
+void codegen::ret(bool has_value) {
+  if (has_value) {
+    value &v = m_stack.back();
+    if (v.m_lvalue || v.m_kind != kind::reg || v.m_reg != rax) {
+      take(rax, v.m_kind == kind::reg ? bit(v.m_reg) : 0);
+      load_to(v, rax);
+    }
+    m_stack.pop_back();
+  }
+  jump_to(m_asm.jmp(), m_return);
+}
+} // namespace cc::x86_64
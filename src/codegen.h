@@ -0,0 +1,111 @@
+#ifndef CPPPROJECT_CODEGEN_H
+#define CPPPROJECT_CODEGEN_H
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "generator.h"
+#include "object.h"
+#include "types.h"
+#include "x86_64.h"
+
+namespace cc::x86_64 {
+// Single-pass code generator in the style of tcc. The parser drives it as a
+// stack machine: operands are pushed as values that describe where they live
+// (a constant, a register, a frame slot, a symbol, or the flags of the last
+// comparison) and code is only emitted when an operation consumes them.
+// Registers are handed out from the caller-saved set on demand and the
+// deepest register-held value is spilled to the frame when they run out.
+class codegen final : public generator {
+public:
+  explicit codegen(object_module &module);
+
+  void begin_function(std::string_view name, bool global) override;
+  int32_t param(unsigned index, qual_type type) override;
+  void end_function() override;
+  int32_t local(qual_type type) override;
+  void global_variable(std::string_view name, qual_type type, bool global,
+                       std::optional<int64_t> init) override;
+  void finish() override;
+
+  void push_int(int64_t value, qual_type type) override;
+  void push_local(int32_t slot, qual_type type) override;
+  void push_global(std::string_view name, qual_type type,
+                   bool external) override;
+  void push_function(std::string_view name, qual_type type) override;
+  void push_string(std::string_view bytes, qual_type type) override;
+  void pop() override;
+  std::optional<int64_t> pop_constant() override;
+  void dup() override;
+  void swap() override;
+
+  void address(qual_type type) override;
+  void deref(qual_type type) override;
+  void binary(int op, qual_type type) override;
+  void unary(int op, qual_type type) override;
+  void cast(qual_type type) override;
+  void assign() override;
+  void call(unsigned argc, qual_type result) override;
+
+  label new_label() override;
+  void place(label l) override;
+  void jump(label l) override;
+  void branch(bool when, label l) override;
+  void ret(bool has_value) override;
+
+private:
+  enum class kind : uint8_t { imm, reg, frame, global, spill, flags };
+
+  // Where a value lives. For lvalues this is where the object lives: a frame
+  // slot, a symbol, or the address in a register or spill slot. For
+  // rvalues of kind frame or global it is the address itself.
+  struct value {
+    kind m_kind;
+    bool m_lvalue = false;
+    bool m_external = false;
+    cond m_cond = cc_e;
+    x86_64::reg m_reg = rax;
+    uint32_t m_symbol = 0;
+    int64_t m_imm = 0;
+    qual_type m_type;
+  };
+
+  struct mem {
+    x86_64::reg m_base;
+    int32_t m_disp;
+  };
+
+  int32_t frame_slot(uint64_t size, uint64_t align);
+  void push(const value &v);
+  uint32_t used_regs() const;
+  x86_64::reg alloc(uint32_t avoid = 0);
+  void spill(value &v);
+  void spill_all();
+  void take(x86_64::reg r, uint32_t avoid);
+  x86_64::reg load(value &v, uint32_t avoid = 0);
+  void load_to(value &v, x86_64::reg r);
+  void symbol_address(const value &v, x86_64::reg r);
+  mem lvalue_mem(value &v, uint32_t avoid);
+  void normalize(x86_64::reg r, qual_type type);
+  bool try_fold(int op, qual_type type);
+  void jump_to(size_t at, label l);
+
+  object_module &m_module;
+  assembler m_asm;
+  std::vector<value> m_stack;
+
+  std::vector<int64_t> m_labels;
+  std::vector<std::pair<label, size_t>> m_fixups;
+
+  uint32_t m_function = 0;
+  bool m_function_global = false;
+  size_t m_function_start = 0;
+  size_t m_frame_patch = 0;
+  int32_t m_frame_size = 0;
+  label m_return = 0;
+};
+} // namespace cc::x86_64
+
+#endif // CPPPROJECT_CODEGEN_H
@@ -0,0 +1,26 @@
+#include "compile.h"
+
+#include <memory>
+
+#include "codegen.h"
+#include "ir_builder.h"
+#include "lexer.h"
+#include "parser.h"
+
+namespace cc {
+object_module compile(file &f, bool optimize) {
+  lexer l(f);
+  symbol_table symbols;
+  type_context types;
+  object_module module;
+  std::unique_ptr<generator> gen;
+  if (optimize) {
+    gen = std::make_unique<ir::builder>(module);
+  } else {
+    gen = std::make_unique<x86_64::codegen>(module);
+  }
+  parser p(l, symbols, types, *gen);
+  p.parse_translation_unit();
+  return module;
+}
+} // namespace cc
@@ -0,0 +1,15 @@
+#ifndef CPPPROJECT_COMPILE_H
+#define CPPPROJECT_COMPILE_H
+
+#include "file.h"
+#include "object.h"
+
+namespace cc {
+// Parses the translation unit in `f` from its current position and
+// generates code for it. With `optimize`, code goes through the SSA IR and
+// its passes instead of being emitted directly by the single-pass
+// generator.
+object_module compile(file &f, bool optimize);
+} // namespace cc
+
+#endif // CPPPROJECT_COMPILE_H
@@ -0,0 +1,248 @@
+#include "elf_writer.h"
+
+#include <elf.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+#include <string>
+
+namespace cc::elf {
+namespace {
+class string_table {
+public:
+  string_table() : m_data(1, '\0') {}
+
+  uint32_t add(std::string_view s) {
+    if (s.empty()) {
+      return 0;
+    }
+    uint32_t offset = m_data.size();
+    m_data.append(s);
+    m_data.push_back('\0');
+    return offset;
+  }
+  const std::string &data() const { return m_data; }
+
+private:
+  std::string m_data;
+};
+
+struct section {
+  std::string_view m_name;
+  Elf64_Shdr m_header{};
+  std::vector<uint8_t> m_contents;
+};
+
+uint32_t relocation_type(reloc_type type) {
+  switch (type) {
+  case reloc_type::pc32:
+    return R_X86_64_PC32;
+  case reloc_type::plt32:
+    return R_X86_64_PLT32;
+  case reloc_type::gotpcrel:
+    return R_X86_64_REX_GOTPCRELX;
+  case reloc_type::abs64:
+    return R_X86_64_64;
+  }
+  throw std::logic_error("unknown relocation type");
+}
+
+template <typename T> void append(std::vector<uint8_t> &out, const T &value) {
+  auto *bytes = reinterpret_cast<const uint8_t *>(&value);
+  out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+bool is_internal_label(const object_symbol &sym) {
+  return sym.m_name.starts_with(".L");
+}
+} // namespace
+
+std::vector<uint8_t> build_object(const object_module &module) {
+  std::vector<section> sections(1);
+  auto add_section = [&](std::string_view name, uint32_t type,
+                         uint64_t flags, uint64_t align) {
+    section &s = sections.emplace_back();
+    s.m_name = name;
+    s.m_header.sh_type = type;
+    s.m_header.sh_flags = flags;
+    s.m_header.sh_addralign = align;
+    return sections.size() - 1;
+  };
+
+  // Indexed by section_id.
+  uint32_t section_index[5] = {};
+  section_index[size_t(section_id::text)] =
+      add_section(".text", SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, 16);
+  section_index[size_t(section_id::data)] =
+      add_section(".data", SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, 8);
+  section_index[size_t(section_id::bss)] =
+      add_section(".bss", SHT_NOBITS, SHF_ALLOC | SHF_WRITE, 8);
+  section_index[size_t(section_id::rodata)] =
+      add_section(".rodata", SHT_PROGBITS, SHF_ALLOC, 8);
+  for (section_id id :
+       {section_id::text, section_id::data, section_id::rodata}) {
+    sections[section_index[size_t(id)]].m_contents = module.section(id);
+  }
+  sections[section_index[size_t(section_id::bss)]].m_header.sh_size =
+      module.bss_size();
+
+  // Symbols: the null symbol, one per section, the locals, then the
+  // globals, as ELF wants locals first. Internal labels are not emitted;
+  // relocations against them and other locals go through the section
+  // symbol, as an assembler would do.
+  string_table strtab;
+  std::vector<Elf64_Sym> symbols(1);
+  uint32_t section_symbol[5] = {};
+  for (section_id id : {section_id::text, section_id::data, section_id::bss,
+                        section_id::rodata}) {
+    Elf64_Sym sym{};
+    sym.st_info = ELF64_ST_INFO(STB_LOCAL, STT_SECTION);
+    sym.st_shndx = section_index[size_t(id)];
+    section_symbol[size_t(id)] = symbols.size();
+    symbols.push_back(sym);
+  }
+  std::vector<uint32_t> symbol_index(module.symbols().size());
+  auto emit_symbols = [&](bool global) {
+    for (size_t i = 0; i < module.symbols().size(); ++i) {
+      const object_symbol &s = module.symbols()[i];
+      bool is_undefined = s.m_section == section_id::undef;
+      if ((s.m_global || is_undefined) != global || is_internal_label(s)) {
+        continue;
+      }
+      Elf64_Sym sym{};
+      sym.st_name = strtab.add(s.m_name);
+      sym.st_info = ELF64_ST_INFO(
+          global ? STB_GLOBAL : STB_LOCAL,
+          is_undefined ? STT_NOTYPE : s.m_function ? STT_FUNC : STT_OBJECT);
+      sym.st_shndx = is_undefined ? SHN_UNDEF
+                                  : section_index[size_t(s.m_section)];
+      sym.st_value = s.m_offset;
+      sym.st_size = s.m_size;
+      symbol_index[i] = symbols.size();
+      symbols.push_back(sym);
+    }
+  };
+  emit_symbols(false);
+  uint32_t first_global = symbols.size();
+  emit_symbols(true);
+
+  std::vector<uint8_t> rela[5];
+  for (const relocation &r : module.relocations()) {
+    const object_symbol &s = module.symbols()[r.m_symbol];
+    Elf64_Rela rel{};
+    rel.r_offset = r.m_offset;
+    rel.r_addend = r.m_addend;
+    uint32_t sym = symbol_index[r.m_symbol];
+    if (!s.m_global && s.m_section != section_id::undef) {
+      sym = section_symbol[size_t(s.m_section)];
+      rel.r_addend += s.m_offset;
+    }
+    rel.r_info = ELF64_R_INFO(sym, relocation_type(r.m_type));
+    append(rela[size_t(r.m_section)], rel);
+  }
+
+  size_t symtab = add_section(".symtab", SHT_SYMTAB, 0, 8);
+  for (section_id id :
+       {section_id::text, section_id::data, section_id::rodata}) {
+    if (rela[size_t(id)].empty()) {
+      continue;
+    }
+    std::string_view name = id == section_id::text   ? ".rela.text"
+                            : id == section_id::data ? ".rela.data"
+                                                     : ".rela.rodata";
+    size_t index = add_section(name, SHT_RELA, SHF_INFO_LINK, 8);
+    sections[index].m_header.sh_link = symtab;
+    sections[index].m_header.sh_info = section_index[size_t(id)];
+    sections[index].m_header.sh_entsize = sizeof(Elf64_Rela);
+    sections[index].m_contents = std::move(rela[size_t(id)]);
+  }
+  size_t strtab_index = add_section(".strtab", SHT_STRTAB, 0, 1);
+  // Marks the object as not needing an executable stack.
+  add_section(".note.GNU-stack", SHT_PROGBITS, 0, 1);
+  size_t shstrtab = add_section(".shstrtab", SHT_STRTAB, 0, 1);
+
+  for (const Elf64_Sym &sym : symbols) {
+    append(sections[symtab].m_contents, sym);
+  }
+  sections[symtab].m_header.sh_link = strtab_index;
+  sections[symtab].m_header.sh_info = first_global;
+  sections[symtab].m_header.sh_entsize = sizeof(Elf64_Sym);
+  sections[strtab_index].m_contents.assign(strtab.data().begin(),
+                                           strtab.data().end());
+  string_table shstr;
+  for (section &s : sections) {
+    s.m_header.sh_name = shstr.add(s.m_name);
+  }
+  sections[shstrtab].m_contents.assign(shstr.data().begin(),
+                                       shstr.data().end());
+
+  // Header, section contents, then the section header table.
+  std::vector<uint8_t> out(sizeof(Elf64_Ehdr));
+  for (section &s : sections) {
+    if (s.m_header.sh_type == SHT_NULL) {
+      continue;
+    }
+    uint64_t align = std::max<uint64_t>(s.m_header.sh_addralign, 1);
+    out.resize((out.size() + align - 1) & ~(align - 1));
+    s.m_header.sh_offset = out.size();
+    if (s.m_header.sh_type != SHT_NOBITS) {
+      s.m_header.sh_size = s.m_contents.size();
+      out.insert(out.end(), s.m_contents.begin(), s.m_contents.end());
+    }
+  }
+  out.resize((out.size() + 7) & ~size_t(7));
+  uint64_t section_headers = out.size();
+  for (const section &s : sections) {
+    append(out, s.m_header);
+  }
+
+  Elf64_Ehdr header{};
+  std::memcpy(header.e_ident, ELFMAG, SELFMAG);
+  header.e_ident[EI_CLASS] = ELFCLASS64;
+  header.e_ident[EI_DATA] = ELFDATA2LSB;
+  header.e_ident[EI_VERSION] = EV_CURRENT;
+  header.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+  header.e_type = ET_REL;
+  header.e_machine = EM_X86_64;
+  header.e_version = EV_CURRENT;
+  header.e_shoff = section_headers;
+  header.e_ehsize = sizeof(Elf64_Ehdr);
+  header.e_shentsize = sizeof(Elf64_Shdr);
+  header.e_shnum = sections.size();
+  header.e_shstrndx = shstrtab;
+  std::memcpy(out.data(), &header, sizeof(header));
+  return out;
+}
+
+void write_object(const object_module &module, std::string_view path) {
+  std::vector<uint8_t> image = build_object(module);
+  std::string name(path);
+  int fd = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    throw std::runtime_error(std::format("Failed to create '{}'", path));
+  }
+  bool written = write_all(fd, image);
+  close(fd);
+  if (!written) {
+    throw std::runtime_error(std::format("Failed to write '{}'", path));
+  }
+}
+
+bool write_all(int fd, std::span<const uint8_t> image) {
+  while (!image.empty()) {
+    ssize_t n = write(fd, image.data(), image.size());
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    image = image.subspan(n);
+  }
+  return true;
+}
+} // namespace cc::elf
@@ -0,0 +1,25 @@
+#ifndef CPPPROJECT_ELF_WRITER_H
+#define CPPPROJECT_ELF_WRITER_H
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "object.h"
+
+namespace cc::elf {
+// Lays out `module` as an ELF64 x86-64 relocatable object, entirely in
+// memory.
+std::vector<uint8_t> build_object(const object_module &module);
+
+// Builds the object and writes it to `path` in one go, with no temporary
+// file in between.
+void write_object(const object_module &module, std::string_view path);
+
+// Writes all of `image` to `fd`, retrying short and interrupted writes.
+// Returns false if the write fails.
+bool write_all(int fd, std::span<const uint8_t> image);
+} // namespace cc::elf
+
+#endif // CPPPROJECT_ELF_WRITER_H
@@ -1,11 +1,12 @@
 #include "file.h"
+#include <algorithm>
 #include <fcntl.h>
 #include <stdexcept>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
-file::file(std::string_view path) {
+file::file(std::string_view path, size_t window_size) {
   int fd = open(path.data(), O_RDONLY);
   if (fd == -1) {
     throw std::runtime_error("Failed to open file");
@@ -16,23 +17,85 @@ file::file(std::string_view path) {
     throw std::runtime_error("Failed to get file size");
   }
   m_size = sb.st_size;
-  m_addr = static_cast<char *>(
-      mmap(nullptr, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0));
+  if (window_size == 0 && m_size > k_window_threshold) {
+    window_size = k_default_window;
+  }
+  if (window_size == 0 || window_size >= m_size) {
+    m_addr = static_cast<char *>(
+        mmap(nullptr, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0));
+    if (m_addr == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error("Failed to map file to memory");
+    }
+    m_mapped = true;
+    m_pos = m_addr;
+    m_limit = m_addr + m_size;
+    close(fd);
+    return;
+  }
+
+  // Reserve address space for the whole file without backing it, then map
+  // windows into the reservation as the reader reaches them. Pointers into
+  // earlier windows stay valid for the lifetime of the file, which is why
+  // the reservation is not a ring of reused windows; it counts against
+  // RLIMIT_AS like a flat mapping would.
+  size_t page = sysconf(_SC_PAGESIZE);
+  m_window = (window_size + page - 1) & ~(page - 1);
+  m_addr = static_cast<char *>(mmap(nullptr, m_size, PROT_NONE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                                    -1, 0));
   if (m_addr == MAP_FAILED) {
     close(fd);
-    throw std::runtime_error("Failed to map file to memory");
+    throw std::runtime_error("Failed to reserve memory for file");
   }
-  close(fd);
+  m_mapped = true;
+  m_fd = fd;
+  m_pos = m_addr;
+  m_limit = m_addr;
 }
 
 file::~file() {
-  if (m_addr) {
+  if (m_mapped) {
     munmap(m_addr, m_size);
   }
+  if (m_fd != -1) {
+    close(m_fd);
+  }
+}
+
+char file::peek_slow(size_t offset) {
+  while (m_pos + offset >= m_limit) {
+    if (m_limit == m_addr + m_size) {
+      return '\0';
+    }
+    map_next_window();
+  }
+  return m_pos[offset];
+}
+
+char file::get_slow() {
+  char c = peek_slow(0);
+  if (!is_eof()) {
+    ++m_pos;
+  }
+  return c;
 }
 
-char file::get() {
-  if (is_eof())
-    return '\0';
-  return *m_pos++;
+void file::map_next_window() {
+  size_t offset = m_limit - m_addr;
+  size_t length = std::min(m_window, m_size - offset);
+  if (mmap(m_limit, length, PROT_READ, MAP_PRIVATE | MAP_FIXED, m_fd,
+           offset) == MAP_FAILED) {
+    throw std::runtime_error("Failed to map file window");
+  }
+  m_limit += length;
+
+  // Keep the window the reader just left resident for tokens that straddle
+  // the boundary and drop everything older. The pages stay mapped, so stale
+  // pointers still read the right bytes; they are just faulted in again.
+  if (offset >= 2 * m_window) {
+    size_t release_end = offset - m_window;
+    madvise(m_addr + m_released, release_end - m_released, MADV_DONTNEED);
+    m_released = release_end;
+  }
 }
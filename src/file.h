@@ -5,26 +5,58 @@
 
 class file {
 public:
-  explicit file(std::string_view path);
+  // Files larger than k_window_threshold are mapped through a sliding window
+  // of k_default_window bytes instead of all at once. That bounds resident
+  // memory, not address space: the whole file still gets a reservation so
+  // that pointers into it stay valid, and a file too large for RLIMIT_AS
+  // fails to open either way.
+  static constexpr size_t k_window_threshold = size_t{1} << 30;
+  static constexpr size_t k_default_window = size_t{64} << 20;
+
+  // A window_size of zero picks flat or windowed mapping by file size.
+  explicit file(std::string_view path, size_t window_size = 0);
   explicit file(char *data, size_t size)
-      : m_addr(data), m_pos(data), m_size(size) {}
+      : m_addr(data), m_pos(data), m_limit(data + size), m_size(size) {}
   ~file();
+  file(const file &) = delete;
+  file &operator=(const file &) = delete;
 
   bool is_eof() const { return m_pos >= m_addr + m_size; }
-  char peek() const { return is_eof() ? '\0' : *m_pos; }
-  char get();
+  char peek() { return m_pos < m_limit ? *m_pos : peek_slow(0); }
+  // Looks `offset` bytes past the current position; '\0' beyond the end.
+  char peek_at(size_t offset) {
+    return m_pos + offset < m_limit ? m_pos[offset] : peek_slow(offset);
+  }
+  char get() { return m_pos < m_limit ? *m_pos++ : get_slow(); }
   void unget() {
     if (m_pos > m_addr) {
       --m_pos;
     }
   }
+  void seek(char *pos) { m_pos = pos; }
   char *pos() const { return m_pos; }
   char *begin() const { return m_addr; }
+  // End of the bytes that are mapped and can be scanned directly.
+  char *limit() const { return m_limit; }
+  size_t size() const { return m_size; }
+  bool is_windowed() const { return m_window != 0; }
+
+private:
+  char peek_slow(size_t offset);
+  char get_slow();
+  void map_next_window();
 
 private:
   char *m_addr = nullptr;
   char *m_pos = nullptr;
+  char *m_limit = nullptr;
   size_t m_size = 0;
+  // Only mappings created by the path constructor are owned; buffers passed
+  // in directly belong to the caller.
+  bool m_mapped = false;
+  int m_fd = -1;
+  size_t m_window = 0;
+  size_t m_released = 0;
 };
 
-#endif // FILE_H
\ No newline at end of file
+#endif // FILE_H
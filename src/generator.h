@@ -0,0 +1,76 @@
+#ifndef CPPPROJECT_GENERATOR_H
+#define CPPPROJECT_GENERATOR_H
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+#include "types.h"
+
+namespace cc {
+// What the parser drives as it goes: a stack machine over typed values.
+// Objects are pushed as lvalues and operators consume the top of the stack.
+// x86_64::codegen implements it by emitting machine code directly;
+// ir::builder records SSA for the optimizer.
+class generator {
+public:
+  using label = uint32_t;
+
+  virtual ~generator() = default;
+
+  virtual void begin_function(std::string_view name, bool global) = 0;
+  // Allocates the slot for parameter `index` and stores the incoming
+  // argument into it.
+  virtual int32_t param(unsigned index, qual_type type) = 0;
+  virtual void end_function() = 0;
+  // Slots are opaque handles for push_local.
+  virtual int32_t local(qual_type type) = 0;
+
+  // Defines a file-scope object, in .data when it has an initializer and in
+  // .bss otherwise.
+  virtual void global_variable(std::string_view name, qual_type type,
+                               bool global, std::optional<int64_t> init) = 0;
+  // Resolves what can be resolved within the module; call once at the end.
+  virtual void finish() = 0;
+
+  virtual void push_int(int64_t value, qual_type type) = 0;
+  virtual void push_local(int32_t slot, qual_type type) = 0;
+  // `external` objects are reached through the GOT so that they link into
+  // position-independent executables.
+  virtual void push_global(std::string_view name, qual_type type,
+                           bool external) = 0;
+  virtual void push_function(std::string_view name, qual_type type) = 0;
+  // Pushes a `char *` to a NUL-terminated copy of `bytes` in .rodata.
+  virtual void push_string(std::string_view bytes, qual_type type) = 0;
+  virtual void pop() = 0;
+  // Pops the top of the stack if it folded to a constant.
+  virtual std::optional<int64_t> pop_constant() = 0;
+  virtual void dup() = 0;
+  virtual void swap() = 0;
+
+  // Lvalue to pointer, and pointer to lvalue of `type`.
+  virtual void address(qual_type type) = 0;
+  virtual void deref(qual_type type) = 0;
+  // Arithmetic, bitwise and comparison operators, named by their token
+  // class. Operands are taken as 64-bit values; the result is converted to
+  // `type`.
+  virtual void binary(int op, qual_type type) = 0;
+  // '-', '~' and '!'.
+  virtual void unary(int op, qual_type type) = 0;
+  virtual void cast(qual_type type) = 0;
+  // [lvalue, value] -> value stored.
+  virtual void assign() = 0;
+  // [function, args...] -> result.
+  virtual void call(unsigned argc, qual_type result) = 0;
+
+  virtual label new_label() = 0;
+  virtual void place(label l) = 0;
+  virtual void jump(label l) = 0;
+  // Pops a condition and jumps to `l` if it is `when`.
+  virtual void branch(bool when, label l) = 0;
+  // Returns from the function, with the top of the stack if `has_value`.
+  virtual void ret(bool has_value) = 0;
+};
+} // namespace cc
+
+#endif // CPPPROJECT_GENERATOR_H
@@ -0,0 +1,610 @@
+#include "ir.h"
+
+#include <algorithm>
+#include <format>
+#include <unordered_map>
+
+namespace cc::ir {
+namespace {
+// Follows copies to the value they stand for, shortening the chain.
+ref resolve(function &fn, ref r) {
+  ref root = r;
+  while (fn.m_insts[root].m_op == opcode::copy) {
+    root = fn.m_insts[root].m_a;
+  }
+  while (r != root) {
+    ref next = fn.m_insts[r].m_a;
+    fn.m_insts[r].m_a = root;
+    r = next;
+  }
+  return root;
+}
+
+bool is_comparison(opcode op) {
+  return op >= opcode::eq && op <= opcode::uge;
+}
+
+bool is_binary(opcode op) {
+  return (op >= opcode::add && op <= opcode::sar) || is_comparison(op);
+}
+
+// Whether the value of `i` is already what extending it to `size` bytes
+// with `is_signed` would give.
+bool is_normalized(const inst &i, unsigned size, bool is_signed) {
+  if (size == 8) {
+    return true;
+  }
+  if (i.m_op == opcode::constant) {
+    return truncate(i.m_imm, size, is_signed) == i.m_imm;
+  }
+  if (is_comparison(i.m_op)) {
+    return true;
+  }
+  switch (i.m_op) {
+  case opcode::param:
+  case opcode::load:
+  case opcode::load_slot:
+  case opcode::call:
+  case opcode::extend:
+  case opcode::add:
+  case opcode::sub:
+  case opcode::mul:
+  case opcode::div:
+  case opcode::rem:
+  case opcode::and_:
+  case opcode::or_:
+  case opcode::xor_:
+  case opcode::shl:
+  case opcode::sar:
+  case opcode::neg:
+  case opcode::not_:
+    return i.m_size < size ? !i.m_signed || is_signed
+                           : i.m_size == size && i.m_signed == is_signed;
+  default:
+    return false;
+  }
+}
+
+const char *name(opcode op) {
+  static const char *const k_names[] = {
+      "nop",  "copy", "const", "param", "frame_addr", "symbol_addr",
+      "load", "store", "load_slot", "store_slot", "add", "sub",
+      "mul",  "div",  "rem",   "and",   "or",         "xor",
+      "shl",  "sar",  "neg",   "not",   "eq",         "ne",
+      "lt",   "le",   "gt",    "ge",    "ult",        "ule",
+      "ugt",  "uge",  "extend", "call", "phi",        "jump",
+      "branch", "ret"};
+  return k_names[static_cast<size_t>(op)];
+}
+
+class ssa_builder {
+public:
+  explicit ssa_builder(function &fn) : m_fn(fn) {}
+
+  void run() {
+    size_t blocks = m_fn.m_blocks.size();
+    m_sealed.assign(blocks, false);
+    m_filled_preds.assign(blocks, 0);
+    m_incomplete.assign(blocks, {});
+    std::vector<bool> promotable(m_fn.m_slots.size());
+    for (size_t s = 0; s < promotable.size(); ++s) {
+      promotable[s] =
+          !m_fn.m_slots[s].m_address_taken && m_fn.m_slots[s].m_size <= 8;
+    }
+    for (uint32_t b = 0; b < blocks; ++b) {
+      m_sealed[b] = m_fn.m_blocks[b].m_pred_count == 0;
+    }
+
+    for (uint32_t b = 0; b < blocks; ++b) {
+      // Phis appended past the end of the array do not move the block.
+      uint32_t first = m_fn.m_blocks[b].m_first;
+      uint32_t end = m_fn.m_blocks[b].m_end;
+      for (uint32_t i = first; i < end; ++i) {
+        opcode op = m_fn.m_insts[i].m_op;
+        if ((op != opcode::store_slot && op != opcode::load_slot) ||
+            !promotable[m_fn.m_insts[i].m_imm]) {
+          continue;
+        }
+        auto slot = static_cast<uint32_t>(m_fn.m_insts[i].m_imm);
+        if (op == opcode::store_slot) {
+          m_defs[key(slot, b)] = resolve(m_fn, m_fn.m_insts[i].m_a);
+          m_fn.m_insts[i].m_op = opcode::nop;
+          continue;
+        }
+        ref value = read(slot, b);
+        inst &load = m_fn.m_insts[i];
+        // A narrower load sees the low bytes of what was stored.
+        load.m_op = load.m_size < m_fn.m_slots[slot].m_size ? opcode::extend
+                                                            : opcode::copy;
+        load.m_a = value;
+      }
+      for_each_successor(m_fn, b, [&](uint32_t s) {
+        if (++m_filled_preds[s] == m_fn.m_blocks[s].m_pred_count) {
+          seal(s);
+        }
+      });
+    }
+  }
+
+private:
+  static uint64_t key(uint32_t slot, uint32_t b) {
+    return uint64_t(slot) << 32 | b;
+  }
+
+  ref read(uint32_t slot, uint32_t b) {
+    auto it = m_defs.find(key(slot, b));
+    if (it != m_defs.end()) {
+      return resolve(m_fn, it->second);
+    }
+    ref value;
+    if (!m_sealed[b]) {
+      value = new_phi(b);
+      m_incomplete[b].emplace_back(slot, value);
+    } else if (m_fn.m_blocks[b].m_pred_count == 1) {
+      value = read(slot, m_fn.preds(b)[0]);
+    } else {
+      // Recorded before the operands are read, so that a loop back to this
+      // block finds the phi and stops.
+      value = new_phi(b);
+      m_defs[key(slot, b)] = value;
+      value = add_operands(slot, value);
+    }
+    m_defs[key(slot, b)] = value;
+    return value;
+  }
+
+  ref new_phi(uint32_t b) {
+    uint32_t count = m_fn.m_blocks[b].m_pred_count;
+    uint32_t first = m_fn.m_operands.size();
+    m_fn.m_operands.resize(first + count, k_no_ref);
+    m_fn.m_insts.push_back(
+        {.m_op = opcode::phi, .m_block = b, .m_a = first, .m_b = count});
+    return m_fn.m_insts.size() - 1;
+  }
+
+  ref add_operands(uint32_t slot, ref phi) {
+    uint32_t b = m_fn.m_insts[phi].m_block;
+    for (uint32_t k = 0; k < m_fn.m_blocks[b].m_pred_count; ++k) {
+      ref value = read(slot, m_fn.preds(b)[k]);
+      m_fn.m_operands[m_fn.m_insts[phi].m_a + k] = value;
+    }
+    return try_remove_trivial(phi);
+  }
+
+  ref try_remove_trivial(ref phi) {
+    ref same = k_no_ref;
+    inst &p = m_fn.m_insts[phi];
+    for (uint32_t k = 0; k < p.m_b; ++k) {
+      ref op = resolve(m_fn, m_fn.m_operands[p.m_a + k]);
+      if (op == same || op == phi) {
+        continue;
+      }
+      if (same != k_no_ref) {
+        return phi;
+      }
+      same = op;
+    }
+    if (same == k_no_ref) {
+      // Only reachable from itself or from nowhere: undefined.
+      p.m_b = 0;
+      return phi;
+    }
+    p.m_op = opcode::copy;
+    p.m_a = same;
+    return same;
+  }
+
+  void seal(uint32_t b) {
+    for (size_t k = 0; k < m_incomplete[b].size(); ++k) {
+      auto [slot, phi] = m_incomplete[b][k];
+      add_operands(slot, phi);
+    }
+    m_incomplete[b].clear();
+    m_sealed[b] = true;
+  }
+
+  function &m_fn;
+  std::unordered_map<uint64_t, ref> m_defs;
+  std::vector<bool> m_sealed;
+  std::vector<uint32_t> m_filled_preds;
+  std::vector<std::vector<std::pair<uint32_t, ref>>> m_incomplete;
+};
+} // namespace
+
+int64_t truncate(int64_t v, unsigned size, bool is_signed) {
+  switch (size) {
+  case 1:
+    return is_signed ? int64_t(int8_t(v)) : int64_t(uint8_t(v));
+  case 2:
+    return int16_t(v);
+  case 4:
+    return int32_t(v);
+  default:
+    return v;
+  }
+}
+
+std::optional<int64_t> evaluate(opcode op, int64_t x, int64_t y) {
+  auto ux = uint64_t(x);
+  auto uy = uint64_t(y);
+  switch (op) {
+  case opcode::add:
+    return int64_t(ux + uy);
+  case opcode::sub:
+    return int64_t(ux - uy);
+  case opcode::mul:
+    return int64_t(ux * uy);
+  case opcode::div:
+  case opcode::rem:
+    if (y == 0 || (x == INT64_MIN && y == -1)) {
+      return std::nullopt;
+    }
+    return op == opcode::div ? x / y : x % y;
+  case opcode::and_:
+    return x & y;
+  case opcode::or_:
+    return x | y;
+  case opcode::xor_:
+    return x ^ y;
+  case opcode::shl:
+    return int64_t(ux << (uy & 63));
+  case opcode::sar:
+    return x >> (uy & 63);
+  case opcode::eq:
+    return x == y;
+  case opcode::ne:
+    return x != y;
+  case opcode::lt:
+    return x < y;
+  case opcode::le:
+    return x <= y;
+  case opcode::gt:
+    return x > y;
+  case opcode::ge:
+    return x >= y;
+  case opcode::ult:
+    return ux < uy;
+  case opcode::ule:
+    return ux <= uy;
+  case opcode::ugt:
+    return ux > uy;
+  case opcode::uge:
+    return ux >= uy;
+  default:
+    return std::nullopt;
+  }
+}
+
+void function::clear() {
+  m_symbol = 0;
+  m_global = false;
+  m_insts.clear();
+  m_blocks.clear();
+  m_operands.clear();
+  m_preds.clear();
+  m_slots.clear();
+}
+
+void compute_predecessors(function &fn) {
+  for (block &b : fn.m_blocks) {
+    b.m_pred_count = 0;
+  }
+  for (uint32_t b = 0; b < fn.m_blocks.size(); ++b) {
+    for_each_successor(fn, b,
+                       [&](uint32_t s) { ++fn.m_blocks[s].m_pred_count; });
+  }
+  uint32_t total = 0;
+  for (block &b : fn.m_blocks) {
+    b.m_preds = total;
+    total += b.m_pred_count;
+    b.m_pred_count = 0;
+  }
+  fn.m_preds.resize(total);
+  for (uint32_t b = 0; b < fn.m_blocks.size(); ++b) {
+    for_each_successor(fn, b, [&](uint32_t s) {
+      block &succ = fn.m_blocks[s];
+      fn.m_preds[succ.m_preds + succ.m_pred_count++] = b;
+    });
+  }
+}
+
+void mem2reg(function &fn) { ssa_builder(fn).run(); }
+
+void fold_constants(function &fn) {
+  for (const block &b : fn.m_blocks) {
+    for (uint32_t n = b.m_first; n < b.m_end; ++n) {
+      for_each_operand(fn, fn.m_insts[n],
+                       [&](ref &r) { r = resolve(fn, r); });
+      inst &i = fn.m_insts[n];
+      auto is_constant = [&](ref r) {
+        return fn.m_insts[r].m_op == opcode::constant;
+      };
+      auto make_constant = [&](int64_t value) {
+        i = {.m_op = opcode::constant, .m_block = i.m_block, .m_imm = value};
+      };
+      auto make_copy = [&](ref r) {
+        i.m_op = opcode::copy;
+        i.m_a = r;
+      };
+
+      if (i.m_op == opcode::phi) {
+        ref same = k_no_ref;
+        bool agree = true;
+        for (ref r : fn.operands(i)) {
+          if (r == same || r == n) {
+            continue;
+          }
+          if (same != k_no_ref) {
+            agree = false;
+            break;
+          }
+          same = r;
+        }
+        if (agree) {
+          same == k_no_ref ? make_constant(0) : make_copy(same);
+        }
+      } else if (is_binary(i.m_op)) {
+        int64_t x = fn.m_insts[i.m_a].m_imm;
+        int64_t y = fn.m_insts[i.m_b].m_imm;
+        bool a_constant = is_constant(i.m_a);
+        bool b_constant = is_constant(i.m_b);
+        std::optional<int64_t> result;
+        if (a_constant && b_constant && (result = evaluate(i.m_op, x, y))) {
+          make_constant(truncate(*result, i.m_size, i.m_signed));
+        } else if (b_constant && y == 0 &&
+                   (i.m_op == opcode::add || i.m_op == opcode::sub ||
+                    i.m_op == opcode::or_ || i.m_op == opcode::xor_ ||
+                    i.m_op == opcode::shl || i.m_op == opcode::sar)) {
+          i.m_op = opcode::extend;
+        } else if (b_constant && y == 1 &&
+                   (i.m_op == opcode::mul || i.m_op == opcode::div)) {
+          i.m_op = opcode::extend;
+        } else if (b_constant && y == 0 &&
+                   (i.m_op == opcode::mul || i.m_op == opcode::and_)) {
+          make_constant(0);
+        }
+      } else if (i.m_op == opcode::neg || i.m_op == opcode::not_) {
+        if (is_constant(i.m_a)) {
+          int64_t x = fn.m_insts[i.m_a].m_imm;
+          int64_t y = i.m_op == opcode::neg ? int64_t(0 - uint64_t(x)) : ~x;
+          make_constant(truncate(y, i.m_size, i.m_signed));
+        }
+      }
+
+      // Not an else: the identities above leave an extend behind.
+      if (i.m_op == opcode::extend) {
+        const inst &value = fn.m_insts[i.m_a];
+        if (value.m_op == opcode::constant) {
+          make_constant(truncate(value.m_imm, i.m_size, i.m_signed));
+        } else if (is_normalized(value, i.m_size, i.m_signed)) {
+          make_copy(i.m_a);
+        }
+      }
+    }
+  }
+}
+
+void eliminate_dead_code(function &fn) {
+  std::vector<bool> live(fn.m_insts.size());
+  std::vector<ref> work;
+  auto mark = [&](ref &r) {
+    r = resolve(fn, r);
+    if (!live[r]) {
+      live[r] = true;
+      work.push_back(r);
+    }
+  };
+  for (ref n = 0; n < fn.m_insts.size(); ++n) {
+    if (has_side_effects(fn.m_insts[n].m_op)) {
+      live[n] = true;
+      work.push_back(n);
+    }
+  }
+  while (!work.empty()) {
+    ref n = work.back();
+    work.pop_back();
+    for_each_operand(fn, fn.m_insts[n], mark);
+  }
+  for (ref n = 0; n < fn.m_insts.size(); ++n) {
+    if (!live[n]) {
+      fn.m_insts[n].m_op = opcode::nop;
+    }
+  }
+}
+
+void compact(function &fn) {
+  for (inst &i : fn.m_insts) {
+    if (i.m_op != opcode::nop && i.m_op != opcode::copy) {
+      for_each_operand(fn, i, [&](ref &r) { r = resolve(fn, r); });
+    }
+  }
+
+  // A stable counting sort on the block and then phis, constants, the rest
+  // and the terminator. Constants may have been phis that were appended to
+  // the array, and have no operands, so they can always go first.
+  size_t buckets = fn.m_blocks.size() * 4;
+  std::vector<uint32_t> start(buckets + 1);
+  auto bucket = [](const inst &i) {
+    uint32_t rank = i.m_op == opcode::phi        ? 0
+                    : i.m_op == opcode::constant ? 1
+                    : is_terminator(i.m_op)      ? 3
+                                                 : 2;
+    return i.m_block * 4 + rank;
+  };
+  auto is_kept = [](const inst &i) {
+    return i.m_op != opcode::nop && i.m_op != opcode::copy;
+  };
+  for (const inst &i : fn.m_insts) {
+    if (is_kept(i)) {
+      ++start[bucket(i) + 1];
+    }
+  }
+  for (size_t k = 0; k < buckets; ++k) {
+    start[k + 1] += start[k];
+  }
+  for (uint32_t b = 0; b < fn.m_blocks.size(); ++b) {
+    fn.m_blocks[b].m_first = start[b * 4];
+    fn.m_blocks[b].m_end = start[b * 4 + 4];
+  }
+
+  std::vector<ref> index(fn.m_insts.size(), k_no_ref);
+  std::vector<inst> insts(start[buckets]);
+  for (ref n = 0; n < fn.m_insts.size(); ++n) {
+    if (is_kept(fn.m_insts[n])) {
+      index[n] = start[bucket(fn.m_insts[n])]++;
+    }
+  }
+  std::vector<ref> operands;
+  operands.reserve(fn.m_operands.size());
+  for (ref n = 0; n < fn.m_insts.size(); ++n) {
+    if (index[n] == k_no_ref) {
+      continue;
+    }
+    inst i = fn.m_insts[n];
+    if (i.m_op == opcode::call || i.m_op == opcode::phi) {
+      uint32_t first = operands.size();
+      operands.insert(operands.end(), fn.m_operands.begin() + i.m_a,
+                      fn.m_operands.begin() + i.m_a + i.m_b);
+      i.m_a = first;
+    }
+    insts[index[n]] = i;
+  }
+  fn.m_insts = std::move(insts);
+  fn.m_operands = std::move(operands);
+  for (inst &i : fn.m_insts) {
+    for_each_operand(fn, i, [&](ref &r) { r = index[r]; });
+  }
+}
+
+void order_blocks(function &fn) {
+  size_t n_blocks = fn.m_blocks.size();
+  std::vector<uint32_t> order;
+  order.reserve(n_blocks);
+  std::vector<bool> seen(n_blocks, false);
+  // Iterative depth-first search; each entry is a block and how many of its
+  // successors have been visited.
+  std::vector<std::pair<uint32_t, uint32_t>> stack{{0, 0}};
+  seen[0] = true;
+  while (!stack.empty()) {
+    auto &[b, visited] = stack.back();
+    uint32_t succs[2];
+    uint32_t count = 0;
+    for_each_successor(fn, b, [&](uint32_t s) { succs[count++] = s; });
+    if (count == 2 && succs[0] < succs[1]) {
+      std::swap(succs[0], succs[1]);
+    }
+    if (visited == count) {
+      order.push_back(b);
+      stack.pop_back();
+      continue;
+    }
+    uint32_t s = succs[visited++];
+    if (!seen[s]) {
+      seen[s] = true;
+      stack.emplace_back(s, 0);
+    }
+  }
+  std::reverse(order.begin(), order.end());
+  for (uint32_t b = 0; b < n_blocks; ++b) {
+    if (!seen[b]) {
+      order.push_back(b);
+    }
+  }
+
+  std::vector<uint32_t> new_id(n_blocks);
+  for (uint32_t k = 0; k < n_blocks; ++k) {
+    new_id[order[k]] = k;
+  }
+  // Phi operands follow the predecessors, which are about to be renumbered.
+  std::vector<uint32_t> old_preds = fn.m_preds;
+  std::vector<block> old_blocks = fn.m_blocks;
+  for (inst &i : fn.m_insts) {
+    i.m_block = new_id[i.m_block];
+    if (i.m_op == opcode::jump || i.m_op == opcode::branch) {
+      i.m_imm = new_id[i.m_imm];
+    }
+    if (i.m_op == opcode::branch) {
+      i.m_b = new_id[i.m_b];
+    }
+  }
+  for (uint32_t k = 0; k < n_blocks; ++k) {
+    fn.m_blocks[k] = old_blocks[order[k]];
+  }
+  compute_predecessors(fn);
+  std::vector<ref> args;
+  for (inst &i : fn.m_insts) {
+    if (i.m_op != opcode::phi || i.m_b == 0) {
+      continue;
+    }
+    const block &old = old_blocks[order[i.m_block]];
+    auto first = old_preds.begin() + old.m_preds;
+    auto last = first + old.m_pred_count;
+    args.assign(fn.m_operands.begin() + i.m_a,
+                fn.m_operands.begin() + i.m_a + i.m_b);
+    auto preds = fn.preds(i.m_block);
+    for (uint32_t k = 0; k < preds.size(); ++k) {
+      auto at = std::find(first, last, order[preds[k]]) - first;
+      fn.m_operands[i.m_a + k] = args[at];
+    }
+  }
+  compact(fn);
+}
+
+void optimize(function &fn) {
+  mem2reg(fn);
+  compact(fn);
+  fold_constants(fn);
+  eliminate_dead_code(fn);
+  compact(fn);
+  order_blocks(fn);
+}
+
+std::string dump(const function &fn) {
+  std::string out;
+  for (uint32_t b = 0; b < fn.m_blocks.size(); ++b) {
+    out += std::format("b{}:", b);
+    for (uint32_t p : fn.preds(b)) {
+      out += std::format(" b{}", p);
+    }
+    out += '\n';
+    for (ref n = fn.m_blocks[b].m_first; n < fn.m_blocks[b].m_end; ++n) {
+      inst i = fn.m_insts[n];
+      out += has_value(i.m_op) ? std::format("  %{} = {}", n, name(i.m_op))
+                               : std::format("  {}", name(i.m_op));
+      std::string args;
+      auto arg = [&](std::string s) {
+        args += args.empty() ? " " : ", ";
+        args += s;
+      };
+      switch (i.m_op) {
+      case opcode::constant:
+      case opcode::param:
+      case opcode::frame_addr:
+      case opcode::symbol_addr:
+      case opcode::load_slot:
+        arg(std::to_string(i.m_imm));
+        break;
+      case opcode::store_slot:
+        arg(std::to_string(i.m_imm));
+        arg(std::format("%{}", i.m_a));
+        break;
+      case opcode::call:
+        arg(std::format("@{}", i.m_imm));
+        [[fallthrough]];
+      default:
+        for_each_operand(fn, i, [&](ref r) { arg(std::format("%{}", r)); });
+        break;
+      }
+      if (i.m_op == opcode::jump) {
+        arg(std::format("b{}", i.m_imm));
+      } else if (i.m_op == opcode::branch) {
+        arg(std::format("b{}", i.m_b));
+        arg(std::format("b{}", i.m_imm));
+      }
+      out += args;
+      out += '\n';
+    }
+  }
+  return out;
+}
+} // namespace cc::ir
@@ -0,0 +1,248 @@
+#ifndef CPPPROJECT_IR_H
+#define CPPPROJECT_IR_H
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace cc::ir {
+// Values are named by their index in function::m_insts.
+using ref = uint32_t;
+constexpr ref k_no_ref = std::numeric_limits<ref>::max();
+
+enum class opcode : uint8_t {
+  // Left behind by passes; dropped by compact().
+  nop,
+  // Stands for m_a; dropped by compact(), which rewrites its uses.
+  copy,
+  constant,
+  // Incoming argument m_imm.
+  param,
+  // Address of slot m_imm.
+  frame_addr,
+  // Address of object symbol m_imm, through the GOT if m_external.
+  symbol_addr,
+  // m_size bytes at address m_a, and m_b stored there.
+  load,
+  store,
+  // Slot m_imm accessed directly; mem2reg promotes these.
+  load_slot,
+  store_slot,
+  add,
+  sub,
+  mul,
+  div,
+  rem,
+  and_,
+  or_,
+  xor_,
+  // Shift counts are taken modulo 64.
+  shl,
+  sar,
+  neg,
+  not_,
+  // Comparisons yield 0 or 1.
+  eq,
+  ne,
+  lt,
+  le,
+  gt,
+  ge,
+  ult,
+  ule,
+  ugt,
+  uge,
+  // m_a truncated to m_size bytes and extended back.
+  extend,
+  // Direct call of symbol m_imm.
+  call,
+  // One operand per predecessor, in predecessor order. With no operands the
+  // value is undefined.
+  phi,
+  // Terminators. jump goes to block m_imm; branch goes to block m_b if m_a
+  // is nonzero and to block m_imm otherwise; ret returns m_a if it is set.
+  jump,
+  branch,
+  ret,
+};
+
+// Operands are stored inline but uses are not: no instruction knows who
+// reads it. A pass that replaces a value turns it into a copy of the
+// replacement, later passes see through copies as they read operands, and
+// compact() rewrites every operand once at the end. That keeps each pass a
+// linear walk over the arrays without def-use lists to keep in sync while
+// instructions are rewritten.
+//
+// 24 bytes. Every value is 64 bits wide; m_size and m_signed give the width
+// a result is normalized to, or the width of a memory access. call and phi
+// keep their operands in function::m_operands[m_a, m_a + m_b).
+struct inst {
+  opcode m_op;
+  uint8_t m_size = 8;
+  bool m_signed = true;
+  bool m_external = false;
+  uint32_t m_block = 0;
+  ref m_a = k_no_ref;
+  ref m_b = k_no_ref;
+  int64_t m_imm = 0;
+};
+
+// A run of instructions ending in exactly one terminator, and the range of
+// its predecessors in function::m_preds.
+struct block {
+  uint32_t m_first = 0;
+  uint32_t m_end = 0;
+  uint32_t m_preds = 0;
+  uint32_t m_pred_count = 0;
+};
+
+struct slot {
+  uint32_t m_size;
+  uint32_t m_align;
+  bool m_address_taken = false;
+};
+
+struct function {
+  uint32_t m_symbol = 0;
+  bool m_global = false;
+  std::vector<inst> m_insts;
+  std::vector<block> m_blocks;
+  std::vector<ref> m_operands;
+  std::vector<uint32_t> m_preds;
+  std::vector<slot> m_slots;
+
+  void clear();
+  std::span<const ref> operands(const inst &i) const {
+    return {m_operands.data() + i.m_a, i.m_b};
+  }
+  std::span<const uint32_t> preds(uint32_t b) const {
+    return {m_preds.data() + m_blocks[b].m_preds, m_blocks[b].m_pred_count};
+  }
+  const inst &terminator(uint32_t b) const {
+    return m_insts[m_blocks[b].m_end - 1];
+  }
+};
+
+inline bool is_terminator(opcode op) {
+  return op == opcode::jump || op == opcode::branch || op == opcode::ret;
+}
+
+// Whether the instruction must stay even if its value is unused.
+inline bool has_side_effects(opcode op) {
+  return op == opcode::store || op == opcode::store_slot ||
+         op == opcode::call || is_terminator(op);
+}
+
+// Whether the instruction produces a value.
+inline bool has_value(opcode op) {
+  return op != opcode::nop && op != opcode::store &&
+         op != opcode::store_slot && !is_terminator(op);
+}
+
+// Calls `f(ref &)` on every value operand of `i`, or `f(const ref &)` when
+// the function is const.
+template <typename Function, typename Inst, typename F>
+void for_each_operand(Function &fn, Inst &i, F f) {
+  switch (i.m_op) {
+  case opcode::call:
+  case opcode::phi:
+    for (uint32_t k = 0; k < i.m_b; ++k) {
+      f(fn.m_operands[i.m_a + k]);
+    }
+    return;
+  case opcode::store:
+    f(i.m_a);
+    f(i.m_b);
+    return;
+  case opcode::add:
+  case opcode::sub:
+  case opcode::mul:
+  case opcode::div:
+  case opcode::rem:
+  case opcode::and_:
+  case opcode::or_:
+  case opcode::xor_:
+  case opcode::shl:
+  case opcode::sar:
+  case opcode::eq:
+  case opcode::ne:
+  case opcode::lt:
+  case opcode::le:
+  case opcode::gt:
+  case opcode::ge:
+  case opcode::ult:
+  case opcode::ule:
+  case opcode::ugt:
+  case opcode::uge:
+    f(i.m_a);
+    f(i.m_b);
+    return;
+  case opcode::copy:
+  case opcode::load:
+  case opcode::store_slot:
+  case opcode::neg:
+  case opcode::not_:
+  case opcode::extend:
+  case opcode::branch:
+    f(i.m_a);
+    return;
+  case opcode::ret:
+    if (i.m_a != k_no_ref) {
+      f(i.m_a);
+    }
+    return;
+  default:
+    return;
+  }
+}
+
+// Calls `f(uint32_t)` on each successor of block `b`.
+template <typename F> void for_each_successor(const function &fn, uint32_t b,
+                                              F f) {
+  const inst &t = fn.terminator(b);
+  if (t.m_op == opcode::branch) {
+    f(t.m_b);
+  }
+  if (t.m_op == opcode::jump || t.m_op == opcode::branch) {
+    f(static_cast<uint32_t>(t.m_imm));
+  }
+}
+
+// `v` truncated to `size` bytes and extended back. `is_signed` only matters
+// for one byte: the parser rejects `unsigned` and `_Bool`, so wider narrow
+// values are always signed, and the lowering sign-extends them the same way.
+int64_t truncate(int64_t v, unsigned size, bool is_signed);
+// The result of a binary operation on constants, unless it would trap.
+std::optional<int64_t> evaluate(opcode op, int64_t x, int64_t y);
+
+// Rebuilds the predecessor lists from the terminators.
+void compute_predecessors(function &fn);
+
+// Promotes slots whose address is never taken to SSA values, inserting phis
+// where control flow joins (Braun et al., "Simple and Efficient
+// Construction of Static Single Assignment Form").
+void mem2reg(function &fn);
+// One pass in block order folding constant operations, algebraic
+// identities and phis whose operands agree.
+void fold_constants(function &fn);
+// Drops instructions whose values are never used.
+void eliminate_dead_code(function &fn);
+// Renumbers the instructions block by block, phis first and terminator
+// last, dropping nops and copies and rewriting every operand.
+void compact(function &fn);
+// Lays the blocks out in reverse postorder, taking the later of two
+// successors first, so that a loop's blocks follow its header and only back
+// edges jump up. Blocks that cannot be reached go last. Leaves the function
+// compact.
+void order_blocks(function &fn);
+// mem2reg, folding, dead code elimination and block ordering, leaving the
+// function compact.
+void optimize(function &fn);
+
+std::string dump(const function &fn);
+} // namespace cc::ir
+
+#endif // CPPPROJECT_IR_H
@@ -0,0 +1,424 @@
+#include "ir_builder.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "lexer.h"
+#include "lower.h"
+
+namespace cc::ir {
+namespace {
+constexpr uint32_t k_no_block = std::numeric_limits<uint32_t>::max();
+constexpr unsigned k_max_args = 6;
+
+unsigned size_of(qual_type type) {
+  return type->m_kind == type_kind::pointer ? 8 : type->m_size;
+}
+
+opcode binary_opcode(int op, bool is_unsigned) {
+  switch (op) {
+  case '+':
+    return opcode::add;
+  case '-':
+    return opcode::sub;
+  case '*':
+    return opcode::mul;
+  case '/':
+    return opcode::div;
+  case '%':
+    return opcode::rem;
+  case '&':
+    return opcode::and_;
+  case '|':
+    return opcode::or_;
+  case '^':
+    return opcode::xor_;
+  case LEFT_OP:
+    return opcode::shl;
+  case RIGHT_OP:
+    return opcode::sar;
+  case EQ_OP:
+    return opcode::eq;
+  case NE_OP:
+    return opcode::ne;
+  case '<':
+    return is_unsigned ? opcode::ult : opcode::lt;
+  case '>':
+    return is_unsigned ? opcode::ugt : opcode::gt;
+  case LE_OP:
+    return is_unsigned ? opcode::ule : opcode::le;
+  case GE_OP:
+    return is_unsigned ? opcode::uge : opcode::ge;
+  default:
+    throw std::logic_error("unknown binary operator");
+  }
+}
+} // namespace
+
+builder::builder(object_module &module, bool optimize)
+    : m_module(module), m_optimize(optimize) {}
+
+void builder::begin_function(std::string_view name, bool global) {
+  m_fn.clear();
+  m_fn.m_symbol = m_module.symbol(name);
+  m_fn.m_global = global;
+  m_label_blocks.clear();
+  open_block(k_no_block);
+}
+
+int32_t builder::param(unsigned index, qual_type type) {
+  if (index >= k_max_args) {
+    throw std::runtime_error("More than 6 parameters are not supported");
+  }
+  int32_t slot = local(type);
+  ref value = emit({.m_op = opcode::param,
+                    .m_size = static_cast<uint8_t>(size_of(type)),
+                    .m_signed = type->is_signed(),
+                    .m_imm = index});
+  emit({.m_op = opcode::store_slot,
+        .m_size = static_cast<uint8_t>(size_of(type)),
+        .m_a = value,
+        .m_imm = slot});
+  return slot;
+}
+
+void builder::end_function() {
+  // Falling off the end returns 0, which is what main needs.
+  if (!m_terminated) {
+    emit({.m_op = opcode::ret, .m_a = constant(0)});
+  }
+  if (!m_stack.empty()) {
+    throw std::logic_error("unbalanced code generation");
+  }
+  auto block_of = [&](int64_t l) {
+    uint32_t b = m_label_blocks[l];
+    if (b == k_no_block) {
+      throw std::logic_error("jump to a label that was never placed");
+    }
+    return b;
+  };
+  for (inst &i : m_fn.m_insts) {
+    if (i.m_op == opcode::jump || i.m_op == opcode::branch) {
+      i.m_imm = block_of(i.m_imm);
+    }
+    if (i.m_op == opcode::branch) {
+      i.m_b = block_of(i.m_b);
+    }
+  }
+  compute_predecessors(m_fn);
+  if (m_optimize) {
+    optimize(m_fn);
+  }
+  x86_64::lower(m_fn, m_module);
+}
+
+int32_t builder::local(qual_type type) {
+  m_fn.m_slots.push_back({static_cast<uint32_t>(std::max<uint64_t>(
+                              type->m_size, 1)),
+                          std::max<uint32_t>(type->m_align, 1)});
+  return m_fn.m_slots.size() - 1;
+}
+
+void builder::global_variable(std::string_view name, qual_type type,
+                              bool global, std::optional<int64_t> init) {
+  m_module.define_object(m_module.symbol(name), type->m_size, type->m_align,
+                         global, init);
+}
+
+void builder::finish() { m_module.resolve_local_relocations(); }
+
+ref builder::emit(inst i) {
+  // Code after a jump or return is unreachable but still gets a block.
+  if (m_terminated) {
+    open_block(k_no_block);
+  }
+  i.m_block = m_fn.m_blocks.size() - 1;
+  m_fn.m_insts.push_back(i);
+  m_fn.m_blocks.back().m_end = m_fn.m_insts.size();
+  m_terminated = is_terminator(i.m_op);
+  return m_fn.m_insts.size() - 1;
+}
+
+void builder::open_block(label l) {
+  uint32_t first = m_fn.m_insts.size();
+  m_fn.m_blocks.push_back({first, first});
+  if (l != k_no_block) {
+    m_label_blocks[l] = m_fn.m_blocks.size() - 1;
+  }
+  m_terminated = false;
+}
+
+ref builder::constant(int64_t value) {
+  return emit({.m_op = opcode::constant, .m_imm = value});
+}
+
+std::optional<int64_t> builder::constant_value(ref r) const {
+  const inst &i = m_fn.m_insts[r];
+  if (i.m_op != opcode::constant) {
+    return std::nullopt;
+  }
+  return i.m_imm;
+}
+
+ref builder::normalized(ref r, qual_type type) {
+  unsigned size = size_of(type);
+  if (size >= 8) {
+    return r;
+  }
+  if (auto c = constant_value(r)) {
+    return constant(truncate(*c, size, type->is_signed()));
+  }
+  return emit({.m_op = opcode::extend,
+               .m_size = static_cast<uint8_t>(size),
+               .m_signed = type->is_signed(),
+               .m_a = r});
+}
+
+ref builder::rvalue(const value &v) {
+  switch (v.m_kind) {
+  case kind::rvalue:
+    return v.m_ref;
+  case kind::slot:
+    return emit({.m_op = opcode::load_slot,
+                 .m_size = static_cast<uint8_t>(size_of(v.m_type)),
+                 .m_signed = v.m_type->is_signed(),
+                 .m_imm = v.m_slot});
+  case kind::memory:
+    return emit({.m_op = opcode::load,
+                 .m_size = static_cast<uint8_t>(size_of(v.m_type)),
+                 .m_signed = v.m_type->is_signed(),
+                 .m_a = v.m_ref});
+  }
+  throw std::logic_error("unknown value kind");
+}
+
+ref builder::pop_rvalue() {
+  value v = m_stack.back();
+  m_stack.pop_back();
+  return rvalue(v);
+}
+
+void builder::push_int(int64_t value, qual_type type) {
+  m_stack.push_back({kind::rvalue, constant(value), 0, type});
+}
+
+void builder::push_local(int32_t slot, qual_type type) {
+  m_stack.push_back({kind::slot, k_no_ref, slot, type});
+}
+
+void builder::push_global(std::string_view name, qual_type type,
+                          bool external) {
+  ref address = emit({.m_op = opcode::symbol_addr,
+                      .m_external = external,
+                      .m_imm = m_module.symbol(name)});
+  m_stack.push_back({kind::memory, address, 0, type});
+}
+
+void builder::push_function(std::string_view name, qual_type type) {
+  ref address =
+      emit({.m_op = opcode::symbol_addr, .m_imm = m_module.symbol(name)});
+  m_stack.push_back({kind::rvalue, address, 0, type});
+}
+
+void builder::push_string(std::string_view bytes, qual_type type) {
+  ref address = emit(
+      {.m_op = opcode::symbol_addr, .m_imm = m_module.add_string(bytes)});
+  m_stack.push_back({kind::rvalue, address, 0, type});
+}
+
+void builder::pop() { m_stack.pop_back(); }
+
+std::optional<int64_t> builder::pop_constant() {
+  const value &v = m_stack.back();
+  if (v.m_kind != kind::rvalue) {
+    return std::nullopt;
+  }
+  auto c = constant_value(v.m_ref);
+  if (c) {
+    m_stack.pop_back();
+  }
+  return c;
+}
+
+void builder::dup() { m_stack.push_back(value(m_stack.back())); }
+
+void builder::swap() {
+  std::swap(m_stack.back(), m_stack[m_stack.size() - 2]);
+}
+
+void builder::address(qual_type type) {
+  value &v = m_stack.back();
+  switch (v.m_kind) {
+  case kind::slot:
+    m_fn.m_slots[v.m_slot].m_address_taken = true;
+    v.m_ref = emit({.m_op = opcode::frame_addr, .m_imm = v.m_slot});
+    break;
+  case kind::memory:
+    break;
+  case kind::rvalue:
+    throw std::logic_error("address of an rvalue");
+  }
+  v.m_kind = kind::rvalue;
+  v.m_type = type;
+}
+
+void builder::deref(qual_type type) {
+  ref address = pop_rvalue();
+  m_stack.push_back({kind::memory, address, 0, type});
+}
+
+void builder::binary(int op, qual_type type) {
+  value b = m_stack.back();
+  m_stack.pop_back();
+  value a = m_stack.back();
+  m_stack.pop_back();
+  bool is_unsigned = a.m_type->m_kind == type_kind::pointer ||
+                     b.m_type->m_kind == type_kind::pointer;
+  ref ra = rvalue(a);
+  ref rb = rvalue(b);
+  opcode code = binary_opcode(op, is_unsigned);
+  unsigned size = size_of(type);
+  auto x = constant_value(ra);
+  auto y = constant_value(rb);
+  if (x && y) {
+    // Division by zero is left for run time, as the single-pass generator
+    // does.
+    if (auto result = evaluate(code, *x, *y)) {
+      push_int(truncate(*result, size, type->is_signed()), type);
+      return;
+    }
+  }
+  ref r = emit({.m_op = code,
+                .m_size = static_cast<uint8_t>(size),
+                .m_signed = type->is_signed(),
+                .m_a = ra,
+                .m_b = rb});
+  m_stack.push_back({kind::rvalue, r, 0, type});
+}
+
+void builder::unary(int op, qual_type type) {
+  if (op == '!') {
+    push_int(0, type);
+    binary(EQ_OP, type);
+    return;
+  }
+  ref a = pop_rvalue();
+  unsigned size = size_of(type);
+  if (auto x = constant_value(a)) {
+    int64_t result = op == '-' ? int64_t(0 - uint64_t(*x)) : ~*x;
+    push_int(truncate(result, size, type->is_signed()), type);
+    return;
+  }
+  ref r = emit({.m_op = op == '-' ? opcode::neg : opcode::not_,
+                .m_size = static_cast<uint8_t>(size),
+                .m_signed = type->is_signed(),
+                .m_a = a});
+  m_stack.push_back({kind::rvalue, r, 0, type});
+}
+
+void builder::cast(qual_type type) {
+  if (type->m_kind == type_kind::void_) {
+    m_stack.back().m_type = type;
+    return;
+  }
+  value v = m_stack.back();
+  m_stack.pop_back();
+  ref r = rvalue(v);
+  if (size_of(type) < size_of(v.m_type)) {
+    r = normalized(r, type);
+  }
+  m_stack.push_back({kind::rvalue, r, 0, type});
+}
+
+void builder::assign() {
+  value v = m_stack.back();
+  m_stack.pop_back();
+  value target = m_stack.back();
+  m_stack.pop_back();
+  qual_type type = target.m_type;
+  ref r = rvalue(v);
+  if (size_of(type) < size_of(v.m_type)) {
+    r = normalized(r, type);
+  }
+  auto size = static_cast<uint8_t>(size_of(type));
+  if (target.m_kind == kind::slot) {
+    emit({.m_op = opcode::store_slot,
+          .m_size = size,
+          .m_a = r,
+          .m_imm = target.m_slot});
+  } else if (target.m_kind == kind::memory) {
+    emit({.m_op = opcode::store, .m_size = size, .m_a = target.m_ref,
+          .m_b = r});
+  } else {
+    throw std::logic_error("not an lvalue");
+  }
+  m_stack.push_back({kind::rvalue, r, 0, type});
+}
+
+void builder::call(unsigned argc, qual_type result) {
+  if (argc > k_max_args) {
+    throw std::runtime_error("More than 6 arguments are not supported");
+  }
+  size_t base = m_stack.size() - argc - 1;
+  const value &fn = m_stack[base];
+  if (fn.m_kind != kind::rvalue ||
+      m_fn.m_insts[fn.m_ref].m_op != opcode::symbol_addr) {
+    throw std::runtime_error("Indirect calls are not supported");
+  }
+  int64_t symbol = m_fn.m_insts[fn.m_ref].m_imm;
+  ref args[k_max_args];
+  for (unsigned i = 0; i < argc; ++i) {
+    args[i] = rvalue(m_stack[base + 1 + i]);
+  }
+  uint32_t first = m_fn.m_operands.size();
+  m_fn.m_operands.insert(m_fn.m_operands.end(), args, args + argc);
+  m_stack.resize(base);
+  bool is_void = result->m_kind == type_kind::void_;
+  ref r = emit({.m_op = opcode::call,
+                .m_size = static_cast<uint8_t>(is_void ? 8 : size_of(result)),
+                .m_signed = result->is_signed(),
+                .m_a = first,
+                .m_b = argc,
+                .m_imm = symbol});
+  if (is_void) {
+    push_int(0, result);
+  } else {
+    m_stack.push_back({kind::rvalue, r, 0, result});
+  }
+}
+
+generator::label builder::new_label() {
+  m_label_blocks.push_back(k_no_block);
+  return m_label_blocks.size() - 1;
+}
+
+void builder::place(label l) {
+  if (!m_terminated) {
+    jump(l);
+  }
+  open_block(l);
+}
+
+void builder::jump(label l) { emit({.m_op = opcode::jump, .m_imm = l}); }
+
+void builder::branch(bool when, label l) {
+  ref c = pop_rvalue();
+  if (auto x = constant_value(c)) {
+    if ((*x != 0) == when) {
+      jump(l);
+    }
+    return;
+  }
+  label next = new_label();
+  emit({.m_op = opcode::branch,
+        .m_a = c,
+        .m_b = when ? l : next,
+        .m_imm = when ? next : l});
+  open_block(next);
+}
+
+void builder::ret(bool has_value) {
+  ref r = has_value ? pop_rvalue() : k_no_ref;
+  emit({.m_op = opcode::ret, .m_a = r});
+}
+} // namespace cc::ir
@@ -0,0 +1,90 @@
+#ifndef CPPPROJECT_IR_BUILDER_H
+#define CPPPROJECT_IR_BUILDER_H
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "generator.h"
+#include "ir.h"
+#include "object.h"
+
+namespace cc::ir {
+// Records each function as IR while the parser drives the stack machine,
+// then optimizes it and lowers it to machine code when the function ends.
+// Locals are accessed through load_slot and store_slot, the way the
+// single-pass generator accesses frame slots, and mem2reg turns them into
+// SSA values afterwards. Operations on constants fold as they are built.
+class builder final : public generator {
+public:
+  explicit builder(object_module &module, bool optimize = true);
+
+  // The last function built, as it was handed to the backend.
+  const function &last_function() const { return m_fn; }
+
+  void begin_function(std::string_view name, bool global) override;
+  int32_t param(unsigned index, qual_type type) override;
+  void end_function() override;
+  int32_t local(qual_type type) override;
+  void global_variable(std::string_view name, qual_type type, bool global,
+                       std::optional<int64_t> init) override;
+  void finish() override;
+
+  void push_int(int64_t value, qual_type type) override;
+  void push_local(int32_t slot, qual_type type) override;
+  void push_global(std::string_view name, qual_type type,
+                   bool external) override;
+  void push_function(std::string_view name, qual_type type) override;
+  void push_string(std::string_view bytes, qual_type type) override;
+  void pop() override;
+  std::optional<int64_t> pop_constant() override;
+  void dup() override;
+  void swap() override;
+
+  void address(qual_type type) override;
+  void deref(qual_type type) override;
+  void binary(int op, qual_type type) override;
+  void unary(int op, qual_type type) override;
+  void cast(qual_type type) override;
+  void assign() override;
+  void call(unsigned argc, qual_type result) override;
+
+  label new_label() override;
+  void place(label l) override;
+  void jump(label l) override;
+  void branch(bool when, label l) override;
+  void ret(bool has_value) override;
+
+private:
+  // An rvalue is m_ref itself. A slot lvalue is local m_slot; a memory
+  // lvalue is the object at address m_ref.
+  enum class kind : uint8_t { rvalue, slot, memory };
+
+  struct value {
+    kind m_kind;
+    ref m_ref = k_no_ref;
+    int32_t m_slot = 0;
+    qual_type m_type;
+  };
+
+  ref emit(inst i);
+  ref constant(int64_t value);
+  ref normalized(ref r, qual_type type);
+  ref rvalue(const value &v);
+  ref pop_rvalue();
+  std::optional<int64_t> constant_value(ref r) const;
+  void open_block(label l);
+
+  object_module &m_module;
+  bool m_optimize;
+  function m_fn;
+  std::vector<value> m_stack;
+  // Labels map to blocks once placed; terminators name labels until the
+  // function ends.
+  std::vector<uint32_t> m_label_blocks;
+  bool m_terminated = true;
+};
+} // namespace cc::ir
+
+#endif // CPPPROJECT_IR_BUILDER_H
@@ -0,0 +1,187 @@
+#include "jit.h"
+
+#include <dlfcn.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <format>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+namespace cc {
+namespace {
+// `jmp qword [rip + disp32]`, padded with int3.
+constexpr size_t k_stub_size = 8;
+constexpr uint32_t k_none = std::numeric_limits<uint32_t>::max();
+
+size_t align_up(size_t n, size_t align) {
+  return (n + align - 1) & ~(align - 1);
+}
+
+void write32(uint8_t *at, int64_t value, std::string_view name) {
+  if (value < std::numeric_limits<int32_t>::min() ||
+      value > std::numeric_limits<int32_t>::max()) {
+    throw std::runtime_error(
+        std::format("Relocation against '{}' is out of range", name));
+  }
+  int32_t v = value;
+  std::memcpy(at, &v, 4);
+}
+} // namespace
+
+jit_image::jit_image(const object_module &module, const resolver &resolve) {
+  const auto &text = module.section(section_id::text);
+  const auto &rodata = module.section(section_id::rodata);
+  const auto &data = module.section(section_id::data);
+  auto symbols = module.symbols();
+
+  // GOT slots and stubs are handed out per symbol, on first use.
+  std::vector<uint32_t> got_slot(symbols.size(), k_none);
+  std::vector<uint32_t> stub(symbols.size(), k_none);
+  uint32_t got_count = 0;
+  uint32_t stub_count = 0;
+  for (const relocation &r : module.relocations()) {
+    bool is_undefined = symbols[r.m_symbol].m_section == section_id::undef;
+    bool needs_stub = is_undefined && (r.m_type == reloc_type::plt32 ||
+                                       r.m_type == reloc_type::pc32);
+    if (needs_stub && stub[r.m_symbol] == k_none) {
+      stub[r.m_symbol] = stub_count++;
+    }
+    if ((needs_stub || r.m_type == reloc_type::gotpcrel) &&
+        got_slot[r.m_symbol] == k_none) {
+      got_slot[r.m_symbol] = got_count++;
+    }
+  }
+
+  // [text, stubs] read+execute | [rodata, GOT] read-only | [data, bss].
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t stubs_at = align_up(text.size(), 16);
+  size_t rodata_at = align_up(stubs_at + stub_count * k_stub_size, page);
+  size_t got_at = align_up(rodata_at + rodata.size(), 8);
+  size_t data_at = align_up(got_at + got_count * 8, page);
+  size_t bss_at = align_up(data_at + data.size(), 16);
+  m_size = align_up(std::max<size_t>(bss_at + module.bss_size(), 1), page);
+  m_base = mmap(nullptr, m_size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (m_base == MAP_FAILED) {
+    m_base = nullptr;
+    throw std::runtime_error("Failed to map memory for the JIT");
+  }
+
+  try {
+    auto *base = static_cast<uint8_t *>(m_base);
+    std::memcpy(base, text.data(), text.size());
+    std::memcpy(base + rodata_at, rodata.data(), rodata.size());
+    std::memcpy(base + data_at, data.data(), data.size());
+    auto section_base = [&](section_id id) -> uint8_t * {
+      switch (id) {
+      case section_id::text:
+        return base;
+      case section_id::rodata:
+        return base + rodata_at;
+      case section_id::data:
+        return base + data_at;
+      case section_id::bss:
+        return base + bss_at;
+      case section_id::undef:
+        break;
+      }
+      return nullptr;
+    };
+
+    std::vector<uint8_t *> address(symbols.size());
+    auto address_of = [&](uint32_t index) {
+      if (address[index]) {
+        return address[index];
+      }
+      const object_symbol &s = symbols[index];
+      if (s.m_section != section_id::undef) {
+        address[index] = section_base(s.m_section) + s.m_offset;
+      } else {
+        void *found = resolve ? resolve(s.m_name)
+                              : dlsym(RTLD_DEFAULT, s.m_name.c_str());
+        if (!found) {
+          throw std::runtime_error(
+              std::format("Undefined symbol '{}'", s.m_name));
+        }
+        address[index] = static_cast<uint8_t *>(found);
+      }
+      return address[index];
+    };
+
+    for (uint32_t i = 0; i < symbols.size(); ++i) {
+      if (got_slot[i] != k_none) {
+        uint8_t *target = address_of(i);
+        std::memcpy(base + got_at + got_slot[i] * 8, &target, 8);
+      }
+      if (stub[i] != k_none) {
+        uint8_t *at = base + stubs_at + stub[i] * k_stub_size;
+        uint8_t *slot = base + got_at + got_slot[i] * 8;
+        const uint8_t code[k_stub_size] = {0xFF, 0x25, 0, 0, 0, 0, 0xCC, 0xCC};
+        std::memcpy(at, code, k_stub_size);
+        write32(at + 2, slot - (at + 6), symbols[i].m_name);
+      }
+    }
+
+    for (const relocation &r : module.relocations()) {
+      const object_symbol &s = symbols[r.m_symbol];
+      uint8_t *place = section_base(r.m_section) + r.m_offset;
+      auto p = reinterpret_cast<intptr_t>(place);
+      switch (r.m_type) {
+      case reloc_type::pc32:
+      case reloc_type::plt32: {
+        uint8_t *target = stub[r.m_symbol] != k_none
+                              ? base + stubs_at + stub[r.m_symbol] * k_stub_size
+                              : address_of(r.m_symbol);
+        write32(place, reinterpret_cast<intptr_t>(target) + r.m_addend - p,
+                s.m_name);
+        break;
+      }
+      case reloc_type::gotpcrel: {
+        auto slot = reinterpret_cast<intptr_t>(base + got_at +
+                                               got_slot[r.m_symbol] * 8);
+        write32(place, slot + r.m_addend - p, s.m_name);
+        break;
+      }
+      case reloc_type::abs64: {
+        uint64_t value =
+            reinterpret_cast<uintptr_t>(address_of(r.m_symbol)) + r.m_addend;
+        std::memcpy(place, &value, 8);
+        break;
+      }
+      }
+    }
+
+    for (uint32_t i = 0; i < symbols.size(); ++i) {
+      if (symbols[i].m_global && symbols[i].m_section != section_id::undef) {
+        m_globals.emplace(symbols[i].m_name, address_of(i));
+      }
+    }
+
+    if (mprotect(base, rodata_at, PROT_READ | PROT_EXEC) != 0 ||
+        mprotect(base + rodata_at, data_at - rodata_at, PROT_READ) != 0) {
+      throw std::runtime_error("Failed to protect JIT memory");
+    }
+  } catch (...) {
+    munmap(m_base, m_size);
+    throw;
+  }
+}
+
+jit_image::~jit_image() { munmap(m_base, m_size); }
+
+void *jit_image::symbol(std::string_view name) const {
+  auto it = m_globals.find(std::string(name));
+  return it == m_globals.end() ? nullptr : it->second;
+}
+
+int jit_image::run_main(int argc, char **argv) const {
+  void *entry = symbol("main");
+  if (!entry) {
+    throw std::runtime_error("Undefined symbol 'main'");
+  }
+  return reinterpret_cast<int (*)(int, char **)>(entry)(argc, argv);
+}
+} // namespace cc
@@ -0,0 +1,43 @@
+#ifndef CPPPROJECT_JIT_H
+#define CPPPROJECT_JIT_H
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "object.h"
+
+namespace cc {
+// Loads an object_module into executable memory in this process. Sections
+// are copied into one anonymous mapping and relocated while it is still
+// writable; then text is flipped to read+execute and rodata to read-only,
+// so no page is ever writable and executable at once.
+//
+// Undefined symbols are looked up with `resolve`, or dlsym() in the global
+// scope when none is given. Calls to them go through a jump stub and a GOT
+// slot next to the image, because the target may be further than rel32
+// can reach.
+class jit_image {
+public:
+  using resolver = std::function<void *(std::string_view)>;
+
+  explicit jit_image(const object_module &module, const resolver &resolve = {});
+  ~jit_image();
+  jit_image(const jit_image &) = delete;
+  jit_image &operator=(const jit_image &) = delete;
+
+  // The address of a global symbol defined by the module, or nullptr.
+  void *symbol(std::string_view name) const;
+  // Calls `int main(int, char **)`.
+  int run_main(int argc, char **argv) const;
+
+private:
+  void *m_base = nullptr;
+  size_t m_size = 0;
+  std::unordered_map<std::string, void *> m_globals;
+};
+} // namespace cc
+
+#endif // CPPPROJECT_JIT_H
@@ -4,9 +4,13 @@
 
 #include "lexer.h"
 
+#include <cstdint>
 #include <format>
 #include <string>
 
+#include "scan.h"
+#include "utf8.h"
+
 static inline bool is_space(char c) {
   return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f';
 }
@@ -15,6 +19,10 @@ static inline bool is_alpha(char c) {
   return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
 }
 
+static inline bool is_non_ascii(char c) {
+  return static_cast<unsigned char>(c) >= 0x80;
+}
+
 static inline bool is_digit(char c) { return c >= '0' && c <= '9'; }
 
 static inline bool is_identifier_char(char c) {
@@ -30,13 +38,39 @@ static inline bool is_oct_digit(char c) { return c >= '0' && c <= '7'; }
 
 static inline bool is_binary_digit(char c) { return c == '0' || c == '1'; }
 
-static inline bool is_keyword(std::string_view word) {
+// Maps the character after "??" to its trigraph replacement, or '\0'.
+static inline char trigraph(char c) {
+  switch (c) {
+  case '=':
+    return '#';
+  case '(':
+    return '[';
+  case '/':
+    return '\\';
+  case ')':
+    return ']';
+  case '\'':
+    return '^';
+  case '<':
+    return '{';
+  case '!':
+    return '|';
+  case '>':
+    return '}';
+  case '-':
+    return '~';
+  default:
+    return '\0';
+  }
+}
+
+static inline bool is_c89_keyword(std::string_view word) {
   return word == "auto" || word == "break" || word == "case" ||
          word == "char" || word == "const" || word == "continue" ||
          word == "default" || word == "do" || word == "double" ||
          word == "else" || word == "enum" || word == "extern" ||
          word == "float" || word == "for" || word == "goto" || word == "if" ||
-         word == "int" || word == "long" || word == "restrict" ||
+         word == "int" || word == "long" || word == "register" ||
          word == "return" || word == "short" || word == "signed" ||
          word == "sizeof" || word == "static" || word == "struct" ||
          word == "switch" || word == "typedef" || word == "union" ||
@@ -44,6 +78,48 @@ static inline bool is_keyword(std::string_view word) {
          word == "while";
 }
 
+static inline bool is_c99_keyword(std::string_view word) {
+  return word == "inline" || word == "restrict" || word == "_Bool" ||
+         word == "_Complex" || word == "_Imaginary";
+}
+
+static inline bool is_c11_keyword(std::string_view word) {
+  return word == "_Alignas" || word == "_Alignof" || word == "_Atomic" ||
+         word == "_Generic" || word == "_Noreturn" ||
+         word == "_Static_assert" || word == "_Thread_local";
+}
+
+static inline bool is_c23_keyword(std::string_view word) {
+  return word == "alignas" || word == "alignof" || word == "bool" ||
+         word == "constexpr" || word == "false" || word == "nullptr" ||
+         word == "static_assert" || word == "thread_local" ||
+         word == "true" || word == "typeof" || word == "typeof_unqual" ||
+         word == "_BitInt" || word == "_Decimal32" || word == "_Decimal64" ||
+         word == "_Decimal128";
+}
+
+template <typename Dialect> static bool is_keyword(std::string_view word) {
+  if (is_c89_keyword(word)) {
+    return true;
+  }
+  if constexpr (Dialect::version >= 199901L) {
+    if (is_c99_keyword(word)) {
+      return true;
+    }
+  }
+  if constexpr (Dialect::version >= 201112L) {
+    if (is_c11_keyword(word)) {
+      return true;
+    }
+  }
+  if constexpr (Dialect::version >= 202311L) {
+    if (is_c23_keyword(word)) {
+      return true;
+    }
+  }
+  return false;
+}
+
 static bool is_integer_suffix(char c) {
   return c == 'u' || c == 'U' || c == 'l' || c == 'L';
 }
@@ -77,57 +153,70 @@ static inline bool validate_float_suffix(std::string_view suffix) {
 }
 
 namespace cc {
-token lexer::get_next_token() {
+template <typename Dialect>
+token basic_lexer<Dialect>::get_next_token() {
   if (m_file.is_eof()) {
+    m_tok_start = m_file.pos();
     return token{token_class::T_EOF};
   }
 
   bool comment_found = false;
   do {
-    while (is_space(m_file.peek())) {
+    while (is_space(peek())) {
       move_next();
     }
     comment_found = false;
-    if (m_file.peek() == '/') {
+    if (peek() == '/') {
+      char *comment_start = m_file.pos();
+      m_spliced = false;
       move_next();
-      if (m_file.peek() == '/') {
+      if (line_comments && peek() == '/') {
         skip_single_line_comment();
         comment_found = true;
-      } else if (m_file.peek() == '*') {
+      } else if (peek() == '*') {
         skip_multi_line_comment();
         comment_found = true;
       } else {
         move_back();
       }
+      if constexpr (Dialect::keep_comments) {
+        if (comment_found) {
+          return {token_class::COMMENT, spelling(comment_start)};
+        }
+      }
     }
   } while (comment_found);
 
   if (m_file.is_eof()) {
+    m_tok_start = m_file.pos();
     return token{token_class::T_EOF};
   }
 
   char *tok_start = m_file.pos();
-  switch (m_file.peek()) {
+  m_tok_start = tok_start;
+  m_spliced = false;
+  char c = peek();
+  switch (c) {
   case '=':
     move_next();
-    if (m_file.peek() == '=') {
+    if (peek() == '=') {
       move_next();
-      return {token_class::EQ_OP, tok_start, m_file.pos()};
+      return {token_class::EQ_OP, spelling(tok_start)};
     } else {
-      return token{*tok_start};
+      return token{c};
     }
     break;
   case '.':
     move_next();
-    if (m_file.peek() == '.') {
+    if (peek() == '.') {
       move_next();
-      if (m_file.peek() == '.') {
+      if (peek() == '.') {
         move_next();
-        return {token_class::ELLIPSIS, tok_start, m_file.pos()};
+        return {token_class::ELLIPSIS, spelling(tok_start)};
       } else {
         throw std::runtime_error("Unexpected character after '..'");
       }
-    } else if (is_digit(m_file.peek())) {
+    } else if (is_digit(peek())) {
       // It's a floating point number starting with .digit
       move_back();
       token tok;
@@ -137,154 +226,154 @@ token lexer::get_next_token() {
         throw std::runtime_error("Invalid number literal");
       }
     } else {
-      return token{*tok_start};
+      return token{c};
     }
   case '>':
     move_next();
-    if (m_file.peek() == '>') {
+    if (peek() == '>') {
       move_next();
-      if (m_file.peek() == '=') {
+      if (peek() == '=') {
         move_next();
-        return {token_class::RIGHT_ASSIGN, tok_start, m_file.pos()};
+        return {token_class::RIGHT_ASSIGN, spelling(tok_start)};
       } else {
-        return {token_class::RIGHT_OP, tok_start, m_file.pos()};
+        return {token_class::RIGHT_OP, spelling(tok_start)};
       }
-    } else if (m_file.peek() == '=') {
+    } else if (peek() == '=') {
       move_next();
-      return {token_class::GE_OP, tok_start, m_file.pos()};
+      return {token_class::GE_OP, spelling(tok_start)};
     } else {
-      return token{*tok_start};
+      return token{c};
     }
     break;
   case '<':
     move_next();
-    if (m_file.peek() == '<') {
+    if (peek() == '<') {
       move_next();
-      if (m_file.peek() == '=') {
+      if (peek() == '=') {
         move_next();
-        return {token_class::LEFT_ASSIGN, tok_start, m_file.pos()};
+        return {token_class::LEFT_ASSIGN, spelling(tok_start)};
       } else {
-        return {token_class::LEFT_OP, tok_start, m_file.pos()};
+        return {token_class::LEFT_OP, spelling(tok_start)};
       }
-    } else if (m_file.peek() == '=') {
+    } else if (peek() == '=') {
       move_next();
-      return {token_class::LE_OP, tok_start, m_file.pos()};
-    } else if (m_file.peek() == '%') {
+      return {token_class::LE_OP, spelling(tok_start)};
+    } else if (digraphs && peek() == '%') {
       move_next();
       return token{'{'};
-    } else if (m_file.peek() == ':') {
+    } else if (digraphs && peek() == ':') {
       move_next();
       return token{'['};
     } else {
-      return token{*tok_start};
+      return token{c};
     }
     break;
   case '+':
     move_next();
-    if (m_file.peek() == '+') {
+    if (peek() == '+') {
       move_next();
-      return {token_class::INC_OP, tok_start, m_file.pos()};
-    } else if (m_file.peek() == '=') {
+      return {token_class::INC_OP, spelling(tok_start)};
+    } else if (peek() == '=') {
       move_next();
-      return {token_class::ADD_ASSIGN, tok_start, m_file.pos()};
+      return {token_class::ADD_ASSIGN, spelling(tok_start)};
     } else {
-      return token{*tok_start};
+      return token{c};
     }
     break;
   case '-':
     move_next();
-    if (m_file.peek() == '-') {
+    if (peek() == '-') {
       move_next();
-      return {token_class::DEC_OP, tok_start, m_file.pos()};
-    } else if (m_file.peek() == '=') {
+      return {token_class::DEC_OP, spelling(tok_start)};
+    } else if (peek() == '=') {
       move_next();
-      return {token_class::SUB_ASSIGN, tok_start, m_file.pos()};
-    } else if (m_file.peek() == '>') {
+      return {token_class::SUB_ASSIGN, spelling(tok_start)};
+    } else if (peek() == '>') {
       move_next();
-      return {token_class::PTR_OP, tok_start, m_file.pos()};
+      return {token_class::PTR_OP, spelling(tok_start)};
     } else {
-      return token{*tok_start};
+      return token{c};
     }
     break;
   case '*':
     move_next();
-    if (m_file.peek() == '=') {
+    if (peek() == '=') {
       move_next();
-      return {token_class::MUL_ASSIGN, tok_start, m_file.pos()};
+      return {token_class::MUL_ASSIGN, spelling(tok_start)};
     } else {
-      return token{*tok_start};
+      return token{c};
     }
     break;
   case '/':
     move_next();
-    if (m_file.peek() == '=') {
+    if (peek() == '=') {
       move_next();
-      return {token_class::DIV_ASSIGN, tok_start, m_file.pos()};
+      return {token_class::DIV_ASSIGN, spelling(tok_start)};
     } else {
-      return token{*tok_start};
+      return token{c};
     }
     break;
   case '%':
     move_next();
-    if (m_file.peek() == '=') {
+    if (peek() == '=') {
       move_next();
-      return {token_class::MOD_ASSIGN, tok_start, m_file.pos()};
-    } else if (m_file.peek() == '%') {
+      return {token_class::MOD_ASSIGN, spelling(tok_start)};
+    } else if (digraphs && peek() == '>') {
       move_next();
       return token{'}'};
     } else {
-      return token{*tok_start};
+      return token{c};
     }
     break;
   case '&':
     move_next();
-    if (m_file.peek() == '&') {
+    if (peek() == '&') {
       move_next();
-      return {token_class::AND_OP, tok_start, m_file.pos()};
-    } else if (m_file.peek() == '=') {
+      return {token_class::AND_OP, spelling(tok_start)};
+    } else if (peek() == '=') {
       move_next();
-      return {token_class::AND_ASSIGN, tok_start, m_file.pos()};
+      return {token_class::AND_ASSIGN, spelling(tok_start)};
     } else {
-      return token{*tok_start};
+      return token{c};
     }
     break;
   case '|':
     move_next();
-    if (m_file.peek() == '|') {
+    if (peek() == '|') {
       move_next();
-      return {token_class::OR_OP, tok_start, m_file.pos()};
-    } else if (m_file.peek() == '=') {
+      return {token_class::OR_OP, spelling(tok_start)};
+    } else if (peek() == '=') {
       move_next();
-      return {token_class::OR_ASSIGN, tok_start, m_file.pos()};
+      return {token_class::OR_ASSIGN, spelling(tok_start)};
     } else {
-      return token{*tok_start};
+      return token{c};
     }
     break;
   case '^':
     move_next();
-    if (m_file.peek() == '=') {
+    if (peek() == '=') {
       move_next();
-      return {token_class::XOR_ASSIGN, tok_start, m_file.pos()};
+      return {token_class::XOR_ASSIGN, spelling(tok_start)};
     } else {
-      return token{*tok_start};
+      return token{c};
     }
     break;
   case '!':
     move_next();
-    if (m_file.peek() == '=') {
+    if (peek() == '=') {
       move_next();
-      return {token_class::NE_OP, tok_start, m_file.pos()};
+      return {token_class::NE_OP, spelling(tok_start)};
     } else {
-      return token{*tok_start};
+      return token{c};
     }
     break;
   case ':':
     move_next();
-    if (m_file.peek() == '>') {
+    if (digraphs && peek() == '>') {
       move_next();
       return token{']'};
     } else {
-      return token{*tok_start};
+      return token{c};
     }
   case ';':
   case '{':
@@ -297,7 +386,7 @@ token lexer::get_next_token() {
   case '~':
   case '?':
     move_next();
-    return token{*tok_start};
+    return token{c};
     break;
   }
 
@@ -314,9 +403,9 @@ token lexer::get_next_token() {
     return tok;
   }
 
-  if (is_digit(*tok_start)) {
+  if (is_digit(c)) {
     if (parse_decimal_number(tok) || parse_octal_number(tok) ||
-        parse_hex_number(tok)) {
+        parse_hex_number(tok) || parse_binary_number(tok)) {
       return tok;
     } else {
       throw std::runtime_error("Invalid number literal");
@@ -324,151 +413,294 @@ token lexer::get_next_token() {
   }
 
   throw std::runtime_error(
-      std::format("Unexpected character with code '{:d}' at {}:{}", *tok_start,
-                  m_line + 1, m_column + 1));
+      std::format("Unexpected character with code '{:d}' at {}", *tok_start,
+                  location(tok_start)));
+}
+
+// Translation phases 1 and 2: consumes any line splices at the current
+// position and resolves a trigraph there without consuming it.
+template <typename Dialect>
+char basic_lexer<Dialect>::peek_slow(char c) {
+  while (true) {
+    size_t lead = 0;
+    if (trigraphs && c == '?') {
+      char mapped = trigraph(m_file.peek_at(2));
+      if (m_file.peek_at(1) != '?' || mapped == '\0') {
+        return c;
+      }
+      if (mapped != '\\') {
+        return mapped;
+      }
+      lead = 3;
+    } else if (c == '\\') {
+      lead = 1;
+    } else {
+      return c;
+    }
+    size_t newline = m_file.peek_at(lead) == '\r' ? lead + 1 : lead;
+    if (m_file.peek_at(newline) != '\n') {
+      return lead == 3 ? '\\' : c;
+    }
+    m_file.seek(m_file.pos() + newline + 1);
+    m_spliced = true;
+    c = m_file.peek();
+  }
 }
 
-int lexer::move_next() {
-  int c = m_file.get();
-  if (c == '\n') {
-    m_line++;
-    m_column = 0;
+template <typename Dialect>
+char basic_lexer<Dialect>::move_next_slow() {
+  // Splices skipped here are undone by move_back() together with the
+  // character that follows them.
+  m_file.seek(m_prev_pos);
+  char c = peek_slow(m_file.peek());
+  if (c != m_file.peek()) {
+    // peek_slow() resolved a trigraph.
+    m_file.seek(m_file.pos() + 3);
+    m_spliced = true;
   } else {
-    m_column++;
+    m_file.get();
   }
   return c;
 }
 
-void lexer::move_back() {
-  if (m_line == 0 && m_column == 0) {
-    return;
+template <typename Dialect>
+void basic_lexer<Dialect>::move_back() { m_file.seek(m_prev_pos); }
+
+// Lines and columns are only needed for diagnostics, so they are counted on
+// demand instead of being tracked for every byte. A column counts code
+// points, not bytes.
+template <typename Dialect>
+std::string basic_lexer<Dialect>::location(const char *pos) const {
+  int line = 0;
+  const char *line_start = m_file.begin();
+  for (const char *p = m_file.begin(); p < pos; ++p) {
+    if (*p == '\n') {
+      line++;
+      line_start = p + 1;
+    }
   }
-  m_file.unget();
-  if (m_file.peek() == '\n') {
-    char *line_start = m_file.pos() - 1;
-    while (line_start > m_file.begin() && *line_start != '\n') {
-      line_start--;
+  int column = 0;
+  for (const char *p = line_start; p < pos; ++p) {
+    if ((*p & 0xC0) != 0x80) {
+      column++;
     }
-    m_column = static_cast<int>(m_file.pos() - line_start);
-    if (line_start == m_file.begin()) {
-      m_column++;
+  }
+  return std::format("{}:{}", line + 1, column + 1);
+}
+
+template <typename Dialect>
+std::string basic_lexer<Dialect>::location(const token &tok) const {
+  // Punctuators carry no spelling and spellings cleaned of splices live in
+  // the arena; both can only be the most recent token.
+  const char *p = tok.m_value.data();
+  if (p < m_file.begin() || p > m_file.pos()) {
+    p = m_tok_start;
+  }
+  return location(p);
+}
+
+template <typename Dialect>
+std::string_view basic_lexer<Dialect>::spelling(const char *start) {
+  std::string_view raw(start, m_file.pos());
+  if (!m_spliced) [[likely]] {
+    return raw;
+  }
+  auto *out = static_cast<char *>(m_arena.allocate(raw.size(), 1));
+  size_t len = 0;
+  for (size_t i = 0; i < raw.size();) {
+    char c = raw[i];
+    size_t width = 1;
+    if (trigraphs && c == '?' && i + 2 < raw.size() && raw[i + 1] == '?' &&
+        trigraph(raw[i + 2]) != '\0') {
+      c = trigraph(raw[i + 2]);
+      width = 3;
+    }
+    if (c == '\\') {
+      size_t next = i + width;
+      if (next < raw.size() && raw[next] == '\r') {
+        next++;
+      }
+      if (next < raw.size() && raw[next] == '\n') {
+        i = next + 1;
+        continue;
+      }
     }
-  } else {
-    m_column--;
+    out[len++] = c;
+    i += width;
   }
+  return {out, len};
 }
 
-bool lexer::parse_identifier_or_keyword(token &tok) {
+template <typename Dialect>
+bool basic_lexer<Dialect>::parse_identifier_or_keyword(token &tok) {
   char *tok_start = m_file.pos();
-  if (is_alpha(m_file.peek()) || m_file.peek() == '_') {
-    if (m_file.peek() == 'L') {
+  if (is_alpha(peek()) || peek() == '_' || is_non_ascii(peek())) {
+    if (peek() == 'L') {
       if (parse_string_literal(tok) || parse_char_literal(tok)) {
         return true;
       }
     }
-    while (is_identifier_char(m_file.peek())) {
-      move_next();
+    if (is_non_ascii(peek())) {
+      read_identifier_utf8(true);
     }
-    if (is_keyword({tok_start, m_file.pos()})) {
-      tok = {token_class::KEYWORD, tok_start, m_file.pos()};
+    while (true) {
+      char *p = m_file.pos();
+      m_file.seek(p + (scan::skip_identifier(p, m_file.limit()) - p));
+      if (is_identifier_char(peek())) {
+        move_next();
+      } else if (is_non_ascii(peek())) {
+        read_identifier_utf8(false);
+      } else {
+        break;
+      }
+    }
+    auto word = spelling(tok_start);
+    if (is_keyword<Dialect>(word)) {
+      tok = {token_class::KEYWORD, word};
+    } else if (m_symbols && m_symbols->is_typedef_name(word)) {
+      tok = {token_class::TYPEDEF_NAME, word};
     } else {
-      tok = {token_class::IDENTIFIER, tok_start, m_file.pos()};
+      tok = {token_class::IDENTIFIER, word};
     }
     return true;
   }
   return false;
 }
 
-bool lexer::parse_string_literal(token &tok) {
+template <typename Dialect>
+void basic_lexer<Dialect>::read_identifier_utf8(bool at_start) {
+  char *start = m_file.pos();
+  char buf[4];
+  auto lead = static_cast<unsigned char>(move_next());
+  buf[0] = static_cast<char>(lead);
+  int expected = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 1;
+  int len = 1;
+  while (len < expected && !m_file.is_eof() && (peek() & 0xC0) == 0x80) {
+    buf[len++] = static_cast<char>(move_next());
+  }
+
+  char32_t cp;
+  if (utf8::decode(buf, buf + len, cp) != len || len != expected) {
+    throw std::runtime_error(
+        std::format("Invalid UTF-8 sequence at {}", location(start)));
+  }
+  if (at_start ? !utf8::is_xid_start(cp) : !utf8::is_xid_continue(cp)) {
+    throw std::runtime_error(
+        std::format("Unexpected character U+{:04X} at {}",
+                    static_cast<uint32_t>(cp), location(start)));
+  }
+}
+
+template <typename Dialect>
+void basic_lexer<Dialect>::validate_utf8(const char *begin, const char *end) {
+  if (utf8::find_invalid(begin, end)) {
+    throw std::runtime_error(std::format("Invalid UTF-8 sequence before {}",
+                                         location(m_file.pos())));
+  }
+}
+
+template <typename Dialect>
+bool basic_lexer<Dialect>::parse_string_literal(token &tok) {
   char *tok_start = m_file.pos();
-  if (m_file.peek() == 'L') {
+  if (peek() == 'L') {
     move_next();
-    if (m_file.peek() != '"') {
+    if (peek() != '"') {
       move_back();
       return false;
     }
   }
-  if (m_file.peek() == '"') {
+  if (peek() == '"') {
     move_next();
-    while (m_file.peek() != '"' && !m_file.is_eof()) {
-      if (m_file.peek() == '\\') {
-        move_next(); // Skip the escape character
-        if (m_file.is_eof()) {
-          break;
-        }
-      }
+    skip_literal_body('"');
+    if (peek() == '"') {
       move_next();
-    }
-    if (m_file.peek() == '"') {
-      move_next();
-      tok = {token_class::STRING_LITERAL, tok_start, m_file.pos()};
+      validate_utf8(tok_start, m_file.pos());
+      tok = {token_class::STRING_LITERAL, spelling(tok_start)};
       return true;
     } else {
       throw std::runtime_error(
-          std::format("Unterminated string literal at {:d}:{:d}", m_line + 1,
-                      m_column + 1));
+          std::format("Unterminated string literal at {}",
+                      location(m_file.pos())));
     }
   }
 
   return false;
 }
 
-bool lexer::parse_char_literal(token &tok) {
+template <typename Dialect>
+bool basic_lexer<Dialect>::parse_char_literal(token &tok) {
   char *tok_start = m_file.pos();
-  if (m_file.peek() == '\'') {
+  if (peek() == '\'') {
     move_next();
-    while (m_file.peek() != '\'' && !m_file.is_eof()) {
-      if (m_file.peek() == '\\') {
-        move_next(); // Skip the escape character
-        if (m_file.is_eof()) {
-          break;
-        }
-      }
-      move_next();
-    }
-    if (m_file.peek() == '\'') {
+    skip_literal_body('\'');
+    if (peek() == '\'') {
       move_next();
-      if (m_file.pos() - tok_start == 2) {
+      if (spelling(tok_start).size() == 2) {
         throw std::runtime_error(std::format(
-            "Empty character literal at {:d}:{:d}", m_line + 1, m_column + 1));
+            "Empty character literal at {}", location(m_file.pos())));
       }
-      tok = {token_class::CHAR_CONSTANT, tok_start, m_file.pos()};
+      validate_utf8(tok_start, m_file.pos());
+      tok = {token_class::CHAR_CONSTANT, spelling(tok_start)};
       return true;
     } else {
       throw std::runtime_error(
-          std::format("Unterminated character literal at {:d}:{:d}", m_line + 1,
-                      m_column + 1));
+          std::format("Unterminated character literal at {}",
+                      location(m_file.pos())));
     }
   }
 
   return false;
 }
 
-bool lexer::parse_decimal_number(token &tok) {
+// Moves to the closing quote, or to a newline or the end of the file if the
+// literal is unterminated. Runs of ordinary characters are skipped a block at
+// a time; only escapes, splices and trigraphs go through move_next().
+template <typename Dialect>
+void basic_lexer<Dialect>::skip_literal_body(char quote) {
+  while (true) {
+    char *p = m_file.pos();
+    auto *stop = scan::find_literal_stop<trigraphs>(p, m_file.limit(), quote);
+    m_file.seek(p + (stop - p));
+    char c = peek();
+    if (c == quote || c == '\n' || m_file.is_eof()) {
+      return;
+    }
+    if (c == '\\') {
+      move_next(); // Skip the escape character
+      if (m_file.is_eof()) {
+        return;
+      }
+    }
+    move_next();
+  }
+}
+
+template <typename Dialect>
+bool basic_lexer<Dialect>::parse_decimal_number(token &tok) {
   auto tok_class = token_class::INT_CONSTANT;
   char *tok_start = m_file.pos();
-  if (!is_digit(m_file.peek()) && m_file.peek() != '.') {
+  if (!is_digit(peek()) && peek() != '.') {
     return false;
   }
-  if (m_file.peek() == '0') {
+  if (peek() == '0') {
     move_next();
-    if (is_digit(m_file.peek()) || m_file.peek() == 'x' ||
-        m_file.peek() == 'X') {
+    if (is_digit(peek()) || peek() == 'x' || peek() == 'X' ||
+        (binary_constants && (peek() == 'b' || peek() == 'B'))) {
       move_back();
       return false;
     }
   }
 
-  while (is_digit(m_file.peek())) {
+  while (is_digit(peek())) {
     move_next();
   }
   auto integer_part = std::string_view(tok_start, m_file.pos());
-  if (m_file.peek() == '.' || is_float_exponent(m_file.peek())) {
+  if (peek() == '.' || is_float_exponent(peek())) {
     auto frac_part = std::string_view();
-    if (m_file.peek() == '.') {
+    if (peek() == '.') {
       move_next();
       auto frac_start = m_file.pos();
-      while (is_digit(m_file.peek())) {
+      while (is_digit(peek())) {
         move_next();
       }
       frac_part = std::string_view(frac_start, m_file.pos());
@@ -476,78 +708,110 @@ bool lexer::parse_decimal_number(token &tok) {
     if (integer_part.empty() && frac_part.empty()) {
       throw std::runtime_error("Invalid float literal");
     }
-    if (m_file.peek() == 'e' || m_file.peek() == 'E') {
+    if (peek() == 'e' || peek() == 'E') {
       move_next();
-      if (m_file.peek() == '+' || m_file.peek() == '-') {
+      if (peek() == '+' || peek() == '-') {
         move_next();
       }
-      if (!is_digit(m_file.peek())) {
+      if (!is_digit(peek())) {
         throw std::runtime_error("Invalid float exponent");
       }
-      while (is_digit(m_file.peek())) {
+      while (is_digit(peek())) {
         move_next();
       }
     }
     tok_class = token_class::FLOAT_CONSTANT;
   }
   parse_number_suffix(tok_class);
-  tok = {tok_class, tok_start, m_file.pos()};
+  tok = {tok_class, spelling(tok_start)};
   return true;
 }
 
-bool lexer::parse_octal_number(token &tok) {
-  if (m_file.peek() != '0') {
+template <typename Dialect>
+bool basic_lexer<Dialect>::parse_octal_number(token &tok) {
+  if (peek() != '0') {
     return false;
   }
   char *tok_start = m_file.pos();
   move_next();
-  if (!is_oct_digit(m_file.peek())) {
+  if (!is_oct_digit(peek())) {
     move_back();
     return false;
   }
   move_next();
-  while (is_digit(m_file.peek())) {
-    if (!is_oct_digit(m_file.peek())) {
+  while (is_digit(peek())) {
+    if (!is_oct_digit(peek())) {
       throw std::runtime_error("Invalid octal digit");
     }
     move_next();
   }
   parse_number_suffix(token_class::OCT_CONSTANT);
-  tok = {token_class::OCT_CONSTANT, tok_start, m_file.pos()};
+  tok = {token_class::OCT_CONSTANT, spelling(tok_start)};
   return true;
 }
 
-bool lexer::parse_hex_number(token &tok) {
-  if (m_file.peek() != '0') {
+template <typename Dialect>
+bool basic_lexer<Dialect>::parse_hex_number(token &tok) {
+  if (peek() != '0') {
     return false;
   }
   char *tok_start = m_file.pos();
 
   move_next();
-  if (m_file.peek() != 'x' && m_file.peek() != 'X') {
+  if (peek() != 'x' && peek() != 'X') {
     move_back();
     return false;
   }
   move_next();
 
-  if (!is_hex_digit(m_file.peek())) {
+  if (!is_hex_digit(peek())) {
     throw std::runtime_error("Invalid hex digit");
   }
 
-  while (is_hex_digit(m_file.peek())) {
+  while (is_hex_digit(peek())) {
     move_next();
   }
   parse_number_suffix(token_class::HEX_CONSTANT);
-  tok = {token_class::HEX_CONSTANT, tok_start, m_file.pos()};
+  tok = {token_class::HEX_CONSTANT, spelling(tok_start)};
+  return true;
+}
+
+template <typename Dialect>
+bool basic_lexer<Dialect>::parse_binary_number(token &tok) {
+  if constexpr (!binary_constants) {
+    return false;
+  }
+  if (peek() != '0') {
+    return false;
+  }
+  char *tok_start = m_file.pos();
+
+  move_next();
+  if (peek() != 'b' && peek() != 'B') {
+    move_back();
+    return false;
+  }
+  move_next();
+
+  if (!is_binary_digit(peek())) {
+    throw std::runtime_error("Invalid binary digit");
+  }
+
+  while (is_binary_digit(peek())) {
+    move_next();
+  }
+  parse_number_suffix(token_class::BIN_CONSTANT);
+  tok = {token_class::BIN_CONSTANT, spelling(tok_start)};
   return true;
 }
 
-void lexer::parse_number_suffix(int tok_class) {
+template <typename Dialect>
+void basic_lexer<Dialect>::parse_number_suffix(int tok_class) {
   char *suffix_start = m_file.pos();
-  while (is_alpha(m_file.peek())) {
+  while (is_alpha(peek())) {
     move_next();
   }
-  auto suffix = std::string_view(suffix_start, m_file.pos());
+  auto suffix = spelling(suffix_start);
   if (!suffix.empty()) {
     if (tok_class == token_class::INT_CONSTANT ||
         tok_class == token_class::OCT_CONSTANT ||
@@ -566,17 +830,22 @@ void lexer::parse_number_suffix(int tok_class) {
   }
 }
 
-void lexer::skip_single_line_comment() {
-  while (m_file.peek() != '\n' && !m_file.is_eof()) {
+template <typename Dialect>
+void basic_lexer<Dialect>::skip_single_line_comment() {
+  char *start = m_file.pos();
+  while (peek() != '\n' && !m_file.is_eof()) {
     move_next();
   }
+  validate_utf8(start, m_file.pos());
 }
 
-void lexer::skip_multi_line_comment() {
+template <typename Dialect>
+void basic_lexer<Dialect>::skip_multi_line_comment() {
+  char *start = m_file.pos();
   while (!m_file.is_eof()) {
-    if (m_file.peek() == '*') {
+    if (peek() == '*') {
       move_next();
-      if (m_file.peek() == '/') {
+      if (peek() == '/') {
         move_next();
         break;
       }
@@ -587,6 +856,12 @@ void lexer::skip_multi_line_comment() {
   if (m_file.is_eof()) {
     throw std::runtime_error("Unterminated multi-line comment");
   }
+  validate_utf8(start, m_file.pos());
 }
 
+template class basic_lexer<c89>;
+template class basic_lexer<c99>;
+template class basic_lexer<c11>;
+template class basic_lexer<c23>;
+template class basic_lexer<c23_highlight>;
 } // namespace cc
@@ -6,7 +6,9 @@
 #define CPPPROJECT_LEXER_H
 #include <string>
 
+#include "arena.h"
 #include "file.h"
+#include "symbol_table.h"
 
 namespace cc {
 enum token_class {
@@ -42,6 +44,32 @@ enum token_class {
   HEX_CONSTANT = 226,
   FLOAT_CONSTANT = 225,
   BIN_CONSTANT = 224,
+  COMMENT = 223,
+  TYPEDEF_NAME = 222,
+};
+
+// Language dialects accepted by basic_lexer. `version` is the value of
+// __STDC_VERSION__ for the standard (C89 never defined one). Everything else
+// the lexer needs is derived from it at compile time.
+struct c89 {
+  static constexpr long version = 198912L;
+  static constexpr bool keep_comments = false;
+};
+struct c99 {
+  static constexpr long version = 199901L;
+  static constexpr bool keep_comments = false;
+};
+struct c11 {
+  static constexpr long version = 201112L;
+  static constexpr bool keep_comments = false;
+};
+struct c23 {
+  static constexpr long version = 202311L;
+  static constexpr bool keep_comments = false;
+};
+// C23 with comments returned as COMMENT tokens, for syntax highlighting.
+struct c23_highlight : c23 {
+  static constexpr bool keep_comments = true;
 };
 
 struct token {
@@ -49,35 +77,88 @@ struct token {
   explicit token(int token_class) : m_token_class(token_class) {}
   token(int token_class, const char *start, const char *end)
       : m_token_class(token_class), m_value(start, end) {}
+  token(int token_class, std::string_view value)
+      : m_token_class(token_class), m_value(value) {}
 
   int m_token_class = token_class::T_EOF;
+  // Points into the source buffer, or into the lexer's arena when the
+  // spelling had to be cleaned of line splices or trigraphs. Either way it
+  // stays valid for as long as the lexer and its file.
   std::string_view m_value;
-  std::string m_buffer;
 };
 
-class lexer {
+template <typename Dialect> class basic_lexer {
 public:
-  explicit lexer(file &f) : m_file(f) {}
+  explicit basic_lexer(file &f) : m_file(f) {}
   token get_next_token();
+  // With a table attached, identifiers currently bound as typedef names are
+  // returned as TYPEDEF_NAME. The parser keeps the table up to date as it
+  // goes, which resolves the C typedef-name ambiguity at the token level.
+  void set_symbol_table(const symbol_table *symbols) { m_symbols = symbols; }
+  // "line:column" of a token returned by this lexer.
+  std::string location(const token &tok) const;
 
 private:
-  int move_next();
+  // Digraphs arrived with C95, // comments and binary constants with C99 and
+  // C23 respectively, and C23 dropped trigraphs.
+  static constexpr bool digraphs = Dialect::version >= 199409L;
+  static constexpr bool line_comments = Dialect::version >= 199901L;
+  static constexpr bool trigraphs = Dialect::version < 202311L;
+  static constexpr bool binary_constants = Dialect::version >= 202311L;
+
+  char peek() {
+    char c = m_file.peek();
+    if (c == '\\' || (trigraphs && c == '?')) [[unlikely]] {
+      return peek_slow(c);
+    }
+    return c;
+  }
+  char peek_slow(char c);
+  int move_next() {
+    m_prev_pos = m_file.pos();
+    char c = m_file.get();
+    if (c == '\\' || (trigraphs && c == '?')) [[unlikely]] {
+      c = move_next_slow();
+    }
+    return c;
+  }
+  char move_next_slow();
   void move_back();
+  std::string_view spelling(const char *start);
+  std::string location(const char *pos) const;
   bool parse_identifier_or_keyword(token &tok);
+  void read_identifier_utf8(bool at_start);
+  void validate_utf8(const char *begin, const char *end);
   bool parse_string_literal(token &tok);
   bool parse_char_literal(token &tok);
+  void skip_literal_body(char quote);
   bool parse_decimal_number(token &tok);
   bool parse_octal_number(token &tok);
   bool parse_hex_number(token &tok);
+  bool parse_binary_number(token &tok);
   void parse_number_suffix(int token_class);
   void skip_single_line_comment();
   void skip_multi_line_comment();
 
 private:
   file &m_file;
-  int m_line = 0;
-  int m_column = 0;
+  // Position before the last move_next(), restored by move_back().
+  char *m_prev_pos = nullptr;
+  // Start of the token returned last.
+  const char *m_tok_start = nullptr;
+  // Set when the current token contains a line splice or trigraph.
+  bool m_spliced = false;
+  arena m_arena;
+  const symbol_table *m_symbols = nullptr;
 };
+
+extern template class basic_lexer<c89>;
+extern template class basic_lexer<c99>;
+extern template class basic_lexer<c11>;
+extern template class basic_lexer<c23>;
+extern template class basic_lexer<c23_highlight>;
+
+using lexer = basic_lexer<c99>;
 } // namespace cc
 
 #endif // CPPPROJECT_LEXER_H
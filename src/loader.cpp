@@ -0,0 +1,422 @@
+#include "loader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <fcntl.h>
+#include <format>
+#include <linux/io_uring.h>
+#include <mutex>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+// user_data of every submission: file index in the upper bits, operation in
+// the lower two.
+enum op_kind : uint64_t { OP_OPEN = 0, OP_STATX = 1, OP_READ = 2 };
+
+uint64_t make_user_data(size_t index, op_kind op) {
+  return (static_cast<uint64_t>(index) << 2) | op;
+}
+
+struct loaded_buffer {
+  std::unique_ptr<char[]> data;
+  size_t size = 0;
+};
+
+loaded_buffer read_whole_file(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    throw std::runtime_error(std::format("Failed to open file {}", path));
+  }
+  struct stat sb;
+  if (fstat(fd, &sb) == -1) {
+    close(fd);
+    throw std::runtime_error(std::format("Failed to get file size {}", path));
+  }
+  loaded_buffer buf;
+  buf.data = std::make_unique_for_overwrite<char[]>(sb.st_size);
+  while (buf.size < static_cast<size_t>(sb.st_size)) {
+    ssize_t n = read(fd, buf.data.get() + buf.size, sb.st_size - buf.size);
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n == -1) {
+      close(fd);
+      throw std::runtime_error(std::format("Failed to read file {}", path));
+    }
+    if (n == 0) {
+      break;
+    }
+    buf.size += n;
+  }
+  close(fd);
+  return buf;
+}
+} // namespace
+
+struct loader::ring {
+  ~ring();
+
+  bool setup(unsigned entries);
+  bool supports(std::initializer_list<unsigned> ops) const;
+  io_uring_sqe *get_sqe();
+  void submit_and_wait();
+
+  int fd = -1;
+  unsigned entries = 0;
+  unsigned queued = 0;
+  unsigned *sq_head = nullptr;
+  unsigned *sq_tail = nullptr;
+  unsigned *sq_mask = nullptr;
+  unsigned *sq_array = nullptr;
+  unsigned *cq_head = nullptr;
+  unsigned *cq_tail = nullptr;
+  unsigned *cq_mask = nullptr;
+  io_uring_sqe *sqes = nullptr;
+  io_uring_cqe *cqes = nullptr;
+  void *sq_ptr = MAP_FAILED;
+  void *cq_ptr = MAP_FAILED;
+  size_t sq_size = 0;
+  size_t cq_size = 0;
+  size_t sqes_size = 0;
+};
+
+loader::ring::~ring() {
+  if (sqes) {
+    munmap(sqes, sqes_size);
+  }
+  if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr) {
+    munmap(cq_ptr, cq_size);
+  }
+  if (sq_ptr != MAP_FAILED) {
+    munmap(sq_ptr, sq_size);
+  }
+  if (fd != -1) {
+    close(fd);
+  }
+}
+
+bool loader::ring::setup(unsigned requested) {
+  io_uring_params params{};
+  fd = static_cast<int>(syscall(__NR_io_uring_setup, requested, &params));
+  if (fd == -1) {
+    return false;
+  }
+  entries = params.sq_entries;
+
+  sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) {
+    sq_size = cq_size = std::max(sq_size, cq_size);
+  }
+  sq_ptr = mmap(nullptr, sq_size, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (sq_ptr == MAP_FAILED) {
+    return false;
+  }
+  cq_ptr = single_mmap ? sq_ptr
+                       : mmap(nullptr, cq_size, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+  if (cq_ptr == MAP_FAILED) {
+    return false;
+  }
+  sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+  void *sqes_ptr = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (sqes_ptr == MAP_FAILED) {
+    return false;
+  }
+  sqes = static_cast<io_uring_sqe *>(sqes_ptr);
+
+  auto *sq = static_cast<char *>(sq_ptr);
+  auto *cq = static_cast<char *>(cq_ptr);
+  sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+  sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+  cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+  return true;
+}
+
+bool loader::ring::supports(std::initializer_list<unsigned> ops) const {
+  constexpr unsigned max_ops = 256;
+  std::vector<char> storage(sizeof(io_uring_probe) +
+                            max_ops * sizeof(io_uring_probe_op));
+  auto *probe = reinterpret_cast<io_uring_probe *>(storage.data());
+  if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe,
+              max_ops) == -1) {
+    return false;
+  }
+  for (unsigned op : ops) {
+    if (op > probe->last_op ||
+        !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+io_uring_sqe *loader::ring::get_sqe() {
+  unsigned tail = *sq_tail + queued;
+  if (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= entries) {
+    return nullptr;
+  }
+  unsigned index = tail & *sq_mask;
+  sq_array[index] = index;
+  ++queued;
+  io_uring_sqe *sqe = &sqes[index];
+  *sqe = io_uring_sqe{};
+  return sqe;
+}
+
+void loader::ring::submit_and_wait() {
+  unsigned to_submit = queued;
+  __atomic_store_n(sq_tail, *sq_tail + queued, __ATOMIC_RELEASE);
+  queued = 0;
+  while (syscall(__NR_io_uring_enter, fd, to_submit, 1,
+                 IORING_ENTER_GETEVENTS, nullptr, 0) == -1) {
+    if (errno != EINTR) {
+      throw std::runtime_error("Failed to submit io_uring requests");
+    }
+    to_submit = 0;
+  }
+}
+
+loader::loader(unsigned queue_depth) {
+  if (queue_depth == 0) {
+    return;
+  }
+  auto r = std::make_unique<ring>();
+  if (r->setup(queue_depth) &&
+      r->supports({IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ})) {
+    m_ring = std::move(r);
+  }
+}
+
+loader::~loader() = default;
+
+void loader::load(std::span<const std::string> paths,
+                  const callback &on_loaded) {
+  if (m_ring) {
+    load_with_ring(paths, on_loaded);
+  } else {
+    load_with_threads(paths, on_loaded);
+  }
+}
+
+void loader::load_with_ring(std::span<const std::string> paths,
+                            const callback &on_loaded) {
+  struct pending {
+    int fd = -1;
+    int waiting = 0;
+    struct statx stx;
+    loaded_buffer buf;
+    size_t expected = 0;
+  };
+  std::vector<pending> files(paths.size());
+  ring &r = *m_ring;
+  // Every file has at most two requests in flight, so capping the number of
+  // files keeps the submission queue from overflowing.
+  const size_t max_files = std::max(1u, r.entries / 2);
+  size_t next = 0;
+  size_t in_flight = 0;
+  unsigned in_flight_ops = 0;
+  std::exception_ptr error;
+
+  auto queue_read = [&](size_t index) {
+    pending &p = files[index];
+    io_uring_sqe *sqe = r.get_sqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = p.fd;
+    sqe->addr = reinterpret_cast<uint64_t>(p.buf.data.get() + p.buf.size);
+    sqe->len = static_cast<uint32_t>(
+        std::min<size_t>(p.expected - p.buf.size, 1u << 30));
+    sqe->off = p.buf.size;
+    sqe->user_data = make_user_data(index, OP_READ);
+    p.waiting = 1;
+    ++in_flight_ops;
+  };
+  auto finish = [&](size_t index) {
+    pending &p = files[index];
+    if (p.fd != -1) {
+      close(p.fd);
+      p.fd = -1;
+    }
+    --in_flight;
+    if (!error) {
+      try {
+        file f(p.buf.data.get(), p.buf.size);
+        on_loaded(paths[index], f);
+      } catch (...) {
+        error = std::current_exception();
+      }
+    }
+    p.buf = {};
+  };
+  auto fail = [&](size_t index, std::string_view what) {
+    if (!error) {
+      error = std::make_exception_ptr(
+          std::runtime_error(std::format("{} {}", what, paths[index])));
+    }
+  };
+
+  while (next < files.size() || in_flight > 0) {
+    while (!error && next < files.size() && in_flight < max_files) {
+      pending &p = files[next];
+      io_uring_sqe *sqe = r.get_sqe();
+      sqe->opcode = IORING_OP_OPENAT;
+      sqe->fd = AT_FDCWD;
+      sqe->addr = reinterpret_cast<uint64_t>(paths[next].c_str());
+      sqe->open_flags = O_RDONLY | O_CLOEXEC;
+      sqe->user_data = make_user_data(next, OP_OPEN);
+
+      sqe = r.get_sqe();
+      sqe->opcode = IORING_OP_STATX;
+      sqe->fd = AT_FDCWD;
+      sqe->addr = reinterpret_cast<uint64_t>(paths[next].c_str());
+      sqe->len = STATX_SIZE;
+      sqe->off = reinterpret_cast<uint64_t>(&p.stx);
+      sqe->user_data = make_user_data(next, OP_STATX);
+
+      p.waiting = 2;
+      in_flight_ops += 2;
+      ++in_flight;
+      ++next;
+    }
+    if (error && in_flight_ops == 0) {
+      break;
+    }
+    r.submit_and_wait();
+
+    unsigned head = *r.cq_head;
+    while (head != __atomic_load_n(r.cq_tail, __ATOMIC_ACQUIRE)) {
+      const io_uring_cqe &cqe = r.cqes[head & *r.cq_mask];
+      size_t index = cqe.user_data >> 2;
+      auto op = static_cast<op_kind>(cqe.user_data & 3);
+      int res = cqe.res;
+      ++head;
+      --in_flight_ops;
+
+      pending &p = files[index];
+      --p.waiting;
+      if (op == OP_OPEN) {
+        if (res < 0) {
+          fail(index, "Failed to open file");
+        } else {
+          p.fd = res;
+        }
+      } else if (op == OP_STATX) {
+        if (res < 0) {
+          fail(index, "Failed to get file size");
+        } else {
+          p.expected = p.stx.stx_size;
+        }
+      } else if (res < 0) {
+        fail(index, "Failed to read file");
+      } else {
+        p.buf.size += res;
+        // A zero-length read means the file shrank after statx; hand over
+        // whatever was read.
+        if (res > 0 && p.buf.size < p.expected && !error) {
+          queue_read(index);
+        }
+      }
+      if (p.waiting > 0) {
+        continue;
+      }
+      if (op != OP_READ && !error && p.expected > 0) {
+        p.buf.data = std::make_unique_for_overwrite<char[]>(p.expected);
+        queue_read(index);
+        continue;
+      }
+      finish(index);
+    }
+    __atomic_store_n(r.cq_head, head, __ATOMIC_RELEASE);
+  }
+
+  for (pending &p : files) {
+    if (p.fd != -1) {
+      close(p.fd);
+    }
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+void loader::load_with_threads(std::span<const std::string> paths,
+                               const callback &on_loaded) {
+  struct result {
+    size_t index = 0;
+    loaded_buffer buf{};
+    std::exception_ptr error{};
+  };
+  std::mutex mutex;
+  std::condition_variable ready_cv;
+  std::deque<result> ready;
+  std::atomic<size_t> next{0};
+  std::atomic<bool> stop{false};
+  std::exception_ptr error;
+  {
+    auto worker = [&] {
+      while (!stop.load(std::memory_order_relaxed)) {
+        size_t index = next.fetch_add(1, std::memory_order_relaxed);
+        if (index >= paths.size()) {
+          break;
+        }
+        result r{index};
+        try {
+          r.buf = read_whole_file(paths[index]);
+        } catch (...) {
+          r.error = std::current_exception();
+        }
+        std::lock_guard lock(mutex);
+        ready.push_back(std::move(r));
+        ready_cv.notify_one();
+      }
+    };
+    size_t thread_count =
+        std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()),
+                         paths.size());
+    std::vector<std::jthread> workers;
+    for (size_t i = 0; i < thread_count; ++i) {
+      workers.emplace_back(worker);
+    }
+
+    for (size_t done = 0; done < paths.size() && !error; ++done) {
+      result r;
+      {
+        std::unique_lock lock(mutex);
+        ready_cv.wait(lock, [&] { return !ready.empty(); });
+        r = std::move(ready.front());
+        ready.pop_front();
+      }
+      if (r.error) {
+        error = r.error;
+        break;
+      }
+      try {
+        file f(r.buf.data.get(), r.buf.size);
+        on_loaded(paths[r.index], f);
+      } catch (...) {
+        error = std::current_exception();
+      }
+    }
+    stop = true;
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
@@ -0,0 +1,43 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "file.h"
+
+// Reads a batch of source files into memory. Opens, size queries and reads
+// for the whole batch are submitted through io_uring when the kernel supports
+// it; otherwise a pool of worker threads performs the same steps. Every file
+// is handed to the callback on the calling thread as soon as its read
+// completes, so completion order is not the order of `paths`. The `file`
+// passed to the callback is only valid for the duration of the call. A queue
+// depth of zero skips io_uring and always uses the threaded path.
+class loader {
+public:
+  using callback = std::function<void(std::string_view path, file &f)>;
+
+  explicit loader(unsigned queue_depth = 64);
+  ~loader();
+  loader(const loader &) = delete;
+  loader &operator=(const loader &) = delete;
+
+  void load(std::span<const std::string> paths, const callback &on_loaded);
+  bool uses_io_uring() const { return m_ring != nullptr; }
+
+private:
+  struct ring;
+
+  void load_with_ring(std::span<const std::string> paths,
+                      const callback &on_loaded);
+  void load_with_threads(std::span<const std::string> paths,
+                         const callback &on_loaded);
+
+private:
+  std::unique_ptr<ring> m_ring;
+};
+
+#endif // LOADER_H
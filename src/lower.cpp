@@ -0,0 +1,633 @@
+#include "lower.h"
+
+#include <algorithm>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+#include "regalloc.h"
+#include "x86_64.h"
+
+namespace cc::x86_64 {
+namespace {
+using ir::opcode;
+using ir::ref;
+
+constexpr reg k_arg_regs[] = {rdi, rsi, rdx, rcx, r8, r9};
+
+cond condition(opcode op) {
+  switch (op) {
+  case opcode::eq:
+    return cc_e;
+  case opcode::ne:
+    return cc_ne;
+  case opcode::lt:
+    return cc_l;
+  case opcode::le:
+    return cc_le;
+  case opcode::gt:
+    return cc_g;
+  case opcode::ge:
+    return cc_ge;
+  case opcode::ult:
+    return cc_b;
+  case opcode::ule:
+    return cc_be;
+  case opcode::ugt:
+    return cc_a;
+  default:
+    return cc_ae;
+  }
+}
+
+alu_op alu(opcode op) {
+  switch (op) {
+  case opcode::add:
+    return alu_add;
+  case opcode::sub:
+    return alu_sub;
+  case opcode::and_:
+    return alu_and;
+  case opcode::or_:
+    return alu_or;
+  case opcode::xor_:
+    return alu_xor;
+  default:
+    return alu_cmp;
+  }
+}
+
+// Where a value is: a register, a frame slot at m_value(%rbp), or the
+// constant m_value.
+struct loc {
+  enum kind : uint8_t { in_reg, in_frame, immediate };
+
+  kind m_kind;
+  reg m_reg = rax;
+  int64_t m_value = 0;
+
+  bool operator==(const loc &) const = default;
+};
+
+loc in(reg r) { return {loc::in_reg, r}; }
+
+struct move {
+  loc m_dst;
+  loc m_src;
+};
+
+class lowering {
+public:
+  lowering(const ir::function &fn, object_module &module)
+      : m_fn(fn), m_module(module), m_asm(module.section(section_id::text)),
+        m_alloc(allocate_registers(fn)) {}
+
+  void run();
+
+private:
+  int32_t frame_slot(uint64_t size, uint64_t align);
+  loc where(ref value, uint32_t pos) const;
+  std::optional<int32_t> immediate(ref value) const;
+  void copy(loc dst, loc src);
+  void parallel_copy(std::vector<move> &moves);
+  reg use(ref value, uint32_t pos, reg scratch);
+  reg target(ref n) const;
+  void define(ref n, reg r);
+  void normalize(reg r, const ir::inst &i);
+  void entry();
+  void epilogue();
+  std::vector<move> edge_moves(uint32_t from, uint32_t to) const;
+  uint32_t forward(uint32_t block) const;
+  bool falls_into(uint32_t block, uint32_t target) const;
+  void jump_to(size_t at, uint32_t block);
+  void branch(const ir::inst &i, uint32_t block);
+  void instruction(ref n, uint32_t block);
+
+  const ir::function &m_fn;
+  object_module &m_module;
+  assembler m_asm;
+  allocation m_alloc;
+  int32_t m_frame_size = 0;
+  std::vector<int32_t> m_locals;
+  std::vector<int32_t> m_spill_slots;
+  std::vector<std::pair<reg, int32_t>> m_saved;
+  std::vector<int64_t> m_block_pos;
+  // Where each block that only jumps leads, or the block itself.
+  std::vector<uint32_t> m_jumps_to;
+  std::vector<std::pair<size_t, uint32_t>> m_fixups;
+  size_t m_next_split = 0;
+  // The condition a fused comparison left in the flags.
+  cond m_flags = cc_ne;
+};
+
+int32_t lowering::frame_slot(uint64_t size, uint64_t align) {
+  uint64_t frame = (m_frame_size + size + align - 1) & ~(align - 1);
+  if (frame > INT32_MAX / 2) {
+    throw std::runtime_error("Stack frame too large");
+  }
+  m_frame_size = static_cast<int32_t>(frame);
+  return -m_frame_size;
+}
+
+loc lowering::where(ref value, uint32_t pos) const {
+  const ir::inst &i = m_fn.m_insts[value];
+  if (i.m_op == opcode::constant) {
+    return {loc::immediate, rax, i.m_imm};
+  }
+  const interval &piece = m_alloc.at(value, pos);
+  if (piece.m_reg != k_spilled) {
+    return in(static_cast<reg>(piece.m_reg));
+  }
+  return {loc::in_frame, rbp, m_spill_slots[m_alloc.m_spill_slot[value]]};
+}
+
+std::optional<int32_t> lowering::immediate(ref value) const {
+  const ir::inst &i = m_fn.m_insts[value];
+  if (i.m_op == opcode::constant && i.m_imm >= INT32_MIN &&
+      i.m_imm <= INT32_MAX) {
+    return static_cast<int32_t>(i.m_imm);
+  }
+  return std::nullopt;
+}
+
+// Frame to frame and constant to frame copies go through %rcx, which is
+// never a source or destination of the same parallel copy.
+void lowering::copy(loc dst, loc src) {
+  if (dst == src) {
+    return;
+  }
+  if (dst.m_kind == loc::in_reg) {
+    switch (src.m_kind) {
+    case loc::in_reg:
+      m_asm.mov(dst.m_reg, src.m_reg);
+      break;
+    case loc::in_frame:
+      m_asm.load(dst.m_reg, rbp, static_cast<int32_t>(src.m_value), 8, false);
+      break;
+    case loc::immediate:
+      m_asm.mov_imm(dst.m_reg, src.m_value);
+      break;
+    }
+    return;
+  }
+  reg r = src.m_reg;
+  if (src.m_kind != loc::in_reg) {
+    copy(in(rcx), src);
+    r = rcx;
+  }
+  m_asm.store(rbp, static_cast<int32_t>(dst.m_value), r, 8);
+}
+
+// Makes every copy as if all sources were read before any destination is
+// written. Cycles are broken through %rax.
+void lowering::parallel_copy(std::vector<move> &moves) {
+  std::erase_if(moves, [](const move &m) { return m.m_dst == m.m_src; });
+  while (!moves.empty()) {
+    bool progress = false;
+    for (size_t k = 0; k < moves.size();) {
+      loc dst = moves[k].m_dst;
+      if (std::ranges::any_of(moves,
+                              [&](const move &m) { return m.m_src == dst; })) {
+        ++k;
+        continue;
+      }
+      copy(dst, moves[k].m_src);
+      moves[k] = moves.back();
+      moves.pop_back();
+      progress = true;
+    }
+    if (!progress) {
+      loc parked = moves.front().m_dst;
+      copy(in(rax), parked);
+      for (move &m : moves) {
+        if (m.m_src == parked) {
+          m.m_src = in(rax);
+        }
+      }
+    }
+  }
+}
+
+// The register holding `value` at `pos`, loading it into `scratch` if it
+// is not in one.
+reg lowering::use(ref value, uint32_t pos, reg scratch) {
+  loc l = where(value, pos);
+  if (l.m_kind == loc::in_reg) {
+    return l.m_reg;
+  }
+  copy(in(scratch), l);
+  return scratch;
+}
+
+// The register to compute `n` into.
+reg lowering::target(ref n) const {
+  if (m_alloc.m_first[n] == k_no_interval) {
+    return rax;
+  }
+  loc l = where(n, 2 * n + 1);
+  return l.m_kind == loc::in_reg ? l.m_reg : rax;
+}
+
+void lowering::define(ref n, reg r) {
+  if (m_alloc.m_first[n] != k_no_interval) {
+    copy(where(n, 2 * n + 1), in(r));
+  }
+}
+
+void lowering::normalize(reg r, const ir::inst &i) {
+  if (i.m_size >= 8) {
+    return;
+  }
+  if (i.m_size == 1 && !i.m_signed) {
+    m_asm.movzx8(r, r);
+  } else {
+    m_asm.movsx(r, r, i.m_size);
+  }
+}
+
+void lowering::entry() {
+  for (uint8_t r = 0; r < 16; ++r) {
+    if (m_alloc.m_callee_saved & (1u << r)) {
+      m_saved.emplace_back(static_cast<reg>(r), frame_slot(8, 8));
+      m_asm.store(rbp, m_saved.back().second, static_cast<reg>(r), 8);
+    }
+  }
+  std::vector<move> moves;
+  for (ref n = 0; n < m_fn.m_insts.size(); ++n) {
+    const ir::inst &i = m_fn.m_insts[n];
+    if (i.m_op == opcode::param && m_alloc.m_first[n] != k_no_interval) {
+      moves.push_back({where(n, 0), in(k_arg_regs[i.m_imm])});
+    }
+  }
+  parallel_copy(moves);
+  for (ref n = 0; n < m_fn.m_insts.size(); ++n) {
+    const ir::inst &i = m_fn.m_insts[n];
+    if (i.m_op == opcode::param && m_alloc.m_first[n] != k_no_interval &&
+        i.m_size < 8) {
+      loc l = where(n, 0);
+      reg r = use(n, 0, rax);
+      normalize(r, i);
+      copy(l, in(r));
+    }
+  }
+}
+
+void lowering::epilogue() {
+  for (auto [r, slot] : m_saved) {
+    m_asm.load(r, rbp, slot, 8, false);
+  }
+  m_asm.leave();
+  m_asm.ret();
+}
+
+// The phi copies on the edge, and the values that live on in a different
+// place in `to` than at the end of `from`.
+std::vector<move> lowering::edge_moves(uint32_t from, uint32_t to) const {
+  std::vector<move> moves;
+  uint32_t exit_pos = 2 * m_fn.m_blocks[from].m_end - 1;
+  uint32_t entry_pos = 2 * m_fn.m_blocks[to].m_first;
+  auto preds = m_fn.preds(to);
+  auto edge = std::ranges::find(preds, from) - preds.begin();
+  auto add = [&](loc dst, loc src) {
+    if (dst != src) {
+      moves.push_back({dst, src});
+    }
+  };
+  for (ref n = m_fn.m_blocks[to].m_first;
+       m_fn.m_insts[n].m_op == opcode::phi; ++n) {
+    const ir::inst &phi = m_fn.m_insts[n];
+    if (phi.m_b != 0 && m_alloc.m_first[n] != k_no_interval) {
+      add(where(n, entry_pos), where(m_fn.operands(phi)[edge], exit_pos));
+    }
+  }
+  for (uint32_t k = m_alloc.m_live_in_begin[to];
+       k < m_alloc.m_live_in_begin[to + 1]; ++k) {
+    ref v = m_alloc.m_live_in[k];
+    if (m_alloc.is_split(v)) {
+      add(where(v, entry_pos), where(v, exit_pos));
+    }
+  }
+  return moves;
+}
+
+// Jumps to a block that only jumps on, with nothing to copy on the way,
+// go straight to where it leads.
+uint32_t lowering::forward(uint32_t block) const {
+  for (size_t hops = 0; hops < m_fn.m_blocks.size(); ++hops) {
+    if (m_jumps_to[block] == block) {
+      break;
+    }
+    block = m_jumps_to[block];
+  }
+  return block;
+}
+
+// Whether code after `block` reaches `target` without a jump.
+bool lowering::falls_into(uint32_t block, uint32_t target) const {
+  return block + 1 < m_fn.m_blocks.size() &&
+         forward(target) == forward(block + 1);
+}
+
+void lowering::jump_to(size_t at, uint32_t block) {
+  block = forward(block);
+  if (m_block_pos[block] >= 0) {
+    m_asm.patch_rel32(at, m_block_pos[block]);
+  } else {
+    m_fixups.emplace_back(at, block);
+  }
+}
+
+// Each edge that needs copies gets them on its own path, after the jump
+// that splits the two.
+void lowering::branch(const ir::inst &i, uint32_t block) {
+  uint32_t taken = i.m_b;
+  auto other = static_cast<uint32_t>(i.m_imm);
+  const ir::inst &c = m_fn.m_insts[i.m_a];
+  if (c.m_op == opcode::constant) {
+    uint32_t target = c.m_imm != 0 ? taken : other;
+    auto moves = edge_moves(block, target);
+    parallel_copy(moves);
+    if (!falls_into(block, target)) {
+      jump_to(m_asm.jmp(), target);
+    }
+    return;
+  }
+  cond when = m_flags;
+  if (!m_alloc.m_fused[i.m_a]) {
+    reg r = use(i.m_a, 2 * (m_fn.m_blocks[block].m_end - 1), rax);
+    m_asm.test(r, r);
+    when = cc_ne;
+  }
+  auto taken_moves = edge_moves(block, taken);
+  auto other_moves = edge_moves(block, other);
+  if (taken_moves.empty() || other_moves.empty()) {
+    if (taken_moves.empty() &&
+        (!other_moves.empty() || !falls_into(block, taken))) {
+      jump_to(m_asm.jcc(when), taken);
+    } else {
+      jump_to(m_asm.jcc(invert(when)), other);
+      std::swap(taken, other);
+      std::swap(taken_moves, other_moves);
+    }
+    parallel_copy(other_moves);
+    if (!falls_into(block, other)) {
+      jump_to(m_asm.jmp(), other);
+    }
+    return;
+  }
+  size_t skip = m_asm.jcc(invert(when));
+  parallel_copy(taken_moves);
+  jump_to(m_asm.jmp(), taken);
+  m_asm.patch_rel32(skip, m_asm.pos());
+  parallel_copy(other_moves);
+  if (!falls_into(block, other)) {
+    jump_to(m_asm.jmp(), other);
+  }
+}
+
+void lowering::run() {
+  size_t start = m_asm.pos();
+  m_asm.push(rbp);
+  m_asm.mov(rbp, rsp);
+  size_t frame_patch = m_asm.sub_rsp();
+
+  // Slots mem2reg promoted take no space.
+  std::vector<bool> accessed(m_fn.m_slots.size(), false);
+  for (const ir::inst &i : m_fn.m_insts) {
+    if (i.m_op == opcode::frame_addr || i.m_op == opcode::load_slot ||
+        i.m_op == opcode::store_slot) {
+      accessed[i.m_imm] = true;
+    }
+  }
+  m_locals.assign(m_fn.m_slots.size(), 0);
+  for (size_t k = 0; k < m_fn.m_slots.size(); ++k) {
+    if (accessed[k]) {
+      m_locals[k] = frame_slot(m_fn.m_slots[k].m_size, m_fn.m_slots[k].m_align);
+    }
+  }
+  for (uint32_t k = 0; k < m_alloc.m_spill_slots; ++k) {
+    m_spill_slots.push_back(frame_slot(8, 8));
+  }
+  entry();
+
+  m_jumps_to.resize(m_fn.m_blocks.size());
+  for (uint32_t b = 0; b < m_fn.m_blocks.size(); ++b) {
+    const ir::block &block = m_fn.m_blocks[b];
+    const ir::inst &t = m_fn.m_insts[block.m_first];
+    auto target = static_cast<uint32_t>(t.m_imm);
+    bool only_jumps = block.m_end - block.m_first == 1 &&
+                      t.m_op == opcode::jump && edge_moves(b, target).empty();
+    m_jumps_to[b] = only_jumps ? target : b;
+  }
+  m_block_pos.assign(m_fn.m_blocks.size(), -1);
+  for (uint32_t b = 0; b < m_fn.m_blocks.size(); ++b) {
+    m_block_pos[b] = m_asm.pos();
+    for (ref n = m_fn.m_blocks[b].m_first; n < m_fn.m_blocks[b].m_end; ++n) {
+      std::vector<move> moves;
+      for (; m_next_split < m_alloc.m_splits.size() &&
+             m_alloc.m_splits[m_next_split].first == 2 * n;
+           ++m_next_split) {
+        ref v = m_alloc.m_splits[m_next_split].second;
+        moves.push_back({where(v, 2 * n), where(v, 2 * n - 1)});
+      }
+      parallel_copy(moves);
+      instruction(n, b);
+    }
+  }
+  for (auto [at, block] : m_fixups) {
+    m_asm.patch_rel32(at, m_block_pos[block]);
+  }
+  m_asm.patch_imm32(frame_patch, (m_frame_size + 15) & ~15);
+  m_module.define(m_fn.m_symbol, section_id::text, start, m_asm.pos() - start,
+                  m_fn.m_global, true);
+}
+
+void lowering::instruction(ref n, uint32_t block) {
+  const ir::inst &i = m_fn.m_insts[n];
+  uint32_t pos = 2 * n;
+  switch (i.m_op) {
+  case opcode::constant:
+  case opcode::param:
+  case opcode::phi:
+    break;
+  case opcode::frame_addr: {
+    reg r = target(n);
+    m_asm.lea(r, rbp, m_locals[i.m_imm]);
+    define(n, r);
+    break;
+  }
+  case opcode::symbol_addr: {
+    reg r = target(n);
+    size_t at = i.m_external ? m_asm.load_rip(r) : m_asm.lea_rip(r);
+    m_module.add_relocation(
+        {section_id::text, at, static_cast<uint32_t>(i.m_imm),
+         i.m_external ? reloc_type::gotpcrel : reloc_type::pc32, -4});
+    define(n, r);
+    break;
+  }
+  case opcode::load: {
+    reg a = use(i.m_a, pos, rax);
+    reg r = target(n);
+    m_asm.load(r, a, 0, i.m_size, i.m_signed);
+    define(n, r);
+    break;
+  }
+  case opcode::store:
+    m_asm.store(use(i.m_a, pos, rax), 0, use(i.m_b, pos, rcx), i.m_size);
+    break;
+  case opcode::load_slot: {
+    reg r = target(n);
+    m_asm.load(r, rbp, m_locals[i.m_imm], i.m_size, i.m_signed);
+    define(n, r);
+    break;
+  }
+  case opcode::store_slot:
+    m_asm.store(rbp, m_locals[i.m_imm], use(i.m_a, pos, rax), i.m_size);
+    break;
+  case opcode::add:
+  case opcode::sub:
+  case opcode::and_:
+  case opcode::or_:
+  case opcode::xor_:
+  case opcode::mul: {
+    ref lhs = i.m_a;
+    ref rhs = i.m_b;
+    reg r = target(n);
+    if (i.m_op != opcode::sub && where(rhs, pos) == in(r)) {
+      std::swap(lhs, rhs);
+    }
+    auto imm = immediate(rhs);
+    reg b = imm ? rcx : use(rhs, pos, rcx);
+    if (!imm && r == b) {
+      r = rax;
+    }
+    copy(in(r), where(lhs, pos));
+    if (i.m_op == opcode::mul && imm) {
+      m_asm.imul_imm(r, *imm);
+    } else if (i.m_op == opcode::mul) {
+      m_asm.imul(r, b);
+    } else if (imm) {
+      m_asm.alu_imm(alu(i.m_op), r, *imm);
+    } else {
+      m_asm.alu(alu(i.m_op), r, b);
+    }
+    normalize(r, i);
+    define(n, r);
+    break;
+  }
+  case opcode::shl:
+  case opcode::sar: {
+    shift_op op = i.m_op == opcode::shl ? shift_shl : shift_sar;
+    reg r = target(n);
+    if (auto imm = immediate(i.m_b)) {
+      copy(in(r), where(i.m_a, pos));
+      m_asm.shift_imm(op, r, *imm & 63);
+    } else {
+      // The count goes to cl first, in case the target register holds it.
+      copy(in(rcx), where(i.m_b, pos));
+      copy(in(r), where(i.m_a, pos));
+      m_asm.shift(op, r);
+    }
+    normalize(r, i);
+    define(n, r);
+    break;
+  }
+  case opcode::div:
+  case opcode::rem: {
+    copy(in(rax), where(i.m_a, pos));
+    reg b = use(i.m_b, pos, rcx);
+    m_asm.cqo();
+    m_asm.idiv(b);
+    reg r = i.m_op == opcode::rem ? rdx : rax;
+    normalize(r, i);
+    define(n, r);
+    break;
+  }
+  case opcode::neg:
+  case opcode::not_:
+  case opcode::extend: {
+    reg r = target(n);
+    copy(in(r), where(i.m_a, pos));
+    if (i.m_op == opcode::neg) {
+      m_asm.neg(r);
+    } else if (i.m_op == opcode::not_) {
+      m_asm.not_(r);
+    }
+    normalize(r, i);
+    define(n, r);
+    break;
+  }
+  case opcode::eq:
+  case opcode::ne:
+  case opcode::lt:
+  case opcode::le:
+  case opcode::gt:
+  case opcode::ge:
+  case opcode::ult:
+  case opcode::ule:
+  case opcode::ugt:
+  case opcode::uge: {
+    reg a = use(i.m_a, pos, rax);
+    auto imm = immediate(i.m_b);
+    if (imm == 0) {
+      m_asm.test(a, a);
+    } else if (imm) {
+      m_asm.alu_imm(alu_cmp, a, *imm);
+    } else {
+      m_asm.alu(alu_cmp, a, use(i.m_b, pos, rcx));
+    }
+    if (m_alloc.m_fused[n]) {
+      m_flags = condition(i.m_op);
+      break;
+    }
+    reg r = target(n);
+    m_asm.setcc(condition(i.m_op), r);
+    m_asm.movzx8(r, r);
+    define(n, r);
+    break;
+  }
+  case opcode::call: {
+    auto args = m_fn.operands(i);
+    std::vector<move> moves;
+    for (size_t k = 0; k < args.size(); ++k) {
+      moves.push_back({in(k_arg_regs[k]), where(args[k], pos)});
+    }
+    parallel_copy(moves);
+    // %al holds the number of vector registers used by a variadic call.
+    m_asm.mov_imm(rax, 0);
+    size_t at = m_asm.call();
+    m_module.add_relocation({section_id::text, at,
+                             static_cast<uint32_t>(i.m_imm),
+                             reloc_type::plt32, -4});
+    normalize(rax, i);
+    define(n, rax);
+    break;
+  }
+  case opcode::jump: {
+    auto target = static_cast<uint32_t>(i.m_imm);
+    auto moves = edge_moves(block, target);
+    parallel_copy(moves);
+    if (!falls_into(block, target)) {
+      jump_to(m_asm.jmp(), target);
+    }
+    break;
+  }
+  case opcode::branch:
+    branch(i, block);
+    break;
+  case opcode::ret:
+    if (i.m_a != ir::k_no_ref) {
+      copy(in(rax), where(i.m_a, pos));
+    }
+    epilogue();
+    break;
+  default:
+    throw std::logic_error("unexpected instruction in lowering");
+  }
+}
+} // namespace
+
+void lower(const ir::function &fn, object_module &module) {
+  lowering(fn, module).run();
+}
+} // namespace cc::x86_64
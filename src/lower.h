@@ -0,0 +1,14 @@
+#ifndef CPPPROJECT_LOWER_H
+#define CPPPROJECT_LOWER_H
+
+#include "ir.h"
+#include "object.h"
+
+namespace cc::x86_64 {
+// Emits machine code for `fn` into the module's text and defines its
+// symbol. Values live where allocate_registers puts them; phis and values
+// that change place between blocks are copied on each edge, all at once.
+void lower(const ir::function &fn, object_module &module);
+} // namespace cc::x86_64
+
+#endif // CPPPROJECT_LOWER_H
@@ -1,15 +1,138 @@
+#include <csignal>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
 #include <iostream>
+#include <memory>
 #include <sstream>
+#include <string>
+#include <vector>
 
+#include "compile.h"
+#include "elf_writer.h"
 #include "file.h"
+#include "jit.h"
+#include "lexer.h"
+#include "loader.h"
+#include "object.h"
+#include "server.h"
+
+namespace fs = std::filesystem;
+
+static void lex_file(std::string_view path, file &f) {
+  try {
+    cc::lexer l(f);
+    while (l.get_next_token().m_token_class != cc::token_class::T_EOF) {
+    }
+  } catch (const std::runtime_error &e) {
+    throw std::runtime_error(std::format("{}: {}", path, e.what()));
+  }
+}
+
+static cc::object_module compile_file(std::string_view path, file &f,
+                                      bool optimize) {
+  try {
+    return cc::compile(f, optimize);
+  } catch (const std::runtime_error &e) {
+    throw std::runtime_error(std::format("{}: {}", path, e.what()));
+  }
+}
+
+// Hands the compile to the server named by ACC_SERVER, if one is running.
+static bool compile_with_server(const std::string &input,
+                                const std::string &output, bool optimize) {
+  const char *socket_path = std::getenv("ACC_SERVER");
+  return socket_path != nullptr &&
+         cc::compile_remote(socket_path, input, optimize, output);
+}
+
+static std::vector<std::string> collect_sources(const fs::path &dir) {
+  std::vector<std::string> paths;
+  for (const auto &entry : fs::recursive_directory_iterator(dir)) {
+    auto ext = entry.path().extension();
+    if (entry.is_regular_file() && (ext == ".c" || ext == ".h")) {
+      paths.push_back(entry.path().string());
+    }
+  }
+  return paths;
+}
 
 int main(int argc, char **argv) {
-  if (argc == 1 || argc > 2) {
-    std::cerr << "usage: acc <filepath>" << std::endl;
+  std::string input;
+  std::string output;
+  std::string server;
+  bool optimize = false;
+  bool run = false;
+  int i = 1;
+  // With --run, what follows the input is passed to its main.
+  for (; i < argc && !(run && !input.empty()); ++i) {
+    std::string_view arg = argv[i];
+    if (arg == "-o" && i + 1 < argc) {
+      output = argv[++i];
+    } else if (arg == "-O") {
+      optimize = true;
+    } else if (arg == "--server" && i + 1 < argc) {
+      server = argv[++i];
+    } else if (arg == "--run") {
+      run = true;
+    } else if (input.empty() && !arg.starts_with('-')) {
+      input = arg;
+    } else {
+      input.clear();
+      break;
+    }
+  }
+  if (!server.empty() && input.empty() && !run) {
+    // A client that goes away early must not take the server with it.
+    std::signal(SIGPIPE, SIG_IGN);
+    try {
+      cc::compile_server daemon(server);
+      daemon.run();
+    } catch (const std::exception &e) {
+      std::cerr << "acc: " << e.what() << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    exit(EXIT_SUCCESS);
+  }
+  if (input.empty() || !server.empty()) {
+    std::cerr << "usage: acc [-O] [-o output] <filepath|directory>\n"
+                 "       acc [-O] --run <filepath> [args...]\n"
+                 "       acc --server <socket>"
+              << std::endl;
     exit(EXIT_FAILURE);
   }
 
-  file f(argv[1]);
+  if (run) {
+    try {
+      file f(input);
+      auto module = compile_file(input, f, optimize);
+      cc::jit_image image(module);
+      exit(image.run_main(argc - i + 1, argv + i - 1));
+    } catch (const std::exception &e) {
+      std::cerr << "acc: " << e.what() << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  try {
+    if (fs::is_directory(input)) {
+      auto paths = collect_sources(input);
+      loader ld;
+      ld.load(paths, lex_file);
+    } else {
+      if (output.empty()) {
+        output = fs::path(input).filename().replace_extension(".o").string();
+      }
+      if (!compile_with_server(input, output, optimize)) {
+        file f(input);
+        auto module = compile_file(input, f, optimize);
+        cc::elf::write_object(module, output);
+      }
+    }
+  } catch (const std::exception &e) {
+    std::cerr << "acc: " << e.what() << std::endl;
+    exit(EXIT_FAILURE);
+  }
 
   // fs::path filepath{argv[1]};
   // std::ifstream ifs(filepath);
@@ -0,0 +1,99 @@
+#include "object.h"
+
+#include <cstring>
+#include <format>
+#include <stdexcept>
+
+namespace cc {
+uint32_t object_module::symbol(std::string_view name) {
+  auto [it, inserted] =
+      m_symbol_index.try_emplace(std::string(name), m_symbols.size());
+  if (inserted) {
+    m_symbols.push_back({std::string(name)});
+  }
+  return it->second;
+}
+
+void object_module::define(uint32_t symbol, section_id section,
+                           uint64_t offset, uint64_t size, bool global,
+                           bool function) {
+  object_symbol &sym = m_symbols[symbol];
+  if (sym.m_section != section_id::undef) {
+    throw std::runtime_error(std::format("Redefinition of '{}'", sym.m_name));
+  }
+  sym.m_section = section;
+  sym.m_offset = offset;
+  sym.m_size = size;
+  sym.m_global = global;
+  sym.m_function = function;
+}
+
+uint32_t object_module::local_symbol(section_id section, uint64_t offset,
+                                     uint64_t size) {
+  uint32_t index = m_symbols.size();
+  // Never entered into the name index, so the name cannot clash with a
+  // user symbol.
+  m_symbols.push_back(
+      {std::format(".L{}", index), section, offset, size, false, false});
+  return index;
+}
+
+void object_module::define_object(uint32_t symbol, uint64_t size,
+                                  uint64_t align, bool global,
+                                  std::optional<int64_t> init) {
+  if (!init) {
+    define(symbol, section_id::bss, allocate_bss(size, align), size, global,
+           false);
+    return;
+  }
+  m_data.resize((m_data.size() + align - 1) & ~(align - 1));
+  uint64_t offset = m_data.size();
+  uint8_t bytes[8];
+  std::memcpy(bytes, &*init, sizeof(bytes));
+  m_data.insert(m_data.end(), bytes, bytes + size);
+  define(symbol, section_id::data, offset, size, global, false);
+}
+
+uint32_t object_module::add_string(std::string_view bytes) {
+  uint64_t offset = m_rodata.size();
+  m_rodata.insert(m_rodata.end(), bytes.begin(), bytes.end());
+  m_rodata.push_back(0);
+  return local_symbol(section_id::rodata, offset, bytes.size() + 1);
+}
+
+std::vector<uint8_t> &object_module::section(section_id id) {
+  switch (id) {
+  case section_id::text:
+    return m_text;
+  case section_id::data:
+    return m_data;
+  case section_id::rodata:
+    return m_rodata;
+  default:
+    throw std::logic_error("section has no contents");
+  }
+}
+
+const std::vector<uint8_t> &object_module::section(section_id id) const {
+  return const_cast<object_module *>(this)->section(id);
+}
+
+uint64_t object_module::allocate_bss(uint64_t size, uint64_t align) {
+  uint64_t offset = (m_bss_size + align - 1) & ~(align - 1);
+  m_bss_size = offset + size;
+  return offset;
+}
+
+void object_module::resolve_local_relocations() {
+  std::erase_if(m_relocations, [&](const relocation &r) {
+    const object_symbol &sym = m_symbols[r.m_symbol];
+    if (r.m_section != section_id::text || sym.m_section != section_id::text ||
+        (r.m_type != reloc_type::pc32 && r.m_type != reloc_type::plt32)) {
+      return false;
+    }
+    auto value = static_cast<int32_t>(sym.m_offset + r.m_addend - r.m_offset);
+    std::memcpy(m_text.data() + r.m_offset, &value, sizeof(value));
+    return true;
+  });
+}
+} // namespace cc
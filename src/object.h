@@ -0,0 +1,90 @@
+#ifndef CPPPROJECT_OBJECT_H
+#define CPPPROJECT_OBJECT_H
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace cc {
+enum class section_id : uint8_t { undef, text, data, rodata, bss };
+
+enum class reloc_type : uint8_t {
+  // S + A - P, for data defined in this module.
+  pc32,
+  // L + A - P, for calls.
+  plt32,
+  // G + GOT + A - P on a `mov reg, [rip + disp]`, for data defined
+  // elsewhere.
+  gotpcrel,
+  // S + A, for pointers stored in data.
+  abs64,
+};
+
+struct object_symbol {
+  std::string m_name;
+  section_id m_section = section_id::undef;
+  uint64_t m_offset = 0;
+  uint64_t m_size = 0;
+  bool m_global = false;
+  bool m_function = false;
+};
+
+struct relocation {
+  section_id m_section;
+  uint64_t m_offset;
+  uint32_t m_symbol;
+  reloc_type m_type;
+  int64_t m_addend;
+};
+
+// The output of compiling one translation unit: section contents, symbols
+// and the relocations against them. Both the object writer and the JIT
+// consume it.
+class object_module {
+public:
+  // Returns the index of the named symbol, adding an undefined one first if
+  // needed.
+  uint32_t symbol(std::string_view name);
+  void define(uint32_t symbol, section_id section, uint64_t offset,
+              uint64_t size, bool global, bool function);
+  // A fresh local symbol, e.g. for a string literal.
+  uint32_t local_symbol(section_id section, uint64_t offset, uint64_t size);
+  // Defines an object of `size` bytes: in .data holding the low bytes of
+  // `init` if there is one, and in .bss otherwise.
+  void define_object(uint32_t symbol, uint64_t size, uint64_t align,
+                     bool global, std::optional<int64_t> init);
+  // Appends a NUL-terminated copy of `bytes` to .rodata and returns a local
+  // symbol for it.
+  uint32_t add_string(std::string_view bytes);
+
+  std::vector<uint8_t> &section(section_id id);
+  const std::vector<uint8_t> &section(section_id id) const;
+  // Reserves `size` zero bytes at `align` and returns their offset.
+  uint64_t allocate_bss(uint64_t size, uint64_t align);
+  uint64_t bss_size() const { return m_bss_size; }
+
+  void add_relocation(const relocation &r) { m_relocations.push_back(r); }
+  // Patches calls and references between text symbols of this module
+  // directly and drops their relocations, the way an assembler resolves
+  // local labels.
+  void resolve_local_relocations();
+
+  std::span<const object_symbol> symbols() const { return m_symbols; }
+  std::span<const relocation> relocations() const { return m_relocations; }
+
+private:
+  std::vector<uint8_t> m_text;
+  std::vector<uint8_t> m_data;
+  std::vector<uint8_t> m_rodata;
+  uint64_t m_bss_size = 0;
+  std::vector<object_symbol> m_symbols;
+  std::unordered_map<std::string, uint32_t> m_symbol_index;
+  std::vector<relocation> m_relocations;
+};
+} // namespace cc
+
+#endif // CPPPROJECT_OBJECT_H
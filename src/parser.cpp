@@ -0,0 +1,1294 @@
+#include "parser.h"
+
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+#include <utility>
+
+namespace cc {
+namespace {
+int precedence(int op) {
+  switch (op) {
+  case '|':
+    return 1;
+  case '^':
+    return 2;
+  case '&':
+    return 3;
+  case EQ_OP:
+  case NE_OP:
+    return 4;
+  case '<':
+  case '>':
+  case LE_OP:
+  case GE_OP:
+    return 5;
+  case LEFT_OP:
+  case RIGHT_OP:
+    return 6;
+  case '+':
+  case '-':
+    return 7;
+  case '*':
+  case '/':
+  case '%':
+    return 8;
+  default:
+    return 0;
+  }
+}
+
+int compound_operator(int token_class) {
+  switch (token_class) {
+  case ADD_ASSIGN:
+    return '+';
+  case SUB_ASSIGN:
+    return '-';
+  case MUL_ASSIGN:
+    return '*';
+  case DIV_ASSIGN:
+    return '/';
+  case MOD_ASSIGN:
+    return '%';
+  case AND_ASSIGN:
+    return '&';
+  case XOR_ASSIGN:
+    return '^';
+  case OR_ASSIGN:
+    return '|';
+  case LEFT_ASSIGN:
+    return LEFT_OP;
+  case RIGHT_ASSIGN:
+    return RIGHT_OP;
+  default:
+    return 0;
+  }
+}
+
+bool is_pointer(qual_type type) {
+  return type->m_kind == type_kind::pointer;
+}
+
+bool is_unprototyped(const type *function) {
+  return function->m_params.empty() && function->m_variadic;
+}
+
+// Decodes the escape sequence after a backslash and advances `p` past it.
+char decode_escape(const char *&p, const char *end) {
+  char c = *p++;
+  switch (c) {
+  case 'n':
+    return '\n';
+  case 't':
+    return '\t';
+  case 'r':
+    return '\r';
+  case 'a':
+    return '\a';
+  case 'b':
+    return '\b';
+  case 'f':
+    return '\f';
+  case 'v':
+    return '\v';
+  case 'x': {
+    unsigned value = 0;
+    while (p < end && std::isxdigit(static_cast<unsigned char>(*p))) {
+      char d = *p++;
+      value = value * 16 + (d <= '9' ? d - '0' : (d | 0x20) - 'a' + 10);
+    }
+    return static_cast<char>(value);
+  }
+  default:
+    if (c >= '0' && c <= '7') {
+      unsigned value = c - '0';
+      for (int i = 0; i < 2 && p < end && *p >= '0' && *p <= '7'; ++i) {
+        value = value * 8 + (*p++ - '0');
+      }
+      return static_cast<char>(value);
+    }
+    // \\, \', \", \? and anything unknown stand for themselves.
+    return c;
+  }
+}
+
+// Stands in for the real generator while the parser goes over operands that
+// are never evaluated, so that they are checked but emit nothing.
+class discarding_generator final : public generator {
+public:
+  void begin_function(std::string_view, bool) override {}
+  int32_t param(unsigned, qual_type) override { return 0; }
+  void end_function() override {}
+  int32_t local(qual_type) override { return 0; }
+  void global_variable(std::string_view, qual_type, bool,
+                       std::optional<int64_t>) override {}
+  void finish() override {}
+  void push_int(int64_t, qual_type) override {}
+  void push_local(int32_t, qual_type) override {}
+  void push_global(std::string_view, qual_type, bool) override {}
+  void push_function(std::string_view, qual_type) override {}
+  void push_string(std::string_view, qual_type) override {}
+  void pop() override {}
+  std::optional<int64_t> pop_constant() override { return std::nullopt; }
+  void dup() override {}
+  void swap() override {}
+  void address(qual_type) override {}
+  void deref(qual_type) override {}
+  void binary(int, qual_type) override {}
+  void unary(int, qual_type) override {}
+  void cast(qual_type) override {}
+  void assign() override {}
+  void call(unsigned, qual_type) override {}
+  label new_label() override { return 0; }
+  void place(label) override {}
+  void jump(label) override {}
+  void branch(bool, label) override {}
+  void ret(bool) override {}
+};
+} // namespace
+
+parser::parser(lexer &lex, symbol_table &symbols, type_context &types,
+               generator &gen)
+    : m_lexer(lex), m_symbols(symbols), m_types(types), m_gen(&gen) {
+  m_lexer.set_symbol_table(&m_symbols);
+  next();
+}
+
+void parser::error(std::string_view message) const {
+  throw std::runtime_error(
+      std::format("{} at {}", message, m_lexer.location(m_tok)));
+}
+
+std::string parser::spelling() const {
+  // Single-character punctuators are returned without a spelling.
+  if (m_tok.m_value.empty()) {
+    return std::string(1, static_cast<char>(m_tok.m_token_class));
+  }
+  return std::string(m_tok.m_value);
+}
+
+void parser::expect(int token_class, std::string_view what) {
+  if (!is(token_class)) {
+    error(std::format("Expected {}", what));
+  }
+  next();
+}
+
+bool parser::is_type_start() const {
+  static constexpr std::string_view k_type_keywords[] = {
+      "void",     "char",     "short",  "int",      "long",   "signed",
+      "unsigned", "float",    "double", "_Bool",    "struct", "union",
+      "enum",     "const",    "volatile", "restrict", "typedef", "extern",
+      "static",   "auto",     "register", "inline"};
+  if (is(TYPEDEF_NAME)) {
+    return true;
+  }
+  if (!is(KEYWORD)) {
+    return false;
+  }
+  for (auto keyword : k_type_keywords) {
+    if (m_tok.m_value == keyword) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void parser::parse_translation_unit() {
+  while (!is(T_EOF)) {
+    external_declaration();
+  }
+  m_gen->finish();
+}
+
+std::optional<parser::specifiers> parser::declaration_specifiers() {
+  specifiers spec;
+  std::optional<type_kind> kind;
+  qual_type named;
+  unsigned quals = 0;
+  int longs = 0;
+  bool is_int = false;
+  bool any = false;
+  while (true) {
+    if (is(TYPEDEF_NAME)) {
+      // After a type specifier, a typedef name is being redeclared.
+      if (kind || named || longs || is_int) {
+        break;
+      }
+      const symbol *sym = m_symbols.lookup(m_tok.m_value);
+      named = m_decls[sym->m_value].m_type;
+    } else if (!is(KEYWORD)) {
+      break;
+    } else {
+      std::string_view word = m_tok.m_value;
+      if (word == "typedef") {
+        spec.m_typedef = true;
+      } else if (word == "extern") {
+        spec.m_extern = true;
+      } else if (word == "static") {
+        spec.m_static = true;
+      } else if (word == "auto" || word == "register" || word == "inline") {
+      } else if (word == "const") {
+        quals |= q_const;
+      } else if (word == "volatile") {
+        quals |= q_volatile;
+      } else if (word == "restrict") {
+        quals |= q_restrict;
+      } else if (word == "void" || word == "char" || word == "short") {
+        if (kind) {
+          error("Invalid combination of type specifiers");
+        }
+        kind = word == "void"   ? type_kind::void_
+               : word == "char" ? type_kind::char_
+                                : type_kind::short_;
+      } else if (word == "int" || word == "signed") {
+        is_int = true;
+      } else if (word == "long") {
+        ++longs;
+      } else if (word == "unsigned" || word == "float" || word == "double" ||
+                 word == "_Bool" || word == "struct" || word == "union" ||
+                 word == "enum") {
+        error(std::format("'{}' is not supported", word));
+      } else {
+        break;
+      }
+    }
+    any = true;
+    next();
+  }
+  if (!any) {
+    return std::nullopt;
+  }
+
+  qual_type base;
+  if (named) {
+    if (kind || longs || is_int) {
+      error("Invalid combination of type specifiers");
+    }
+    base = named;
+  } else if (kind) {
+    if (longs || (is_int && *kind == type_kind::void_)) {
+      error("Invalid combination of type specifiers");
+    }
+    base = builtin(*kind);
+  } else {
+    // `long long` is as wide as `long` here, and a declaration with only
+    // storage classes or qualifiers is implicitly int.
+    base = builtin(longs ? type_kind::long_ : type_kind::int_);
+  }
+  spec.m_type = base.with(quals);
+  return spec;
+}
+
+unsigned parser::type_qualifiers() {
+  unsigned quals = 0;
+  while (true) {
+    if (is_keyword("const")) {
+      quals |= q_const;
+    } else if (is_keyword("volatile")) {
+      quals |= q_volatile;
+    } else if (is_keyword("restrict")) {
+      quals |= q_restrict;
+    } else {
+      return quals;
+    }
+    next();
+  }
+}
+
+qual_type parser::declarator(qual_type base, std::string_view &name,
+                             std::vector<parameter> *params) {
+  while (is('*')) {
+    next();
+    base = qual_type(m_types.pointer_to(base), type_qualifiers());
+  }
+  if (is(IDENTIFIER) || is(TYPEDEF_NAME)) {
+    name = m_tok.m_value;
+    next();
+  }
+  if (is('(')) {
+    next();
+    return parameter_list(base, params);
+  }
+  std::vector<uint64_t> bounds;
+  while (is('[')) {
+    next();
+    if (is(']')) {
+      bounds.push_back(type::k_unknown_bound);
+    } else {
+      int64_t bound = constant_expression();
+      if (bound < 0) {
+        error("Array size is negative");
+      }
+      bounds.push_back(bound);
+    }
+    expect(']', "']'");
+  }
+  for (auto it = bounds.rbegin(); it != bounds.rend(); ++it) {
+    base = m_types.array_of(base, *it);
+  }
+  return base;
+}
+
+qual_type parser::parameter_list(qual_type result,
+                                 std::vector<parameter> *declared) {
+  std::vector<qual_type> params;
+  if (is(')')) {
+    next();
+    return m_types.function(result, {}, true);
+  }
+  bool variadic = false;
+  while (true) {
+    if (is(ELLIPSIS)) {
+      next();
+      variadic = true;
+      break;
+    }
+    auto spec = declaration_specifiers();
+    if (!spec) {
+      error("Expected a parameter type");
+    }
+    std::string_view name;
+    qual_type type = declarator(spec->m_type, name);
+    if (type->m_kind == type_kind::void_ && name.empty() && params.empty() &&
+        is(')')) {
+      break;
+    }
+    if (type->m_kind == type_kind::array) {
+      type = m_types.pointer_to(type->m_base);
+    } else if (type->m_kind == type_kind::function) {
+      type = m_types.pointer_to(type);
+    }
+    params.push_back(type);
+    if (declared) {
+      declared->push_back({name, type});
+    }
+    if (!is(',')) {
+      break;
+    }
+    next();
+  }
+  expect(')', "')'");
+  return m_types.function(result, params, variadic);
+}
+
+qual_type parser::type_name() {
+  auto spec = declaration_specifiers();
+  if (!spec || spec->m_typedef || spec->m_extern || spec->m_static) {
+    error("Expected a type name");
+  }
+  std::string_view name;
+  qual_type type = declarator(spec->m_type, name);
+  if (!name.empty()) {
+    error("Unexpected name in type name");
+  }
+  return type;
+}
+
+parser::declaration &parser::declare(std::string_view name, storage kind,
+                                     qual_type type) {
+  symbol_kind sym_kind = kind == storage::type       ? symbol_kind::typedef_name
+                         : kind == storage::function ? symbol_kind::function
+                                                     : symbol_kind::object;
+  symbol_table::name_id id = m_symbols.intern(name);
+  if (m_symbols.declare(id, sym_kind, m_decls.size())) {
+    m_decls.push_back({kind, type, m_symbols.name(id)});
+    return m_decls.back();
+  }
+
+  declaration &prev = m_decls[m_symbols.lookup(id)->m_value];
+  bool objects = (prev.m_storage == storage::global ||
+                  prev.m_storage == storage::external) &&
+                 (kind == storage::global || kind == storage::external);
+  if (prev.m_storage != kind && !objects) {
+    error(std::format("Redeclaration of '{}'", name));
+  }
+  if (kind == storage::local) {
+    error(std::format("Redefinition of '{}'", name));
+  }
+  if (prev.m_type != type) {
+    // Types are hash-consed, so anything but an unprototyped declaration
+    // meeting a prototype is a real conflict.
+    bool prototype = kind == storage::function &&
+                     prev.m_type->m_base == type->m_base &&
+                     (is_unprototyped(prev.m_type.get()) ||
+                      is_unprototyped(type.get()));
+    if (!prototype) {
+      error(std::format("Conflicting types for '{}'", name));
+    }
+    if (is_unprototyped(prev.m_type.get())) {
+      prev.m_type = type;
+    }
+  }
+  if (kind == storage::global) {
+    prev.m_storage = storage::global;
+  }
+  return prev;
+}
+
+int64_t parser::constant_expression() {
+  conditional_expression();
+  auto value = m_gen->pop_constant();
+  if (!value) {
+    error("Expected a constant expression");
+  }
+  return *value;
+}
+
+void parser::external_declaration() {
+  auto spec = declaration_specifiers();
+  if (!spec) {
+    error(is(T_EOF) ? "Unexpected end of file"
+                    : std::format("Unexpected '{}'", spelling()));
+  }
+  if (is(';')) {
+    next();
+    return;
+  }
+  while (true) {
+    std::string_view name;
+    std::vector<parameter> params;
+    qual_type type = declarator(spec->m_type, name, &params);
+    if (name.empty()) {
+      error("Expected a declarator");
+    }
+    if (spec->m_typedef) {
+      declare(name, storage::type, type);
+    } else if (type->m_kind == type_kind::function) {
+      std::string_view stable = declare(name, storage::function, type).m_name;
+      if (is('{')) {
+        function_definition(stable, type, params, !spec->m_static);
+        return;
+      }
+    } else if (spec->m_extern) {
+      declare(name, storage::external, type);
+    } else {
+      std::string_view stable = declare(name, storage::global, type).m_name;
+      std::optional<int64_t> init;
+      if (is('=')) {
+        if (type->m_kind == type_kind::array) {
+          error("Array initializers are not supported");
+        }
+        next();
+        init = constant_expression();
+      }
+      if (!type->m_complete) {
+        error(std::format("Variable '{}' has incomplete type", name));
+      }
+      m_gen->global_variable(stable, type, !spec->m_static, init);
+    }
+    if (!is(',')) {
+      break;
+    }
+    next();
+  }
+  expect(';', "';'");
+}
+
+void parser::function_definition(std::string_view name, qual_type type,
+                                 const std::vector<parameter> &params,
+                                 bool global) {
+  m_gen->begin_function(name, global);
+  m_symbols.push_scope();
+  m_return_type = type->m_base;
+  for (size_t i = 0; i < type->m_params.size(); ++i) {
+    if (i >= params.size() || params[i].m_name.empty()) {
+      error("Parameter name omitted");
+    }
+    int32_t slot = m_gen->param(i, params[i].m_type);
+    declare(params[i].m_name, storage::local, params[i].m_type).m_slot = slot;
+  }
+  compound_statement(false);
+  m_gen->end_function();
+}
+
+void parser::local_declaration() {
+  auto spec = declaration_specifiers();
+  if (is(';')) {
+    next();
+    return;
+  }
+  while (true) {
+    std::string_view name;
+    qual_type type = declarator(spec->m_type, name);
+    if (name.empty()) {
+      error("Expected a declarator");
+    }
+    if (spec->m_typedef) {
+      declare(name, storage::type, type);
+    } else if (type->m_kind == type_kind::function) {
+      declare(name, storage::function, type);
+    } else if (spec->m_extern) {
+      declare(name, storage::external, type);
+    } else if (spec->m_static) {
+      error("Static local variables are not supported");
+    } else {
+      if (!type->m_complete) {
+        error(std::format("Variable '{}' has incomplete type", name));
+      }
+      int32_t slot = m_gen->local(type);
+      declare(name, storage::local, type).m_slot = slot;
+      if (is('=')) {
+        if (type->m_kind == type_kind::array) {
+          error("Array initializers are not supported");
+        }
+        next();
+        m_gen->push_local(slot, type);
+        rvalue(assignment_expression());
+        m_gen->assign();
+        m_gen->pop();
+      }
+    }
+    if (!is(',')) {
+      break;
+    }
+    next();
+  }
+  expect(';', "';'");
+}
+
+void parser::compound_statement(bool new_scope) {
+  if (new_scope) {
+    m_symbols.push_scope();
+  }
+  expect('{', "'{'");
+  while (!is('}')) {
+    if (is(T_EOF)) {
+      error("Expected '}'");
+    }
+    if (is_type_start()) {
+      local_declaration();
+    } else {
+      statement();
+    }
+  }
+  // The scope has to go before the next token is read, since that token
+  // may be a typedef name the scope shadowed.
+  m_symbols.pop_scope();
+  next();
+}
+
+// The body of a for statement reads the token after the loop while the
+// loop's declarations are still in scope, so that token may have been
+// taken for an identifier where a typedef name was only shadowed.
+void parser::reclassify() {
+  if (is(IDENTIFIER) || is(TYPEDEF_NAME)) {
+    m_tok.m_token_class = m_symbols.is_typedef_name(m_tok.m_value)
+                              ? TYPEDEF_NAME
+                              : IDENTIFIER;
+  }
+}
+
+void parser::statement() {
+  if (is('{')) {
+    compound_statement(true);
+  } else if (is(';')) {
+    next();
+  } else if (is_keyword("if")) {
+    if_statement();
+  } else if (is_keyword("while")) {
+    while_statement();
+  } else if (is_keyword("do")) {
+    do_statement();
+  } else if (is_keyword("for")) {
+    for_statement();
+  } else if (is_keyword("return")) {
+    next();
+    if (is(';')) {
+      m_gen->ret(false);
+    } else {
+      operand value = rvalue(expression());
+      if (m_return_type->m_kind == type_kind::void_) {
+        m_gen->pop();
+        m_gen->ret(false);
+      } else {
+        convert(value, m_return_type);
+        m_gen->ret(true);
+      }
+    }
+    expect(';', "';'");
+  } else if (is_keyword("break") || is_keyword("continue")) {
+    bool is_break = m_tok.m_value == "break";
+    if (m_loops.empty()) {
+      error(std::format("'{}' outside of a loop", m_tok.m_value));
+    }
+    next();
+    m_gen->jump(is_break ? m_loops.back().m_break
+                        : m_loops.back().m_continue);
+    expect(';', "';'");
+  } else if (is_keyword("switch") || is_keyword("goto") ||
+             is_keyword("case") || is_keyword("default")) {
+    error(std::format("'{}' is not supported", m_tok.m_value));
+  } else {
+    expression();
+    m_gen->pop();
+    expect(';', "';'");
+  }
+}
+
+void parser::if_statement() {
+  next();
+  expect('(', "'('");
+  rvalue(expression());
+  expect(')', "')'");
+  auto otherwise = m_gen->new_label();
+  m_gen->branch(false, otherwise);
+  statement();
+  if (is_keyword("else")) {
+    next();
+    auto end = m_gen->new_label();
+    m_gen->jump(end);
+    m_gen->place(otherwise);
+    statement();
+    m_gen->place(end);
+  } else {
+    m_gen->place(otherwise);
+  }
+}
+
+void parser::while_statement() {
+  next();
+  auto top = m_gen->new_label();
+  auto end = m_gen->new_label();
+  m_gen->place(top);
+  expect('(', "'('");
+  rvalue(expression());
+  expect(')', "')'");
+  m_gen->branch(false, end);
+  m_loops.push_back({end, top});
+  statement();
+  m_loops.pop_back();
+  m_gen->jump(top);
+  m_gen->place(end);
+}
+
+void parser::do_statement() {
+  next();
+  auto top = m_gen->new_label();
+  auto cont = m_gen->new_label();
+  auto end = m_gen->new_label();
+  m_gen->place(top);
+  m_loops.push_back({end, cont});
+  statement();
+  m_loops.pop_back();
+  if (!is_keyword("while")) {
+    error("Expected 'while'");
+  }
+  next();
+  m_gen->place(cont);
+  expect('(', "'('");
+  rvalue(expression());
+  expect(')', "')'");
+  m_gen->branch(true, top);
+  m_gen->place(end);
+  expect(';', "';'");
+}
+
+// The increment is parsed before the body but has to run after it, so it
+// is emitted out of line: top: cond; jmp body; inc: ...; jmp top; body: ...
+void parser::for_statement() {
+  next();
+  expect('(', "'('");
+  m_symbols.push_scope();
+  if (is_type_start()) {
+    local_declaration();
+  } else {
+    if (!is(';')) {
+      expression();
+      m_gen->pop();
+    }
+    expect(';', "';'");
+  }
+  auto top = m_gen->new_label();
+  auto body = m_gen->new_label();
+  auto inc = m_gen->new_label();
+  auto end = m_gen->new_label();
+  m_gen->place(top);
+  if (!is(';')) {
+    rvalue(expression());
+    m_gen->branch(false, end);
+  }
+  expect(';', "';'");
+  m_gen->jump(body);
+  m_gen->place(inc);
+  if (!is(')')) {
+    expression();
+    m_gen->pop();
+  }
+  expect(')', "')'");
+  m_gen->jump(top);
+  m_gen->place(body);
+  m_loops.push_back({end, inc});
+  statement();
+  m_loops.pop_back();
+  m_gen->jump(inc);
+  m_gen->place(end);
+  m_symbols.pop_scope();
+  reclassify();
+}
+
+parser::operand parser::expression() {
+  operand result = assignment_expression();
+  while (is(',')) {
+    next();
+    m_gen->pop();
+    result = assignment_expression();
+  }
+  return result;
+}
+
+parser::operand parser::assignment_expression() {
+  operand lhs = conditional_expression();
+  int op = is('=') ? '=' : compound_operator(m_tok.m_token_class);
+  if (op == 0) {
+    return lhs;
+  }
+  if (!lhs.m_lvalue || lhs.m_type->m_kind == type_kind::array ||
+      lhs.m_type.is_const()) {
+    error("Expression is not assignable");
+  }
+  next();
+  if (op == '=') {
+    rvalue(assignment_expression());
+  } else {
+    m_gen->dup();
+    operand current{lhs.m_type};
+    apply_binary(op, current, rvalue(assignment_expression()));
+  }
+  m_gen->assign();
+  return {lhs.m_type};
+}
+
+template <typename F> parser::operand parser::unevaluated(F parse) {
+  discarding_generator discard;
+  generator *gen = std::exchange(m_gen, &discard);
+  try {
+    operand o = parse();
+    m_gen = gen;
+    return o;
+  } catch (...) {
+    m_gen = gen;
+    throw;
+  }
+}
+
+// A constant condition selects its arm while parsing, so that the result
+// can itself be constant. Otherwise both arms store into one 64-bit slot,
+// which is read back at the type of the result once both are known.
+parser::operand parser::conditional_expression() {
+  operand cond = logical_expression(OR_OP);
+  if (!is('?')) {
+    return cond;
+  }
+  next();
+  rvalue(cond);
+  auto result_type = [&](operand a, operand b) {
+    if (is_pointer(a.m_type)) {
+      return a.m_type;
+    }
+    if (is_pointer(b.m_type)) {
+      return b.m_type;
+    }
+    if (a.m_type->m_kind == type_kind::void_ ||
+        b.m_type->m_kind == type_kind::void_) {
+      return builtin(type_kind::void_);
+    }
+    return arithmetic_result(a, b);
+  };
+
+  if (auto value = m_gen->pop_constant()) {
+    auto arm = [&](bool taken, auto parse) {
+      return taken ? rvalue(parse()) : unevaluated([&] {
+        return rvalue(parse());
+      });
+    };
+    operand a = arm(*value != 0, [&] { return expression(); });
+    expect(':', "':'");
+    operand b = arm(*value == 0, [&] { return conditional_expression(); });
+    qual_type result = result_type(a, b);
+    if (result->m_kind == type_kind::void_) {
+      m_gen->pop();
+      m_gen->push_int(0, result);
+    } else {
+      m_gen->cast(result);
+    }
+    return {result};
+  }
+
+  qual_type slot_type = builtin(type_kind::long_);
+  int32_t slot = m_gen->local(slot_type);
+  auto otherwise = m_gen->new_label();
+  auto end = m_gen->new_label();
+  auto store = [&](operand arm) {
+    if (arm.m_type->m_kind == type_kind::void_) {
+      m_gen->pop();
+      return;
+    }
+    m_gen->push_local(slot, slot_type);
+    m_gen->swap();
+    m_gen->assign();
+    m_gen->pop();
+  };
+
+  m_gen->branch(false, otherwise);
+  operand a = rvalue(expression());
+  store(a);
+  m_gen->jump(end);
+  expect(':', "':'");
+  m_gen->place(otherwise);
+  operand b = rvalue(conditional_expression());
+  store(b);
+  m_gen->place(end);
+
+  qual_type result = result_type(a, b);
+  if (result->m_kind == type_kind::void_) {
+    m_gen->push_int(0, result);
+  } else {
+    m_gen->push_local(slot, result);
+  }
+  return {result};
+}
+
+// Leading constant operands are folded: one that decides the result leaves
+// the rest unevaluated, and the others drop out. From the first operand
+// that is not constant on, `a && b` and `a || b` store the short-circuit
+// result into a slot first and overwrite it only if every operand is
+// evaluated.
+parser::operand parser::logical_expression(int op) {
+  auto operand_expression = [&] {
+    return op == OR_OP ? logical_expression(AND_OP) : binary_expression(1);
+  };
+  operand lhs = operand_expression();
+  if (!is(op)) {
+    return lhs;
+  }
+  bool is_and = op == AND_OP;
+  qual_type int_type = builtin(type_kind::int_);
+  rvalue(lhs);
+  while (auto value = m_gen->pop_constant()) {
+    if ((*value != 0) != is_and) {
+      while (is(op)) {
+        next();
+        unevaluated([&] { return rvalue(operand_expression()); });
+      }
+      m_gen->push_int(is_and ? 0 : 1, int_type);
+      return {int_type};
+    }
+    if (!is(op)) {
+      m_gen->push_int(is_and ? 1 : 0, int_type);
+      return {int_type};
+    }
+    next();
+    rvalue(operand_expression());
+  }
+
+  int32_t slot = m_gen->local(int_type);
+  auto done = m_gen->new_label();
+  m_gen->push_local(slot, int_type);
+  m_gen->push_int(is_and ? 0 : 1, int_type);
+  m_gen->assign();
+  m_gen->pop();
+  m_gen->branch(!is_and, done);
+  while (is(op)) {
+    next();
+    rvalue(operand_expression());
+    m_gen->branch(!is_and, done);
+  }
+  m_gen->push_local(slot, int_type);
+  m_gen->push_int(is_and ? 1 : 0, int_type);
+  m_gen->assign();
+  m_gen->pop();
+  m_gen->place(done);
+  m_gen->push_local(slot, int_type);
+  return {int_type};
+}
+
+parser::operand parser::binary_expression(int min_precedence) {
+  operand lhs = unary_expression();
+  while (true) {
+    int op = m_tok.m_token_class;
+    int prec = precedence(op);
+    if (prec == 0 || prec < min_precedence) {
+      return lhs;
+    }
+    next();
+    lhs = rvalue(lhs);
+    operand rhs = rvalue(binary_expression(prec + 1));
+    lhs = apply_binary(op, lhs, rhs);
+  }
+}
+
+parser::operand parser::unary_expression() {
+  int op = m_tok.m_token_class;
+  if (op == INC_OP || op == DEC_OP) {
+    next();
+    operand target = unary_expression();
+    if (!target.m_lvalue || target.m_type.is_const()) {
+      error("Expression is not assignable");
+    }
+    m_gen->dup();
+    m_gen->push_int(1, builtin(type_kind::int_));
+    apply_binary(op == INC_OP ? '+' : '-', {target.m_type},
+                 {builtin(type_kind::int_)});
+    m_gen->assign();
+    return {target.m_type};
+  }
+  if (op == '-' || op == '+' || op == '~' || op == '!') {
+    next();
+    operand value = rvalue(unary_expression());
+    if (op == '!') {
+      m_gen->unary('!', builtin(type_kind::int_));
+      return {builtin(type_kind::int_)};
+    }
+    qual_type type = arithmetic_result(value, value);
+    if (op != '+') {
+      m_gen->unary(op, type);
+    }
+    return {type};
+  }
+  if (op == '*') {
+    next();
+    operand value = rvalue(unary_expression());
+    if (!is_pointer(value.m_type)) {
+      error("Dereferencing a non-pointer");
+    }
+    qual_type pointee = value.m_type->m_base;
+    if (!pointee->m_complete && pointee->m_kind != type_kind::array) {
+      error("Dereferencing a pointer to an incomplete type");
+    }
+    m_gen->deref(pointee);
+    return {pointee, true};
+  }
+  if (op == '&') {
+    next();
+    operand value = unary_expression();
+    qual_type type = m_types.pointer_to(value.m_type);
+    if (value.m_type->m_kind == type_kind::function) {
+      return {type};
+    }
+    if (!value.m_lvalue) {
+      error("Cannot take the address of an rvalue");
+    }
+    m_gen->address(type);
+    return {type};
+  }
+  if (is_keyword("sizeof")) {
+    next();
+    if (!is('(')) {
+      error("sizeof of an expression is not supported");
+    }
+    next();
+    if (!is_type_start()) {
+      error("sizeof of an expression is not supported");
+    }
+    qual_type type = type_name();
+    expect(')', "')'");
+    if (!type->m_complete) {
+      error("sizeof of an incomplete type");
+    }
+    m_gen->push_int(type->m_size, builtin(type_kind::long_));
+    return {builtin(type_kind::long_)};
+  }
+  if (op == '(') {
+    next();
+    if (is_type_start()) {
+      qual_type type = type_name();
+      expect(')', "')'");
+      operand value = rvalue(unary_expression());
+      convert(value, type);
+      m_gen->cast(type);
+      return {type};
+    }
+    operand value = expression();
+    expect(')', "')'");
+    return postfix_expression(value);
+  }
+  return postfix_expression(primary_expression());
+}
+
+parser::operand parser::postfix_expression(operand value) {
+  while (true) {
+    if (is('[')) {
+      next();
+      operand base = rvalue(value);
+      operand index = rvalue(expression());
+      expect(']', "']'");
+      operand address = apply_binary('+', base, index);
+      if (!is_pointer(address.m_type)) {
+        error("Subscripted value is not a pointer");
+      }
+      qual_type element = address.m_type->m_base;
+      m_gen->deref(element);
+      value = {element, true};
+    } else if (is('(')) {
+      if (value.m_type->m_kind != type_kind::function) {
+        error(is_pointer(value.m_type)
+                  ? "Indirect calls are not supported"
+                  : "Called object is not a function");
+      }
+      next();
+      value = call(value.m_type.get());
+    } else if (is(INC_OP) || is(DEC_OP)) {
+      bool inc = is(INC_OP);
+      if (!value.m_lvalue || value.m_type.is_const()) {
+        error("Expression is not assignable");
+      }
+      next();
+      // x++ is computed as (x += 1) - 1, cast back to the type of x so that
+      // an increment that wrapped still yields the old value.
+      qual_type type = value.m_type;
+      qual_type int_type = builtin(type_kind::int_);
+      m_gen->dup();
+      m_gen->push_int(1, int_type);
+      apply_binary(inc ? '+' : '-', {type}, {int_type});
+      m_gen->assign();
+      m_gen->push_int(1, int_type);
+      value = apply_binary(inc ? '-' : '+', {type}, {int_type});
+      if (type->is_integer() && type->m_size < value.m_type->m_size) {
+        m_gen->cast(type);
+        value = {type};
+      }
+    } else {
+      return value;
+    }
+  }
+}
+
+parser::operand parser::call(const type *function) {
+  auto params = function->m_params;
+  unsigned argc = 0;
+  if (!is(')')) {
+    while (true) {
+      operand arg = rvalue(assignment_expression());
+      if (argc < params.size()) {
+        convert(arg, params[argc]);
+      }
+      ++argc;
+      if (!is(',')) {
+        break;
+      }
+      next();
+    }
+  }
+  expect(')', "')'");
+  if (argc < params.size() || (!function->m_variadic && argc > params.size())) {
+    error(std::format("Expected {} arguments, got {}", params.size(), argc));
+  }
+  m_gen->call(argc, function->m_base);
+  return {function->m_base};
+}
+
+parser::operand parser::primary_expression() {
+  switch (m_tok.m_token_class) {
+  case IDENTIFIER:
+    return identifier();
+  case INT_CONSTANT:
+  case OCT_CONSTANT:
+  case HEX_CONSTANT:
+  case BIN_CONSTANT:
+    return integer_constant();
+  case CHAR_CONSTANT: {
+    std::string_view text = m_tok.m_value;
+    if (text.front() != '\'') {
+      error("Wide character constants are not supported");
+    }
+    const char *p = text.data() + 1;
+    const char *end = text.data() + text.size() - 1;
+    char c = *p == '\\' ? (++p, decode_escape(p, end)) : *p++;
+    if (p != end) {
+      error("Multi-character constants are not supported");
+    }
+    m_gen->push_int(c, builtin(type_kind::int_));
+    next();
+    return {builtin(type_kind::int_)};
+  }
+  case STRING_LITERAL:
+    return string_literal();
+  case FLOAT_CONSTANT:
+    error("Floating point is not supported");
+  case T_EOF:
+    error("Unexpected end of file");
+  default:
+    error(std::format("Unexpected '{}'", spelling()));
+  }
+}
+
+parser::operand parser::identifier() {
+  std::string_view name = m_tok.m_value;
+  symbol_table::name_id id = m_symbols.find(name);
+  const symbol *sym =
+      id == symbol_table::k_no_name ? nullptr : m_symbols.lookup(id);
+  if (!sym) {
+    // Only known once the next token is in, which moves the location on.
+    std::string where = m_lexer.location(m_tok);
+    next();
+    if (!is('(')) {
+      throw std::runtime_error(
+          std::format("Undeclared identifier '{}' at {}", name, where));
+    }
+    // An implicit declaration, as C89 has it: int name().
+    qual_type type =
+        m_types.function(builtin(type_kind::int_), {}, true);
+    m_gen->push_function(declare(name, storage::function, type).m_name, type);
+    return {type};
+  }
+  declaration decl = m_decls[sym->m_value];
+  next();
+  switch (decl.m_storage) {
+  case storage::local:
+    m_gen->push_local(decl.m_slot, decl.m_type);
+    return {decl.m_type, true};
+  case storage::global:
+  case storage::external:
+    m_gen->push_global(decl.m_name, decl.m_type,
+                      decl.m_storage == storage::external);
+    return {decl.m_type, true};
+  case storage::function:
+    m_gen->push_function(decl.m_name, decl.m_type);
+    return {decl.m_type};
+  default:
+    error(std::format("Unexpected type name '{}'", name));
+  }
+}
+
+parser::operand parser::integer_constant() {
+  std::string_view text = m_tok.m_value;
+  int base = 10;
+  if (is(HEX_CONSTANT) || is(BIN_CONSTANT)) {
+    base = is(HEX_CONSTANT) ? 16 : 2;
+    text.remove_prefix(2);
+  } else if (is(OCT_CONSTANT)) {
+    base = 8;
+  }
+  bool is_long = false;
+  while (!text.empty() && std::strchr("uUlL", text.back())) {
+    is_long |= (text.back() | 0x20) == 'l';
+    text.remove_suffix(1);
+  }
+  uint64_t value;
+  auto [end, ec] =
+      std::from_chars(text.data(), text.data() + text.size(), value, base);
+  if (ec != std::errc() || end != text.data() + text.size()) {
+    error("Invalid integer constant");
+  }
+  qual_type type =
+      builtin(is_long || value > INT32_MAX ? type_kind::long_ : type_kind::int_);
+  m_gen->push_int(static_cast<int64_t>(value), type);
+  next();
+  return {type};
+}
+
+parser::operand parser::string_literal() {
+  std::string bytes;
+  while (is(STRING_LITERAL)) {
+    std::string_view text = m_tok.m_value;
+    if (text.front() != '"') {
+      error("Wide string literals are not supported");
+    }
+    const char *p = text.data() + 1;
+    const char *end = text.data() + text.size() - 1;
+    while (p < end) {
+      if (*p == '\\') {
+        ++p;
+        bytes.push_back(decode_escape(p, end));
+      } else {
+        bytes.push_back(*p++);
+      }
+    }
+    next();
+  }
+  qual_type type = m_types.pointer_to(builtin(type_kind::char_));
+  m_gen->push_string(bytes, type);
+  return {type};
+}
+
+parser::operand parser::rvalue(operand o) {
+  if (o.m_type->m_kind == type_kind::array) {
+    qual_type type = m_types.pointer_to(o.m_type->m_base);
+    m_gen->address(type);
+    return {type};
+  }
+  if (o.m_type->m_kind == type_kind::function) {
+    return {m_types.pointer_to(o.m_type)};
+  }
+  return {o.m_type};
+}
+
+parser::operand parser::apply_binary(int op, operand lhs, operand rhs) {
+  bool lp = is_pointer(lhs.m_type);
+  bool rp = is_pointer(rhs.m_type);
+  qual_type long_type = builtin(type_kind::long_);
+  auto scale = [&](qual_type pointer) {
+    const type *pointee = pointer->m_base.get();
+    uint64_t size = pointee->m_complete ? pointee->m_size : 1;
+    if (size != 1) {
+      m_gen->push_int(size, long_type);
+      m_gen->binary('*', long_type);
+    }
+  };
+
+  if (op == EQ_OP || op == NE_OP || op == '<' || op == '>' || op == LE_OP ||
+      op == GE_OP) {
+    m_gen->binary(op, builtin(type_kind::int_));
+    return {builtin(type_kind::int_)};
+  }
+  if (op == LEFT_OP || op == RIGHT_OP) {
+    // The type is that of the promoted left operand alone.
+    if (!lhs.m_type->is_integer() || !rhs.m_type->is_integer()) {
+      error("Invalid operands to a shift");
+    }
+    qual_type type = builtin(lhs.m_type->m_size == 8 ? type_kind::long_
+                                                     : type_kind::int_);
+    m_gen->binary(op, type);
+    return {type};
+  }
+  if (op == '+' && (lp || rp)) {
+    if (lp && rp) {
+      error("Invalid operands to '+'");
+    }
+    if (rp) {
+      m_gen->swap();
+      std::swap(lhs, rhs);
+    }
+    scale(lhs.m_type);
+    m_gen->binary('+', lhs.m_type);
+    return {lhs.m_type};
+  }
+  if (op == '-' && lp) {
+    if (rp) {
+      const type *pointee = lhs.m_type->m_base.get();
+      m_gen->binary('-', long_type);
+      m_gen->push_int(pointee->m_complete ? pointee->m_size : 1, long_type);
+      m_gen->binary('/', long_type);
+      return {long_type};
+    }
+    scale(lhs.m_type);
+    m_gen->binary('-', lhs.m_type);
+    return {lhs.m_type};
+  }
+  if (lp || rp) {
+    error(std::format("Invalid operands to '{}'", static_cast<char>(op)));
+  }
+  qual_type type = arithmetic_result(lhs, rhs);
+  m_gen->binary(op, type);
+  return {type};
+}
+
+void parser::convert(operand from, qual_type to) {
+  if (from.m_type->is_arithmetic() && to->is_arithmetic() &&
+      from.m_type->m_size != to->m_size) {
+    m_gen->cast(to);
+  }
+}
+
+qual_type parser::arithmetic_result(operand a, operand b) const {
+  if (!a.m_type->is_arithmetic() || !b.m_type->is_arithmetic()) {
+    error("Invalid operands to an arithmetic operator");
+  }
+  return builtin(a.m_type->m_size == 8 || b.m_type->m_size == 8
+                     ? type_kind::long_
+                     : type_kind::int_);
+}
+} // namespace cc
@@ -0,0 +1,138 @@
+#ifndef CPPPROJECT_PARSER_H
+#define CPPPROJECT_PARSER_H
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "generator.h"
+#include "lexer.h"
+#include "symbol_table.h"
+#include "types.h"
+
+namespace cc {
+// Recursive-descent parser for a subset of C that generates code as it
+// goes, with no syntax tree in between. The subset covers void, char,
+// short, int, long and pointer and array types; typedefs; functions with up
+// to six parameters; locals and file-scope objects; the usual expression
+// operators, shifts included; and if, while, do, for, break, continue and
+// return.
+class parser {
+public:
+  parser(lexer &lex, symbol_table &symbols, type_context &types,
+         generator &gen);
+
+  void parse_translation_unit();
+
+private:
+  enum class storage : uint8_t { local, global, external, function, type };
+
+  struct declaration {
+    storage m_storage;
+    qual_type m_type;
+    std::string_view m_name;
+    int32_t m_slot = 0;
+  };
+
+  // The value of an expression is on the code generator's stack; this is
+  // what the parser knows about it.
+  struct operand {
+    qual_type m_type;
+    bool m_lvalue = false;
+  };
+
+  struct specifiers {
+    qual_type m_type;
+    bool m_typedef = false;
+    bool m_extern = false;
+    bool m_static = false;
+  };
+
+  // A parameter as declared, qualifiers included.
+  struct parameter {
+    std::string_view m_name;
+    qual_type m_type;
+  };
+
+  struct loop {
+    generator::label m_break;
+    generator::label m_continue;
+  };
+
+  [[noreturn]] void error(std::string_view message) const;
+  void next() { m_tok = m_lexer.get_next_token(); }
+  bool is(int token_class) const { return m_tok.m_token_class == token_class; }
+  bool is_keyword(std::string_view keyword) const {
+    return is(KEYWORD) && m_tok.m_value == keyword;
+  }
+  void expect(int token_class, std::string_view what);
+  std::string spelling() const;
+  bool is_type_start() const;
+  // Looks the current token up again after a scope was popped.
+  void reclassify();
+
+  // Declarations.
+  void external_declaration();
+  void function_definition(std::string_view name, qual_type type,
+                           const std::vector<parameter> &params,
+                           bool global);
+  void local_declaration();
+  std::optional<specifiers> declaration_specifiers();
+  unsigned type_qualifiers();
+  // Parses a declarator around `base`. Abstract declarators leave `name`
+  // empty; `params` receives the parameters when it is a function.
+  qual_type declarator(qual_type base, std::string_view &name,
+                       std::vector<parameter> *params = nullptr);
+  qual_type parameter_list(qual_type result,
+                           std::vector<parameter> *declared);
+  qual_type type_name();
+  declaration &declare(std::string_view name, storage kind, qual_type type);
+  int64_t constant_expression();
+
+  // Statements.
+  void compound_statement(bool new_scope);
+  void statement();
+  void if_statement();
+  void while_statement();
+  void do_statement();
+  void for_statement();
+
+  // Expressions.
+  operand expression();
+  operand assignment_expression();
+  operand conditional_expression();
+  operand logical_expression(int op);
+  operand binary_expression(int min_precedence);
+  operand unary_expression();
+  operand postfix_expression(operand value);
+  operand primary_expression();
+  operand call(const type *function);
+  operand identifier();
+  operand integer_constant();
+  operand string_literal();
+
+  // Parses an operand that is never evaluated, such as the arm a constant
+  // condition does not take, checking it without generating code.
+  template <typename F> operand unevaluated(F parse);
+
+  operand rvalue(operand o);
+  operand apply_binary(int op, operand lhs, operand rhs);
+  void convert(operand from, qual_type to);
+  qual_type builtin(type_kind kind) const { return m_types.builtin(kind); }
+  qual_type arithmetic_result(operand a, operand b) const;
+
+  lexer &m_lexer;
+  symbol_table &m_symbols;
+  type_context &m_types;
+  // Points elsewhere while unevaluated operands are parsed.
+  generator *m_gen;
+  token m_tok;
+
+  std::vector<declaration> m_decls;
+  std::vector<loop> m_loops;
+  qual_type m_return_type;
+};
+} // namespace cc
+
+#endif // CPPPROJECT_PARSER_H
@@ -0,0 +1,471 @@
+#include "regalloc.h"
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+
+namespace cc::x86_64 {
+namespace {
+using ir::opcode;
+using ir::ref;
+
+constexpr uint32_t k_never = std::numeric_limits<uint32_t>::max();
+
+bool is_comparison(opcode op) { return op >= opcode::eq && op <= opcode::uge; }
+
+class allocator {
+public:
+  allocator(const ir::function &fn, allocation &out) : m_fn(fn), m_out(out) {}
+
+  void run();
+
+private:
+  void count_uses();
+  void fuse_comparisons();
+  void number_uses();
+  void weigh_uses();
+  void build_intervals();
+  void live_in(ref v, uint32_t block);
+  void scan();
+  void assign_spill_slots();
+
+  bool has_interval(ref n) const;
+  uint32_t def_position(ref n) const;
+  bool at_block_start(uint32_t pos) const;
+  double weight(uint32_t piece, uint32_t from) const;
+  uint32_t split(uint32_t piece, uint32_t pos);
+  void spill(uint32_t piece);
+  void assign(uint32_t piece, reg r);
+  bool allocate_free(uint32_t piece);
+  void allocate_blocked(uint32_t piece);
+
+  const ir::function &m_fn;
+  allocation &m_out;
+  std::vector<uint32_t> m_use_count;
+  // Read positions of each value, sorted:
+  // m_use_pos[m_use_begin[v], m_use_begin[v + 1]).
+  std::vector<uint32_t> m_use_begin;
+  std::vector<uint32_t> m_use_pos;
+  // Prefix sums of the loop weight of m_use_pos.
+  std::vector<double> m_use_weight;
+  std::vector<uint32_t> m_loop_depth;
+  // A phi each value flows into, whose register it would rather share.
+  std::vector<ref> m_hint;
+  std::vector<uint32_t> m_calls;
+  std::vector<ref> m_visited;
+  std::vector<uint32_t> m_worklist;
+  std::vector<std::pair<uint32_t, ref>> m_live_pairs;
+
+  using entry = std::pair<uint32_t, uint32_t>;
+  std::priority_queue<entry, std::vector<entry>, std::greater<>> m_unhandled;
+  uint32_t m_occupant[16];
+  // The first call at or after the current position.
+  uint32_t m_next_call = 0;
+};
+
+bool allocator::has_interval(ref n) const {
+  return m_use_count[n] != 0 && m_fn.m_insts[n].m_op != opcode::constant &&
+         !m_out.m_fused[n];
+}
+
+uint32_t allocator::def_position(ref n) const {
+  const ir::inst &i = m_fn.m_insts[n];
+  if (i.m_op == opcode::param) {
+    return 0;
+  }
+  if (i.m_op == opcode::phi) {
+    return 2 * m_fn.m_blocks[i.m_block].m_first;
+  }
+  return 2 * n + 1;
+}
+
+bool allocator::at_block_start(uint32_t pos) const {
+  ref n = pos / 2;
+  return pos % 2 == 0 && m_fn.m_blocks[m_fn.m_insts[n].m_block].m_first == n;
+}
+
+void allocator::count_uses() {
+  m_use_count.assign(m_fn.m_insts.size(), 0);
+  for (const ir::inst &i : m_fn.m_insts) {
+    for_each_operand(m_fn, i, [&](ref r) { ++m_use_count[r]; });
+  }
+}
+
+void allocator::fuse_comparisons() {
+  m_out.m_fused.assign(m_fn.m_insts.size(), false);
+  for (const ir::block &b : m_fn.m_blocks) {
+    ref t = b.m_end - 1;
+    const ir::inst &branch = m_fn.m_insts[t];
+    if (branch.m_op == opcode::branch && t > b.m_first &&
+        branch.m_a == t - 1 && is_comparison(m_fn.m_insts[t - 1].m_op) &&
+        m_use_count[t - 1] == 1) {
+      m_out.m_fused[t - 1] = true;
+    }
+  }
+}
+
+void allocator::number_uses() {
+  size_t n_insts = m_fn.m_insts.size();
+  m_use_begin.assign(n_insts + 1, 0);
+  for (ref n = 0; n < n_insts; ++n) {
+    m_use_begin[n + 1] =
+        m_use_begin[n] + (has_interval(n) ? m_use_count[n] : 0);
+  }
+  m_use_pos.resize(m_use_begin[n_insts]);
+  std::vector<uint32_t> fill(m_use_begin.begin(), m_use_begin.end() - 1);
+  auto add = [&](ref v, uint32_t pos) {
+    if (has_interval(v)) {
+      m_use_pos[fill[v]++] = pos;
+    }
+  };
+  m_hint.assign(n_insts, ir::k_no_ref);
+  for (ref n = 0; n < n_insts; ++n) {
+    const ir::inst &i = m_fn.m_insts[n];
+    if (i.m_op == opcode::phi) {
+      auto preds = m_fn.preds(i.m_block);
+      auto args = m_fn.operands(i);
+      for (size_t k = 0; k < args.size(); ++k) {
+        add(args[k], 2 * (m_fn.m_blocks[preds[k]].m_end - 1));
+        m_hint[args[k]] = n;
+      }
+    } else {
+      for_each_operand(m_fn, i, [&](ref r) { add(r, 2 * n); });
+    }
+  }
+  for (ref n = 0; n < n_insts; ++n) {
+    std::sort(m_use_pos.begin() + m_use_begin[n],
+              m_use_pos.begin() + m_use_begin[n + 1]);
+  }
+}
+
+// Uses inside loops weigh more. A block is in a loop if a later block jumps
+// back to or above it, which is how the parser lays out every loop.
+void allocator::weigh_uses() {
+  size_t n_blocks = m_fn.m_blocks.size();
+  std::vector<int32_t> delta(n_blocks + 1, 0);
+  for (uint32_t b = 0; b < n_blocks; ++b) {
+    ir::for_each_successor(m_fn, b, [&](uint32_t s) {
+      if (s <= b) {
+        ++delta[s];
+        --delta[b + 1];
+      }
+    });
+  }
+  m_loop_depth.resize(n_blocks);
+  int32_t depth = 0;
+  for (uint32_t b = 0; b < n_blocks; ++b) {
+    depth += delta[b];
+    m_loop_depth[b] = depth;
+  }
+  m_use_weight.assign(m_use_pos.size() + 1, 0);
+  for (size_t k = 0; k < m_use_pos.size(); ++k) {
+    uint32_t block = m_fn.m_insts[m_use_pos[k] / 2].m_block;
+    uint32_t d = std::min(m_loop_depth[block], 9u);
+    m_use_weight[k + 1] = m_use_weight[k] + static_cast<double>(1u << (3 * d));
+  }
+}
+
+// Marks `v` live into `block` and, through the predecessors, every block
+// on the way back to its definition (Boissinot et al., path exploration).
+void allocator::live_in(ref v, uint32_t block) {
+  interval &piece = m_out.m_intervals[m_out.m_first[v]];
+  uint32_t def_block = m_fn.m_insts[v].m_block;
+  m_worklist.push_back(block);
+  while (!m_worklist.empty()) {
+    uint32_t b = m_worklist.back();
+    m_worklist.pop_back();
+    if (m_visited[b] == v) {
+      continue;
+    }
+    m_visited[b] = v;
+    m_live_pairs.emplace_back(b, v);
+    piece.m_start = std::min(piece.m_start, 2 * m_fn.m_blocks[b].m_first);
+    for (uint32_t p : m_fn.preds(b)) {
+      piece.m_end = std::max(piece.m_end, 2 * m_fn.m_blocks[p].m_end);
+      if (p != def_block) {
+        m_worklist.push_back(p);
+      }
+    }
+  }
+}
+
+void allocator::build_intervals() {
+  size_t n_insts = m_fn.m_insts.size();
+  size_t n_blocks = m_fn.m_blocks.size();
+  m_out.m_first.assign(n_insts, k_no_interval);
+  m_out.m_spill_slot.assign(n_insts, k_no_interval);
+  m_visited.assign(n_blocks, ir::k_no_ref);
+  for (ref v = 0; v < n_insts; ++v) {
+    if (!has_interval(v)) {
+      continue;
+    }
+    uint32_t def = def_position(v);
+    m_out.m_first[v] = m_out.m_intervals.size();
+    m_out.m_intervals.push_back({def, def + 1, v});
+    uint32_t def_block = m_fn.m_insts[v].m_block;
+    for (uint32_t k = m_use_begin[v]; k < m_use_begin[v + 1]; ++k) {
+      uint32_t pos = m_use_pos[k];
+      const ir::inst &user = m_fn.m_insts[pos / 2];
+      // A terminator's position also stands for the edges leaving its
+      // block, where phi operands are read.
+      uint32_t end = pos + (ir::is_terminator(user.m_op) ? 2 : 1);
+      interval &piece = m_out.m_intervals.back();
+      piece.m_end = std::max(piece.m_end, end);
+      if (user.m_block != def_block) {
+        live_in(v, user.m_block);
+      }
+    }
+    m_unhandled.emplace(m_out.m_intervals.back().m_start, m_out.m_first[v]);
+  }
+
+  m_out.m_live_in_begin.assign(n_blocks + 1, 0);
+  for (auto [b, v] : m_live_pairs) {
+    ++m_out.m_live_in_begin[b + 1];
+  }
+  for (size_t b = 0; b < n_blocks; ++b) {
+    m_out.m_live_in_begin[b + 1] += m_out.m_live_in_begin[b];
+  }
+  m_out.m_live_in.resize(m_live_pairs.size());
+  std::vector<uint32_t> fill(m_out.m_live_in_begin.begin(),
+                             m_out.m_live_in_begin.end() - 1);
+  for (auto [b, v] : m_live_pairs) {
+    m_out.m_live_in[fill[b]++] = v;
+  }
+
+  for (ref n = 0; n < n_insts; ++n) {
+    if (m_fn.m_insts[n].m_op == opcode::call) {
+      m_calls.push_back(2 * n);
+    }
+  }
+}
+
+// Uses from `from` on, per position the piece still covers.
+double allocator::weight(uint32_t piece, uint32_t from) const {
+  const interval &p = m_out.m_intervals[piece];
+  auto first = m_use_pos.begin() + m_use_begin[p.m_value];
+  auto last = m_use_pos.begin() + m_use_begin[p.m_value + 1];
+  auto lo = std::lower_bound(first, last, from);
+  auto hi = std::lower_bound(lo, last, p.m_end);
+  double uses = m_use_weight[hi - m_use_pos.begin()] -
+                m_use_weight[lo - m_use_pos.begin()];
+  return uses / (p.m_end - from);
+}
+
+// Cuts `piece` at `pos` and returns the second half, which starts out in
+// memory. If `pos` is the start of the piece, the whole piece is returned.
+uint32_t allocator::split(uint32_t piece, uint32_t pos) {
+  if (pos <= m_out.m_intervals[piece].m_start) {
+    return piece;
+  }
+  interval rest = m_out.m_intervals[piece];
+  rest.m_start = pos;
+  rest.m_reg = k_spilled;
+  auto index = static_cast<uint32_t>(m_out.m_intervals.size());
+  m_out.m_intervals[piece].m_end = pos;
+  m_out.m_intervals[piece].m_next = index;
+  m_out.m_intervals.push_back(rest);
+  if (!at_block_start(pos)) {
+    m_out.m_splits.emplace_back(pos, rest.m_value);
+  }
+  return index;
+}
+
+// Leaves `piece` in memory up to its next use, from where the rest competes
+// for a register again.
+void allocator::spill(uint32_t piece) {
+  interval &p = m_out.m_intervals[piece];
+  p.m_reg = k_spilled;
+  ref v = p.m_value;
+  auto first = m_use_pos.begin() + m_use_begin[v];
+  auto last = m_use_pos.begin() + m_use_begin[v + 1];
+  auto next = std::upper_bound(first, last, p.m_start);
+  if (next != last && *next < p.m_end) {
+    uint32_t rest = split(piece, *next);
+    m_unhandled.emplace(*next, rest);
+  }
+}
+
+void allocator::assign(uint32_t piece, reg r) {
+  m_out.m_intervals[piece].m_reg = r;
+  m_occupant[r] = piece;
+  if (is_callee_saved(r)) {
+    m_out.m_callee_saved |= 1u << r;
+  }
+}
+
+// Takes a free register for as much of the piece as it can. Caller-saved
+// registers come first and are only free up to the next call.
+bool allocator::allocate_free(uint32_t piece) {
+  const interval &p = m_out.m_intervals[piece];
+  bool crosses = m_next_call < m_calls.size() &&
+                 p.m_end >= m_calls[m_next_call] + 2;
+  uint32_t call = crosses ? m_calls[m_next_call] : k_never;
+  // The argument's register saves a move on entry, and the register of the
+  // phi a value flows into saves one on the edge.
+  reg hint = rax;
+  const ir::inst &def = m_fn.m_insts[p.m_value];
+  ref phi = m_hint[p.m_value];
+  if (def.m_op == opcode::param) {
+    constexpr reg k_arg_regs[] = {rdi, rsi, rdx, rcx, r8, r9};
+    hint = k_arg_regs[def.m_imm];
+  } else if (phi != ir::k_no_ref && m_out.m_first[phi] != k_no_interval) {
+    uint8_t r = m_out.m_intervals[m_out.m_first[phi]].m_reg;
+    hint = r == k_spilled ? rax : static_cast<reg>(r);
+  }
+  if (hint != rax && hint != rcx && hint != rdx &&
+      m_occupant[hint] == k_no_interval &&
+      (is_callee_saved(hint) || !crosses)) {
+    assign(piece, hint);
+    return true;
+  }
+  reg best = rax;
+  uint32_t best_until = 0;
+  for (reg r : k_allocatable) {
+    if (m_occupant[r] != k_no_interval) {
+      continue;
+    }
+    uint32_t until = is_callee_saved(r) ? k_never : call;
+    if (until == k_never) {
+      assign(piece, r);
+      return true;
+    }
+    if (until > best_until) {
+      best = r;
+      best_until = until;
+    }
+  }
+  if (best_until <= p.m_start) {
+    return false;
+  }
+  uint32_t rest = split(piece, best_until);
+  m_unhandled.emplace(best_until, rest);
+  assign(piece, best);
+  return true;
+}
+
+// Every usable register is taken: the piece with the lowest spill weight
+// from here on goes to memory, this one or the occupant of a register.
+void allocator::allocate_blocked(uint32_t piece) {
+  uint32_t start = m_out.m_intervals[piece].m_start;
+  bool at_call =
+      m_next_call < m_calls.size() && m_calls[m_next_call] == start &&
+      m_out.m_intervals[piece].m_end >= start + 2;
+  reg victim = rax;
+  double victim_weight = 0;
+  for (reg r : k_allocatable) {
+    if (m_occupant[r] == k_no_interval || (at_call && !is_callee_saved(r))) {
+      continue;
+    }
+    double w = weight(m_occupant[r], start);
+    if (victim == rax || w < victim_weight) {
+      victim = r;
+      victim_weight = w;
+    }
+  }
+  if (victim == rax || weight(piece, start) <= victim_weight) {
+    spill(piece);
+    return;
+  }
+  // The occupant leaves its register before the instruction that defines
+  // this piece reads its operands.
+  uint32_t rest = split(m_occupant[victim], start & ~1u);
+  m_occupant[victim] = k_no_interval;
+  spill(rest);
+  if (!is_callee_saved(victim) && m_next_call < m_calls.size() &&
+      m_out.m_intervals[piece].m_end >= m_calls[m_next_call] + 2) {
+    uint32_t call = m_calls[m_next_call];
+    m_unhandled.emplace(call, split(piece, call));
+  }
+  assign(piece, victim);
+}
+
+void allocator::scan() {
+  std::fill(std::begin(m_occupant), std::end(m_occupant), k_no_interval);
+  while (!m_unhandled.empty()) {
+    auto [start, piece] = m_unhandled.top();
+    m_unhandled.pop();
+    for (uint32_t &occupant : m_occupant) {
+      if (occupant != k_no_interval &&
+          m_out.m_intervals[occupant].m_end <= start) {
+        occupant = k_no_interval;
+      }
+    }
+    while (m_next_call < m_calls.size() && m_calls[m_next_call] < start) {
+      ++m_next_call;
+    }
+    if (!allocate_free(piece)) {
+      allocate_blocked(piece);
+    }
+  }
+  std::sort(m_out.m_splits.begin(), m_out.m_splits.end());
+}
+
+// Values whose pieces in memory are never live at the same time share a
+// slot: from the first of those pieces to the end of the last.
+void allocator::assign_spill_slots() {
+  std::vector<std::pair<uint32_t, uint32_t>> range(m_fn.m_insts.size(),
+                                                   {k_never, 0});
+  for (const interval &p : m_out.m_intervals) {
+    if (p.m_reg == k_spilled) {
+      auto &[start, end] = range[p.m_value];
+      start = std::min(start, p.m_start);
+      end = std::max(end, p.m_end);
+    }
+  }
+  std::vector<ref> spilled;
+  for (ref v = 0; v < range.size(); ++v) {
+    if (range[v].first != k_never) {
+      spilled.push_back(v);
+    }
+  }
+  std::sort(spilled.begin(), spilled.end(), [&](ref a, ref b) {
+    return range[a].first < range[b].first;
+  });
+  std::priority_queue<entry, std::vector<entry>, std::greater<>> active;
+  std::vector<uint32_t> free_slots;
+  for (ref v : spilled) {
+    while (!active.empty() && active.top().first <= range[v].first) {
+      free_slots.push_back(active.top().second);
+      active.pop();
+    }
+    uint32_t slot = m_out.m_spill_slots;
+    if (free_slots.empty()) {
+      ++m_out.m_spill_slots;
+    } else {
+      slot = free_slots.back();
+      free_slots.pop_back();
+    }
+    m_out.m_spill_slot[v] = slot;
+    active.emplace(range[v].second, slot);
+  }
+}
+
+void allocator::run() {
+  count_uses();
+  fuse_comparisons();
+  number_uses();
+  weigh_uses();
+  build_intervals();
+  scan();
+  assign_spill_slots();
+}
+} // namespace
+
+const interval &allocation::at(ir::ref v, uint32_t pos) const {
+  uint32_t i = m_first[v];
+  while (i != k_no_interval && m_intervals[i].m_end <= pos) {
+    i = m_intervals[i].m_next;
+  }
+  if (i == k_no_interval) {
+    throw std::logic_error("value used outside its lifetime");
+  }
+  return m_intervals[i];
+}
+
+allocation allocate_registers(const ir::function &fn) {
+  allocation out;
+  allocator(fn, out).run();
+  return out;
+}
+} // namespace cc::x86_64
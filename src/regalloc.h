@@ -0,0 +1,75 @@
+#ifndef CPPPROJECT_REGALLOC_H
+#define CPPPROJECT_REGALLOC_H
+
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "ir.h"
+#include "x86_64.h"
+
+namespace cc::x86_64 {
+constexpr uint32_t k_no_interval = std::numeric_limits<uint32_t>::max();
+constexpr uint8_t k_spilled = 0xFF;
+
+// Instruction n reads its operands at position 2n and writes its result at
+// 2n + 1. Phis are written at the start of their block, and the values
+// flowing into them are read at the end of each predecessor.
+//
+// A value's lifetime is one range of positions, cut into pieces where its
+// location changes. Each piece lives in a register, or in the value's spill
+// slot when m_reg is k_spilled.
+struct interval {
+  uint32_t m_start;
+  uint32_t m_end;
+  ir::ref m_value;
+  uint32_t m_next = k_no_interval;
+  uint8_t m_reg = k_spilled;
+};
+
+struct allocation {
+  std::vector<interval> m_intervals;
+  // The first piece of each value, or k_no_interval for values that are
+  // never read and for constants, which are materialized where they are
+  // used.
+  std::vector<uint32_t> m_first;
+  std::vector<uint32_t> m_spill_slot;
+  uint32_t m_spill_slots = 0;
+  // Positions inside a block where a value moves from one piece to the
+  // next, sorted. Moves at block boundaries are made on the incoming edges.
+  std::vector<std::pair<uint32_t, ir::ref>> m_splits;
+  // The values live into each block, its phis aside:
+  // m_live_in[m_live_in_begin[b], m_live_in_begin[b + 1]).
+  std::vector<uint32_t> m_live_in_begin;
+  std::vector<ir::ref> m_live_in;
+  // Comparisons whose only use is the branch right after them; they set
+  // the flags and produce no value.
+  std::vector<bool> m_fused;
+  // Bit r is set if callee-saved register r is used.
+  uint16_t m_callee_saved = 0;
+
+  // The piece of `v` covering `pos`.
+  const interval &at(ir::ref v, uint32_t pos) const;
+  bool is_split(ir::ref v) const {
+    return m_intervals[m_first[v]].m_next != k_no_interval;
+  }
+};
+
+// The registers values can live in. rax, rcx and rdx are left to the
+// lowering as scratch registers.
+constexpr reg k_allocatable[] = {rsi, rdi, r8,  r9,  r10, r11,
+                                 rbx, r12, r13, r14, r15};
+
+inline bool is_callee_saved(reg r) { return r == rbx || r >= r12; }
+
+// Linear scan over the function in block order (Wimmer and Franz, "Linear
+// Scan Register Allocation on SSA Form"). Lifetimes come from liveness
+// without holes. When no register is free, the piece with the lowest spill
+// weight (uses weighted by loop depth over remaining length) goes to memory
+// until its next use, where it competes for a register again. Values live
+// across a call only get callee-saved registers.
+allocation allocate_registers(const ir::function &fn);
+} // namespace cc::x86_64
+
+#endif // CPPPROJECT_REGALLOC_H
@@ -0,0 +1,102 @@
+#ifndef CPPPROJECT_SCAN_H
+#define CPPPROJECT_SCAN_H
+
+// Block-at-a-time scanners for the bodies of identifiers and literals. Each
+// returns the first byte in [p, end) that the caller has to look at itself,
+// or `end`. They work on raw bytes, so line splices, trigraphs and non-ASCII
+// characters always stop the scan and are left to the lexer's slow path.
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace cc::scan {
+inline bool is_identifier_byte(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_';
+}
+
+// Stops at the first byte outside [A-Za-z0-9_].
+inline const char *skip_identifier(const char *p, const char *end) {
+#if defined(__SSE2__)
+  // A byte x is in [lo, lo + n] iff max_epu8(x - lo, n) == n.
+  auto in_range = [](__m128i v, char lo, char n) {
+    __m128i t = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+    __m128i limit = _mm_set1_epi8(n);
+    return _mm_cmpeq_epi8(_mm_max_epu8(t, limit), limit);
+  };
+  while (end - p >= 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i ident = _mm_or_si128(
+        _mm_or_si128(in_range(lower, 'a', 'z' - 'a'), in_range(v, '0', 9)),
+        _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+    int mask = ~_mm_movemask_epi8(ident) & 0xFFFF;
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+    p += 16;
+  }
+#endif
+  while (p < end && is_identifier_byte(*p)) {
+    ++p;
+  }
+  return p;
+}
+
+// Stops at `quote`, a backslash, a newline, or '?' when trigraphs are on.
+template <bool Trigraphs>
+inline const char *find_literal_stop(const char *p, const char *end,
+                                     char quote) {
+#if defined(__SSE2__)
+  const __m128i quotes = _mm_set1_epi8(quote);
+  const __m128i backslashes = _mm_set1_epi8('\\');
+  const __m128i newlines = _mm_set1_epi8('\n');
+  const __m128i questions = _mm_set1_epi8('?');
+  while (end - p >= 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    __m128i stop = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, quotes), _mm_cmpeq_epi8(v, backslashes)),
+        _mm_cmpeq_epi8(v, newlines));
+    if constexpr (Trigraphs) {
+      stop = _mm_or_si128(stop, _mm_cmpeq_epi8(v, questions));
+    }
+    int mask = _mm_movemask_epi8(stop);
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+    p += 16;
+  }
+#elif __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  // Classic has-zero-byte test on eight bytes at a time. Borrows can only
+  // flag bytes above a real match, so the lowest flagged byte is exact.
+  auto has_byte = [](uint64_t v, unsigned char b) {
+    uint64_t x = v ^ (0x0101010101010101ull * b);
+    return (x - 0x0101010101010101ull) & ~x & 0x8080808080808080ull;
+  };
+  while (end - p >= 8) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    uint64_t stop =
+        has_byte(v, quote) | has_byte(v, '\\') | has_byte(v, '\n');
+    if constexpr (Trigraphs) {
+      stop |= has_byte(v, '?');
+    }
+    if (stop != 0) {
+      return p + __builtin_ctzll(stop) / 8;
+    }
+    p += 8;
+  }
+#endif
+  while (p < end && *p != quote && *p != '\\' && *p != '\n' &&
+         (!Trigraphs || *p != '?')) {
+    ++p;
+  }
+  return p;
+}
+} // namespace cc::scan
+
+#endif // CPPPROJECT_SCAN_H
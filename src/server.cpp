@@ -0,0 +1,404 @@
+#include "server.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <stdexcept>
+#include <thread>
+
+#include "compile.h"
+#include "elf_writer.h"
+
+namespace cc {
+namespace {
+// A request is one packet: these flags, then the source path. The output
+// file travels alongside as SCM_RIGHTS. The reply is an int32_t status
+// followed by the error message, if any.
+constexpr uint32_t k_optimize = 1;
+
+// IN_ATTRIB also reports the link count dropping, which is what an editor
+// replacing the file through rename() looks like from the mapped inode.
+constexpr uint32_t k_watch_events =
+    IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF;
+
+// A client that connects and sends nothing must not hold up the others.
+constexpr timeval k_request_timeout = {5, 0};
+
+sockaddr_un address(std::string_view path) {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    throw std::runtime_error(std::format("Socket path '{}' is too long", path));
+  }
+  path.copy(addr.sun_path, path.size());
+  return addr;
+}
+
+int connect_to(const sockaddr_un &addr) {
+  int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
+    return -1;
+  }
+  if (connect(fd, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) ==
+      -1) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Reads the whole source with pread rather than mapping it: a mapped file
+// that someone truncates raises SIGBUS in whoever reads past the new end,
+// which would take the server down with every client.
+std::string read_source(const std::string &path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    throw std::runtime_error("Failed to open file");
+  }
+  struct stat sb;
+  if (fstat(fd, &sb) == -1) {
+    close(fd);
+    throw std::runtime_error("Failed to get file size");
+  }
+  std::string text(sb.st_size, '\0');
+  size_t size = 0;
+  while (size < text.size()) {
+    ssize_t n = pread(fd, text.data() + size, text.size() - size, size);
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n == -1) {
+      close(fd);
+      throw std::runtime_error("Failed to read file");
+    }
+    if (n == 0) {
+      break;
+    }
+    size += n;
+  }
+  close(fd);
+  text.resize(size);
+  return text;
+}
+
+std::vector<uint8_t> compile_object(const std::string &path, bool optimize) {
+  std::string text = read_source(path);
+  file f(text.data(), text.size());
+  return elf::build_object(compile(f, optimize));
+}
+} // namespace
+
+compile_server::compile_server(std::string_view socket_path,
+                               size_t capacity, unsigned threads)
+    : m_socket_path(socket_path), m_capacity(std::max<size_t>(capacity, 1)),
+      m_threads(threads != 0
+                    ? threads
+                    : std::max(1u, std::thread::hardware_concurrency())) {
+  sockaddr_un addr = address(socket_path);
+  int probe = connect_to(addr);
+  if (probe != -1) {
+    close(probe);
+    throw std::runtime_error(
+        std::format("A server is already listening on '{}'", socket_path));
+  }
+  // Nobody answers on the path, so whatever is left there is stale.
+  unlink(m_socket_path.c_str());
+  // Non-blocking, since every worker polls it and only one wins accept().
+  m_listen =
+      socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+  m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  m_stop = eventfd(0, EFD_CLOEXEC);
+  if (m_listen == -1 || m_inotify == -1 || m_stop == -1 ||
+      bind(m_listen, reinterpret_cast<const sockaddr *>(&addr),
+           sizeof(addr)) == -1 ||
+      listen(m_listen, SOMAXCONN) == -1) {
+    for (int fd : {m_listen, m_inotify, m_stop}) {
+      if (fd != -1) {
+        close(fd);
+      }
+    }
+    throw std::runtime_error(
+        std::format("Failed to listen on '{}'", socket_path));
+  }
+}
+
+compile_server::~compile_server() {
+  close(m_listen);
+  close(m_inotify);
+  close(m_stop);
+  unlink(m_socket_path.c_str());
+}
+
+void compile_server::run() {
+  std::vector<std::jthread> workers;
+  for (unsigned k = 1; k < m_threads; ++k) {
+    workers.emplace_back([this] { accept_clients(); });
+  }
+  accept_clients();
+}
+
+size_t compile_server::cached_sources() const {
+  std::lock_guard lock(m_mutex);
+  return m_sources.size();
+}
+
+void compile_server::accept_clients() {
+  pollfd fds[] = {{m_stop, POLLIN, 0}, {m_listen, POLLIN, 0}};
+  while (true) {
+    if (poll(fds, std::size(fds), -1) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      stop();
+      return;
+    }
+    // The event counter is never read, so stop() wakes every worker.
+    if (fds[0].revents != 0) {
+      return;
+    }
+    if (fds[1].revents & POLLIN) {
+      int client = accept4(m_listen, nullptr, nullptr, SOCK_CLOEXEC);
+      if (client != -1) {
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &k_request_timeout,
+                   sizeof(k_request_timeout));
+        serve(client);
+        close(client);
+      }
+    }
+  }
+}
+
+void compile_server::stop() {
+  uint64_t one = 1;
+  [[maybe_unused]] ssize_t n = write(m_stop, &one, sizeof(one));
+}
+
+void compile_server::serve(int client) {
+  uint32_t flags;
+  char buffer[sizeof(flags) + PATH_MAX];
+  iovec iov{buffer, sizeof(buffer)};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  ssize_t n = recvmsg(client, &msg, MSG_CMSG_CLOEXEC);
+  int output = -1;
+  if (n != -1) {
+    for (cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+      if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) {
+        std::memcpy(&output, CMSG_DATA(c), sizeof(output));
+      }
+    }
+  }
+
+  int32_t status = 0;
+  std::string message;
+  try {
+    if (n < ssize_t(sizeof(flags)) || output == -1 ||
+        (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC))) {
+      throw std::runtime_error("Malformed request");
+    }
+    std::memcpy(&flags, buffer, sizeof(flags));
+    std::string path(buffer + sizeof(flags), n - sizeof(flags));
+    auto image = object(path, flags & k_optimize);
+    if (!elf::write_all(output, *image)) {
+      throw std::runtime_error(std::format("Failed to write '{}'", path));
+    }
+  } catch (const std::exception &e) {
+    status = 1;
+    message = e.what();
+  }
+  if (output != -1) {
+    close(output);
+  }
+  std::string reply(sizeof(status), '\0');
+  std::memcpy(reply.data(), &status, sizeof(status));
+  reply += message;
+  send(client, reply.data(), reply.size(), MSG_NOSIGNAL);
+}
+
+std::shared_ptr<const std::vector<uint8_t>>
+compile_server::object(const std::string &path, bool optimize) {
+  std::shared_ptr<source> entry;
+  {
+    std::lock_guard lock(m_mutex);
+    // Drain change notifications first so that no request is answered from
+    // an entry that is already stale.
+    invalidate();
+    auto it = m_sources.find(path);
+    if (it == m_sources.end()) {
+      entry = add(path);
+    } else {
+      entry = it->second;
+      m_lru.splice(m_lru.begin(), m_lru, entry->m_lru);
+      if (auto cached = entry->m_object[optimize]) {
+        ++m_hits;
+        return cached;
+      }
+    }
+  }
+
+  // Compiling happens outside the lock. The source is read after the watch
+  // was added, so a change made since then drops the entry.
+  std::shared_ptr<const image> result;
+  try {
+    result = std::make_shared<image>(compile_object(path, optimize));
+  } catch (const std::runtime_error &e) {
+    throw std::runtime_error(std::format("{}: {}", path, e.what()));
+  }
+  if (entry) {
+    std::lock_guard lock(m_mutex);
+    // A change that arrived while compiling has dropped the entry, and the
+    // object must not be cached.
+    invalidate();
+    auto it = m_sources.find(path);
+    if (it != m_sources.end() && it->second == entry) {
+      entry->m_object[optimize] = result;
+    }
+  }
+  return result;
+}
+
+std::shared_ptr<compile_server::source>
+compile_server::add(const std::string &path) {
+  // Watch before the source is read, so that no change in between is missed.
+  int watch = inotify_add_watch(m_inotify, path.c_str(), k_watch_events);
+  if (watch == -1 && errno == ENOSPC && !m_lru.empty()) {
+    forget(std::string(m_lru.back()));
+    watch = inotify_add_watch(m_inotify, path.c_str(), k_watch_events);
+  }
+  if (watch == -1) {
+    // Without a watch a change would go unnoticed, so nothing is kept.
+    return nullptr;
+  }
+  auto entry = std::make_shared<source>();
+  entry->m_watch = watch;
+  m_watched.emplace(watch, path);
+  m_lru.push_front(path);
+  entry->m_lru = m_lru.begin();
+  m_sources.emplace(path, entry);
+  if (m_sources.size() > m_capacity) {
+    forget(std::string(m_lru.back()));
+  }
+  return entry;
+}
+
+void compile_server::forget(const std::string &path) {
+  auto it = m_sources.find(path);
+  if (it == m_sources.end()) {
+    return;
+  }
+  int watch = it->second->m_watch;
+  m_lru.erase(it->second->m_lru);
+  m_sources.erase(it);
+  auto [first, last] = m_watched.equal_range(watch);
+  for (auto w = first; w != last; ++w) {
+    if (w->second == path) {
+      m_watched.erase(w);
+      break;
+    }
+  }
+  if (!m_watched.contains(watch)) {
+    inotify_rm_watch(m_inotify, watch);
+  }
+}
+
+void compile_server::invalidate() {
+  alignas(inotify_event) char buffer[4096];
+  ssize_t n;
+  while ((n = read(m_inotify, buffer, sizeof(buffer))) > 0) {
+    for (ssize_t k = 0; k < n;) {
+      const auto *event = reinterpret_cast<const inotify_event *>(buffer + k);
+      k += sizeof(inotify_event) + event->len;
+      if (event->mask & IN_Q_OVERFLOW) {
+        // Events were lost; nothing cached can be trusted.
+        while (!m_lru.empty()) {
+          forget(std::string(m_lru.back()));
+        }
+        continue;
+      }
+      std::vector<std::string> paths;
+      auto [first, last] = m_watched.equal_range(event->wd);
+      for (auto it = first; it != last; ++it) {
+        paths.push_back(it->second);
+      }
+      for (const auto &path : paths) {
+        forget(path);
+      }
+    }
+  }
+}
+
+bool compile_remote(std::string_view socket_path, std::string_view source,
+                    bool optimize, std::string_view output) {
+  int fd = connect_to(address(socket_path));
+  if (fd == -1) {
+    return false;
+  }
+  // Created only once a server has taken the connection, so that a driver
+  // falling back to compiling locally finds the output as it was.
+  std::string output_path(output);
+  int out =
+      open(output_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (out == -1) {
+    close(fd);
+    throw std::runtime_error(std::format("Failed to create '{}'", output));
+  }
+  uint32_t flags = optimize ? k_optimize : 0;
+  std::string request(sizeof(flags), '\0');
+  std::memcpy(request.data(), &flags, sizeof(flags));
+  request += std::filesystem::absolute(source).string();
+
+  iovec iov{request.data(), request.size()};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  cmsghdr *c = CMSG_FIRSTHDR(&msg);
+  c->cmsg_level = SOL_SOCKET;
+  c->cmsg_type = SCM_RIGHTS;
+  c->cmsg_len = CMSG_LEN(sizeof(out));
+  std::memcpy(CMSG_DATA(c), &out, sizeof(out));
+
+  int32_t status;
+  std::string reply;
+  ssize_t size = -1;
+  if (sendmsg(fd, &msg, MSG_NOSIGNAL) != -1) {
+    // Peeking with MSG_TRUNC gives the length of the whole packet.
+    size = recv(fd, nullptr, 0, MSG_PEEK | MSG_TRUNC);
+  }
+  if (size >= ssize_t(sizeof(status))) {
+    reply.resize(size);
+    size = recv(fd, reply.data(), reply.size(), 0);
+  }
+  close(fd);
+  close(out);
+  if (size < ssize_t(sizeof(status))) {
+    unlink(output_path.c_str());
+    throw std::runtime_error(
+        std::format("Lost the connection to the server at '{}'", socket_path));
+  }
+  std::memcpy(&status, reply.data(), sizeof(status));
+  if (status != 0) {
+    unlink(output_path.c_str());
+    throw std::runtime_error(reply.substr(sizeof(status)));
+  }
+  return true;
+}
+} // namespace cc
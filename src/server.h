@@ -0,0 +1,91 @@
+#ifndef CPPPROJECT_SERVER_H
+#define CPPPROJECT_SERVER_H
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace cc {
+// Compiles sources on behalf of clients connecting to a Unix domain socket.
+// A request names a source by absolute path and carries the client's open
+// output file as an SCM_RIGHTS descriptor; the server writes the ELF object
+// into it and replies with a status and any error message. Requests are
+// served by a pool of threads, so parallel builds compile in parallel.
+//
+// A translation unit is a single file, so the object built from an
+// unchanged source can be handed out again as is. The objects of up to
+// `capacity` sources are cached, least recently used first out, until
+// inotify reports that the file changed, moved or went away. Sources that
+// cannot be watched, say once the inotify watch limit is reached, are
+// compiled without being cached. Sources are read into memory rather than
+// mapped, so one truncated mid-compile fails that request alone.
+class compile_server {
+public:
+  static constexpr size_t k_default_capacity = 1024;
+
+  // Takes over `socket_path` unless another server is listening on it. Zero
+  // threads means one per hardware thread.
+  explicit compile_server(std::string_view socket_path,
+                          size_t capacity = k_default_capacity,
+                          unsigned threads = 0);
+  ~compile_server();
+  compile_server(const compile_server &) = delete;
+  compile_server &operator=(const compile_server &) = delete;
+
+  // Serves requests until stop() is called.
+  void run();
+  // Can be called from any thread.
+  void stop();
+
+  size_t cache_hits() const { return m_hits; }
+  size_t cached_sources() const;
+
+private:
+  using image = std::vector<uint8_t>;
+
+  struct source {
+    int m_watch;
+    // Indexed by whether the object was optimized.
+    std::shared_ptr<const image> m_object[2];
+    std::list<std::string>::iterator m_lru;
+  };
+
+  void accept_clients();
+  void serve(int client);
+  std::shared_ptr<const image> object(const std::string &path,
+                                      bool optimize);
+  // The rest run with m_mutex held.
+  std::shared_ptr<source> add(const std::string &path);
+  void forget(const std::string &path);
+  void invalidate();
+
+private:
+  std::string m_socket_path;
+  size_t m_capacity;
+  unsigned m_threads;
+  int m_listen = -1;
+  int m_inotify = -1;
+  int m_stop = -1;
+  mutable std::mutex m_mutex;
+  std::unordered_map<std::string, std::shared_ptr<source>> m_sources;
+  // Most recently used first.
+  std::list<std::string> m_lru;
+  // Hard links to one file share a watch.
+  std::unordered_multimap<int, std::string> m_watched;
+  std::atomic<size_t> m_hits = 0;
+};
+
+// Has the server at `socket_path` compile `source` into the file `output`.
+// Returns false, leaving `output` untouched, if no server is listening
+// there. Compile errors are thrown, and remove `output`.
+bool compile_remote(std::string_view socket_path, std::string_view source,
+                    bool optimize, std::string_view output);
+} // namespace cc
+
+#endif // CPPPROJECT_SERVER_H
@@ -0,0 +1,100 @@
+#include "symbol_table.h"
+
+#include <stdexcept>
+
+namespace cc {
+symbol_table::symbol_table() : m_slots(256, k_none) {}
+
+uint32_t symbol_table::hash(std::string_view name) {
+  // FNV-1a; identifiers are short, so this beats anything with a setup cost.
+  uint32_t h = 2166136261u;
+  for (char c : name) {
+    h = (h ^ static_cast<unsigned char>(c)) * 16777619u;
+  }
+  return h;
+}
+
+// Returns the slot holding `name`, or the empty slot where it would go.
+uint32_t symbol_table::probe(std::string_view name, uint32_t h) const {
+  uint32_t mask = m_slots.size() - 1;
+  for (uint32_t i = h & mask;; i = (i + 1) & mask) {
+    uint32_t id = m_slots[i];
+    if (id == k_none ||
+        (m_names[id].m_hash == h && m_names[id].m_text == name)) {
+      return i;
+    }
+  }
+}
+
+void symbol_table::grow() {
+  std::vector<uint32_t> slots(m_slots.size() * 2, k_none);
+  uint32_t mask = slots.size() - 1;
+  for (uint32_t id = 0; id < m_names.size(); ++id) {
+    uint32_t i = m_names[id].m_hash & mask;
+    while (slots[i] != k_none) {
+      i = (i + 1) & mask;
+    }
+    slots[i] = id;
+  }
+  m_slots = std::move(slots);
+}
+
+symbol_table::name_id symbol_table::intern(std::string_view name) {
+  uint32_t h = hash(name);
+  uint32_t slot = probe(name, h);
+  if (m_slots[slot] != k_none) {
+    return m_slots[slot];
+  }
+  if ((m_names.size() + 1) * 2 > m_slots.size()) {
+    grow();
+    slot = probe(name, h);
+  }
+  name_id id = m_names.size();
+  m_names.push_back({m_text.copy(name), h});
+  m_slots[slot] = id;
+  return id;
+}
+
+symbol_table::name_id symbol_table::find(std::string_view name) const {
+  return m_slots[probe(name, hash(name))];
+}
+
+void symbol_table::pop_scope() {
+  if (m_scope_marks.empty()) {
+    throw std::logic_error("pop_scope() at file scope");
+  }
+  uint32_t mark = m_scope_marks.back();
+  m_scope_marks.pop_back();
+  while (m_bindings.size() > mark) {
+    const binding &b = m_bindings.back();
+    m_names[b.m_name].m_head = b.m_shadowed;
+    m_bindings.pop_back();
+  }
+}
+
+symbol *symbol_table::declare(name_id name, symbol_kind kind,
+                              uint32_t value) {
+  uint32_t head = m_names[name].m_head;
+  if (head != k_none && m_bindings[head].m_symbol.m_scope == depth()) {
+    return nullptr;
+  }
+  m_names[name].m_head = m_bindings.size();
+  m_bindings.push_back({{kind, depth(), value}, name, head});
+  return &m_bindings.back().m_symbol;
+}
+
+symbol *symbol_table::lookup(name_id name) {
+  uint32_t head = m_names[name].m_head;
+  return head == k_none ? nullptr : &m_bindings[head].m_symbol;
+}
+
+const symbol *symbol_table::lookup(name_id name) const {
+  uint32_t head = m_names[name].m_head;
+  return head == k_none ? nullptr : &m_bindings[head].m_symbol;
+}
+
+const symbol *symbol_table::lookup(std::string_view name) const {
+  name_id id = find(name);
+  return id == k_no_name ? nullptr : lookup(id);
+}
+} // namespace cc
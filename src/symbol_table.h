@@ -0,0 +1,99 @@
+#ifndef CPPPROJECT_SYMBOL_TABLE_H
+#define CPPPROJECT_SYMBOL_TABLE_H
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "arena.h"
+
+namespace cc {
+enum class symbol_kind : uint8_t {
+  object,
+  function,
+  typedef_name,
+  enum_constant,
+};
+
+struct symbol {
+  symbol_kind m_kind = symbol_kind::object;
+  // Scope depth the symbol was declared at; 0 is file scope.
+  uint32_t m_scope = 0;
+  // Free for the client, e.g. an index into its own declaration tables.
+  uint32_t m_value = 0;
+};
+
+// Ordinary-identifier namespace of a C translation unit.
+//
+// Names are interned in a single open-addressing hash table. Each interned
+// name heads a chain of the bindings that currently shadow one another, so
+// a lookup is one probe sequence regardless of nesting depth. Bindings are
+// appended to one array in declaration order, which doubles as the undo log:
+// leaving a scope truncates it back to the scope's mark and restores each
+// removed binding's shadowed predecessor.
+//
+// Pointers to symbols stay valid until the next declare() or pop_scope().
+class symbol_table {
+public:
+  using name_id = uint32_t;
+  static constexpr name_id k_no_name = UINT32_MAX;
+
+  symbol_table();
+
+  name_id intern(std::string_view name);
+  // Returns k_no_name if `name` has never been interned.
+  name_id find(std::string_view name) const;
+  std::string_view name(name_id id) const { return m_names[id].m_text; }
+
+  void push_scope() { m_scope_marks.push_back(m_bindings.size()); }
+  void pop_scope();
+  uint32_t depth() const { return m_scope_marks.size(); }
+
+  // Binds `name` in the current scope, shadowing any outer binding. Returns
+  // nullptr if the name is already declared in the current scope.
+  symbol *declare(name_id name, symbol_kind kind, uint32_t value = 0);
+  symbol *declare(std::string_view name, symbol_kind kind,
+                  uint32_t value = 0) {
+    return declare(intern(name), kind, value);
+  }
+
+  symbol *lookup(name_id name);
+  const symbol *lookup(name_id name) const;
+  const symbol *lookup(std::string_view name) const;
+
+  bool is_typedef_name(std::string_view name) const {
+    const symbol *sym = lookup(name);
+    return sym && sym->m_kind == symbol_kind::typedef_name;
+  }
+
+private:
+  static constexpr uint32_t k_none = UINT32_MAX;
+
+  struct name_entry {
+    std::string_view m_text;
+    uint32_t m_hash = 0;
+    // Innermost binding of the name, or k_none.
+    uint32_t m_head = k_none;
+  };
+  struct binding {
+    symbol m_symbol;
+    name_id m_name = 0;
+    // Binding this one shadows, restored when its scope is popped.
+    uint32_t m_shadowed = k_none;
+  };
+
+  static uint32_t hash(std::string_view name);
+  uint32_t probe(std::string_view name, uint32_t h) const;
+  void grow();
+
+  // Slots hold name ids; k_none marks an empty slot. The capacity is a power
+  // of two and at most half of it is used.
+  std::vector<uint32_t> m_slots;
+  std::vector<name_entry> m_names;
+  std::vector<binding> m_bindings;
+  std::vector<uint32_t> m_scope_marks;
+  arena m_text;
+};
+} // namespace cc
+
+#endif // CPPPROJECT_SYMBOL_TABLE_H
@@ -0,0 +1,215 @@
+#include "types.h"
+
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+
+namespace cc {
+namespace {
+struct builtin_layout {
+  type_kind m_kind;
+  uint32_t m_size;
+};
+
+constexpr builtin_layout k_builtin_layouts[] = {
+    {type_kind::void_, 0},   {type_kind::bool_, 1},   {type_kind::char_, 1},
+    {type_kind::schar, 1},   {type_kind::uchar, 1},   {type_kind::short_, 2},
+    {type_kind::ushort, 2},  {type_kind::int_, 4},    {type_kind::uint, 4},
+    {type_kind::long_, 8},   {type_kind::ulong, 8},   {type_kind::llong, 8},
+    {type_kind::ullong, 8},  {type_kind::float_, 4},  {type_kind::double_, 8},
+    {type_kind::ldouble, 16},
+};
+
+uint64_t mix(uint64_t h, uint64_t v) {
+  h ^= v + 0x9E3779B97F4A7C15ull + (h << 6) + (h >> 2);
+  return h;
+}
+} // namespace
+
+bool type::is_signed() const {
+  switch (m_kind) {
+  case type_kind::char_:
+  case type_kind::schar:
+  case type_kind::short_:
+  case type_kind::int_:
+  case type_kind::long_:
+  case type_kind::llong:
+  case type_kind::enum_:
+    return true;
+  default:
+    return is_floating();
+  }
+}
+
+type_context::type_context() : m_slots(1024) {
+  for (const auto &layout : k_builtin_layouts) {
+    auto *t = m_arena.make<type>();
+    t->m_kind = layout.m_kind;
+    t->m_size = layout.m_size;
+    t->m_align = std::max<uint32_t>(layout.m_size, 1);
+    t->m_complete = layout.m_kind != type_kind::void_;
+    m_builtins.push_back(t);
+  }
+}
+
+uint64_t type_context::hash(const key &k) {
+  uint64_t h = static_cast<uint64_t>(k.m_kind);
+  h = mix(h, k.m_base.bits());
+  h = mix(h, k.m_count);
+  h = mix(h, k.m_variadic);
+  for (qual_type param : k.m_params) {
+    h = mix(h, param.bits());
+  }
+  return h;
+}
+
+bool type_context::matches(const type *t, const key &k) {
+  return t->m_kind == k.m_kind && t->m_base == k.m_base &&
+         t->m_count == k.m_count && t->m_variadic == k.m_variadic &&
+         std::ranges::equal(t->m_params, k.m_params);
+}
+
+void type_context::grow() {
+  std::vector<slot> slots(m_slots.size() * 2);
+  size_t mask = slots.size() - 1;
+  for (const slot &s : m_slots) {
+    if (s.m_type) {
+      size_t i = s.m_hash & mask;
+      while (slots[i].m_type) {
+        i = (i + 1) & mask;
+      }
+      slots[i] = s;
+    }
+  }
+  m_slots = std::move(slots);
+}
+
+const type *type_context::intern(const key &k) {
+  uint64_t h = hash(k);
+  size_t mask = m_slots.size() - 1;
+  size_t i = h & mask;
+  for (; m_slots[i].m_type; i = (i + 1) & mask) {
+    if (m_slots[i].m_hash == h && matches(m_slots[i].m_type, k)) {
+      return m_slots[i].m_type;
+    }
+  }
+
+  // Only a miss pays for the allocation, including the parameter list.
+  auto *t = m_arena.make<type>();
+  t->m_kind = k.m_kind;
+  t->m_base = k.m_base;
+  t->m_count = k.m_count;
+  t->m_variadic = k.m_variadic;
+  if (!k.m_params.empty()) {
+    auto *params = static_cast<qual_type *>(m_arena.allocate(
+        k.m_params.size_bytes(), alignof(qual_type)));
+    std::ranges::copy(k.m_params, params);
+    t->m_params = {params, k.m_params.size()};
+  }
+
+  switch (k.m_kind) {
+  case type_kind::pointer:
+    t->m_size = t->m_align = 8;
+    break;
+  case type_kind::array:
+    t->m_align = k.m_base->m_align;
+    t->m_complete = k.m_count != type::k_unknown_bound;
+    t->m_size = t->m_complete ? k.m_base->m_size * k.m_count : 0;
+    break;
+  default:
+    break;
+  }
+
+  if ((m_interned + 1) * 2 > m_slots.size()) {
+    grow();
+    mask = m_slots.size() - 1;
+    i = h & mask;
+    while (m_slots[i].m_type) {
+      i = (i + 1) & mask;
+    }
+  }
+  m_slots[i] = {t, h};
+  ++m_interned;
+  return t;
+}
+
+const type *type_context::pointer_to(qual_type pointee) {
+  return intern({type_kind::pointer, pointee, 0, false, {}});
+}
+
+const type *type_context::array_of(qual_type element, uint64_t count) {
+  if (!element->m_complete) {
+    throw std::runtime_error("array of incomplete element type");
+  }
+  return intern({type_kind::array, element, count, false, {}});
+}
+
+const type *type_context::function(qual_type result,
+                                   std::span<const qual_type> params,
+                                   bool variadic) {
+  // Top-level qualifiers of parameters are not part of the function type.
+  auto qualified = [](qual_type param) { return param.quals() != q_none; };
+  if (std::ranges::any_of(params, qualified)) {
+    std::vector<qual_type> unqualified;
+    unqualified.reserve(params.size());
+    for (qual_type param : params) {
+      unqualified.push_back(param.unqualified());
+    }
+    return function(result, unqualified, variadic);
+  }
+  return intern(
+      {type_kind::function, result, params.size(), variadic, params});
+}
+
+type *type_context::record(type_kind kind, std::string_view tag) {
+  if (kind != type_kind::struct_ && kind != type_kind::union_) {
+    throw std::logic_error("record() needs struct_ or union_");
+  }
+  auto *t = m_arena.make<type>();
+  t->m_kind = kind;
+  t->m_complete = false;
+  t->m_tag = m_arena.copy(tag);
+  return t;
+}
+
+void type_context::complete(type *record, std::span<const field> fields) {
+  if (record->m_complete) {
+    throw std::runtime_error(
+        std::format("redefinition of '{}'", record->m_tag));
+  }
+  auto *laid_out = static_cast<field *>(
+      m_arena.allocate(fields.size_bytes(), alignof(field)));
+  uint64_t size = 0;
+  uint32_t align = 1;
+  for (size_t i = 0; i < fields.size(); ++i) {
+    const type *ft = fields[i].m_type.get();
+    if (!ft->m_complete) {
+      throw std::runtime_error(std::format(
+          "field '{}' has incomplete type", fields[i].m_name));
+    }
+    uint64_t offset = 0;
+    if (record->m_kind == type_kind::struct_) {
+      offset = (size + ft->m_align - 1) & ~uint64_t(ft->m_align - 1);
+      size = offset + ft->m_size;
+    } else {
+      size = std::max(size, ft->m_size);
+    }
+    align = std::max(align, ft->m_align);
+    new (&laid_out[i])
+        field{m_arena.copy(fields[i].m_name), fields[i].m_type, offset};
+  }
+  record->m_fields = {laid_out, fields.size()};
+  record->m_count = fields.size();
+  record->m_align = align;
+  record->m_size = (size + align - 1) & ~uint64_t(align - 1);
+  record->m_complete = true;
+}
+
+type *type_context::enumeration(std::string_view tag) {
+  auto *t = m_arena.make<type>();
+  t->m_kind = type_kind::enum_;
+  t->m_tag = m_arena.copy(tag);
+  t->m_size = t->m_align = 4;
+  return t;
+}
+} // namespace cc
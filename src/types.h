@@ -0,0 +1,182 @@
+#ifndef CPPPROJECT_TYPES_H
+#define CPPPROJECT_TYPES_H
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "arena.h"
+
+namespace cc {
+enum class type_kind : uint8_t {
+  void_,
+  bool_,
+  char_,
+  schar,
+  uchar,
+  short_,
+  ushort,
+  int_,
+  uint,
+  long_,
+  ulong,
+  llong,
+  ullong,
+  float_,
+  double_,
+  ldouble,
+  pointer,
+  array,
+  function,
+  struct_,
+  union_,
+  enum_,
+};
+
+enum qualifier : unsigned {
+  q_none = 0,
+  q_const = 1,
+  q_volatile = 2,
+  q_restrict = 4,
+};
+
+struct type;
+
+// A type plus its cv/restrict qualifiers. Types are at least 8-byte aligned,
+// so the qualifiers live in the low bits of the pointer and a qualified type
+// is still one word that compares by value.
+class qual_type {
+public:
+  static constexpr uintptr_t k_qual_mask = 7;
+
+  qual_type() = default;
+  qual_type(const type *t, unsigned quals = q_none)
+      : m_bits(reinterpret_cast<uintptr_t>(t) | (quals & k_qual_mask)) {}
+
+  const type *get() const {
+    return reinterpret_cast<const type *>(m_bits & ~k_qual_mask);
+  }
+  const type *operator->() const { return get(); }
+  const type &operator*() const { return *get(); }
+  explicit operator bool() const { return get() != nullptr; }
+
+  unsigned quals() const { return m_bits & k_qual_mask; }
+  bool is_const() const { return m_bits & q_const; }
+  bool is_volatile() const { return m_bits & q_volatile; }
+  bool is_restrict() const { return m_bits & q_restrict; }
+  qual_type with(unsigned quals) const {
+    return {get(), this->quals() | quals};
+  }
+  qual_type unqualified() const { return {get()}; }
+  uintptr_t bits() const { return m_bits; }
+
+  bool operator==(const qual_type &) const = default;
+
+private:
+  uintptr_t m_bits = 0;
+};
+
+struct field {
+  std::string_view m_name;
+  qual_type m_type;
+  uint64_t m_offset = 0;
+};
+
+struct alignas(8) type {
+  static constexpr uint64_t k_unknown_bound = UINT64_MAX;
+
+  type_kind m_kind;
+  // Functions only.
+  bool m_variadic = false;
+  // False for incomplete arrays, records and enums until they are completed.
+  bool m_complete = true;
+  uint32_t m_align = 1;
+  uint64_t m_size = 0;
+  // Pointee, element or return type.
+  qual_type m_base;
+  // Array bound, or the number of parameters or fields.
+  uint64_t m_count = 0;
+  std::span<const qual_type> m_params;
+  std::span<const field> m_fields;
+  // Records and enums.
+  std::string_view m_tag;
+
+  bool is_integer() const {
+    return (m_kind >= type_kind::bool_ && m_kind <= type_kind::ullong) ||
+           m_kind == type_kind::enum_;
+  }
+  bool is_signed() const;
+  bool is_floating() const {
+    return m_kind >= type_kind::float_ && m_kind <= type_kind::ldouble;
+  }
+  bool is_arithmetic() const { return is_integer() || is_floating(); }
+  bool is_scalar() const {
+    return is_arithmetic() || m_kind == type_kind::pointer;
+  }
+  bool is_record() const {
+    return m_kind == type_kind::struct_ || m_kind == type_kind::union_;
+  }
+};
+
+// Owns every type of a translation unit. Derived types are hash-consed:
+// asking twice for `int *` or for `int (char *, ...)` returns the same
+// object, so type identity is pointer identity. Records and enums are
+// nominal and get a fresh type for every declaration of a new tag.
+//
+// Sizes and alignments follow the LP64 ABI.
+class type_context {
+public:
+  type_context();
+  type_context(const type_context &) = delete;
+  type_context &operator=(const type_context &) = delete;
+
+  const type *builtin(type_kind kind) const {
+    return m_builtins[static_cast<size_t>(kind)];
+  }
+  const type *pointer_to(qual_type pointee);
+  const type *array_of(qual_type element,
+                       uint64_t count = type::k_unknown_bound);
+  // Drops top-level qualifiers of `params`, which C ignores when comparing
+  // function types.
+  const type *function(qual_type result, std::span<const qual_type> params,
+                       bool variadic = false);
+
+  type *record(type_kind kind, std::string_view tag);
+  // Lays out the fields in order and marks the record complete. The offsets
+  // of `fields` are ignored and recomputed.
+  void complete(type *record, std::span<const field> fields);
+  type *enumeration(std::string_view tag);
+
+  // Number of distinct derived types created so far.
+  size_t derived_count() const { return m_interned; }
+
+private:
+  struct key {
+    type_kind m_kind;
+    qual_type m_base;
+    uint64_t m_count;
+    bool m_variadic;
+    std::span<const qual_type> m_params;
+  };
+
+  static uint64_t hash(const key &k);
+  static bool matches(const type *t, const key &k);
+  const type *intern(const key &k);
+  void grow();
+
+  struct slot {
+    const type *m_type = nullptr;
+    uint64_t m_hash = 0;
+  };
+
+  std::vector<const type *> m_builtins;
+  // Open-addressing set of derived types; nullptr marks an empty slot. The
+  // capacity is a power of two and at most half of it is used.
+  std::vector<slot> m_slots;
+  size_t m_interned = 0;
+  arena m_arena;
+};
+} // namespace cc
+
+#endif // CPPPROJECT_TYPES_H
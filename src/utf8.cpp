@@ -0,0 +1,114 @@
+#include "utf8.h"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "xid_tables.inc"
+
+namespace cc::utf8 {
+int decode(const char *p, const char *end, char32_t &cp) {
+  auto byte = [p](int i) { return static_cast<unsigned char>(p[i]); };
+  auto is_cont = [&](int i) { return (byte(i) & 0xC0) == 0x80; };
+  unsigned char lead = byte(0);
+  ptrdiff_t avail = end - p;
+  if (lead < 0x80) {
+    cp = lead;
+    return 1;
+  }
+  if (lead < 0xC2) {
+    // Stray continuation byte or overlong two-byte form.
+    return 0;
+  }
+  if (lead < 0xE0) {
+    if (avail < 2 || !is_cont(1)) {
+      return 0;
+    }
+    cp = (lead & 0x1F) << 6 | (byte(1) & 0x3F);
+    return 2;
+  }
+  if (lead < 0xF0) {
+    if (avail < 3 || !is_cont(1) || !is_cont(2)) {
+      return 0;
+    }
+    cp = (lead & 0x0F) << 12 | (byte(1) & 0x3F) << 6 | (byte(2) & 0x3F);
+    if (cp < 0x800 || (cp >= 0xD800 && cp <= 0xDFFF)) {
+      return 0;
+    }
+    return 3;
+  }
+  if (lead < 0xF5) {
+    if (avail < 4 || !is_cont(1) || !is_cont(2) || !is_cont(3)) {
+      return 0;
+    }
+    cp = (lead & 0x07) << 18 | (byte(1) & 0x3F) << 12 |
+         (byte(2) & 0x3F) << 6 | (byte(3) & 0x3F);
+    if (cp < 0x10000 || cp > 0x10FFFF) {
+      return 0;
+    }
+    return 4;
+  }
+  return 0;
+}
+
+// Advances `p` over ASCII bytes and stops at the first byte with the high
+// bit set, or at `end`.
+static const char *skip_ascii(const char *p, const char *end) {
+#if defined(__SSE2__)
+  while (end - p >= 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    int mask = _mm_movemask_epi8(chunk);
+    if (mask != 0) {
+      return p + __builtin_ctz(mask);
+    }
+    p += 16;
+  }
+#else
+  while (end - p >= 8) {
+    uint64_t chunk;
+    std::memcpy(&chunk, p, sizeof(chunk));
+    uint64_t high = chunk & 0x8080808080808080ull;
+    if (high != 0) {
+      return p + __builtin_ctzll(high) / 8;
+    }
+    p += 8;
+  }
+#endif
+  while (p < end && static_cast<unsigned char>(*p) < 0x80) {
+    ++p;
+  }
+  return p;
+}
+
+const char *find_invalid(const char *begin, const char *end) {
+  const char *p = begin;
+  while (true) {
+    p = skip_ascii(p, end);
+    if (p == end) {
+      return nullptr;
+    }
+    char32_t cp;
+    int len = decode(p, end, cp);
+    if (len == 0) {
+      return p;
+    }
+    p += len;
+  }
+}
+
+static bool lookup(const uint8_t *index, char32_t cp) {
+  if (cp >= 0x110000) {
+    return false;
+  }
+  const uint64_t *block = xid_blocks[index[cp >> 8]];
+  unsigned low = cp & 0xFF;
+  return (block[low >> 6] >> (low & 63)) & 1;
+}
+
+bool is_xid_start(char32_t cp) { return lookup(xid_start_index, cp); }
+
+bool is_xid_continue(char32_t cp) { return lookup(xid_continue_index, cp); }
+} // namespace cc::utf8
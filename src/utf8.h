@@ -0,0 +1,21 @@
+#ifndef CPPPROJECT_UTF8_H
+#define CPPPROJECT_UTF8_H
+
+#include <cstddef>
+
+namespace cc::utf8 {
+// Decodes one UTF-8 sequence starting at `p`. Returns its length in bytes,
+// or 0 if the sequence is truncated, overlong, a surrogate or out of range.
+int decode(const char *p, const char *end, char32_t &cp);
+
+// Returns the first byte of [begin, end) that does not start a valid UTF-8
+// sequence, or nullptr if the whole range is valid. Runs of ASCII are
+// skipped 16 bytes at a time.
+const char *find_invalid(const char *begin, const char *end);
+
+// Unicode identifier classes for non-ASCII code points.
+bool is_xid_start(char32_t cp);
+bool is_xid_continue(char32_t cp);
+} // namespace cc::utf8
+
+#endif // CPPPROJECT_UTF8_H
@@ -0,0 +1,299 @@
+#include "x86_64.h"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace cc::x86_64 {
+void assembler::imm32(int32_t v) {
+  uint8_t bytes[4];
+  std::memcpy(bytes, &v, sizeof(bytes));
+  m_code.insert(m_code.end(), bytes, bytes + 4);
+}
+
+// `byte_regs` forces a REX prefix so that registers 4-7 encode spl..dil
+// rather than ah..bh in byte instructions.
+void assembler::rex(bool w, unsigned r, unsigned b, bool byte_regs) {
+  uint8_t prefix = 0x40 | (w << 3) | ((r >> 3) << 2) | (b >> 3);
+  if (prefix != 0x40 || (byte_regs && ((r & 7) >= 4 || (b & 7) >= 4))) {
+    byte(prefix);
+  }
+}
+
+void assembler::modrm(unsigned r, unsigned rm) {
+  byte(0xC0 | ((r & 7) << 3) | (rm & 7));
+}
+
+void assembler::modrm_mem(unsigned r, reg base, int32_t disp) {
+  unsigned mod;
+  if (disp == 0 && (base & 7) != rbp) {
+    mod = 0;
+  } else if (disp >= -128 && disp <= 127) {
+    mod = 1;
+  } else {
+    mod = 2;
+  }
+  byte((mod << 6) | ((r & 7) << 3) | (base & 7));
+  if ((base & 7) == rsp) {
+    byte(0x24);
+  }
+  if (mod == 1) {
+    byte(static_cast<uint8_t>(disp));
+  } else if (mod == 2) {
+    imm32(disp);
+  }
+}
+
+void assembler::mov(reg dst, reg src) {
+  rex(true, src, dst);
+  byte(0x89);
+  modrm(src, dst);
+}
+
+void assembler::mov_imm(reg dst, int64_t imm) {
+  if (imm == 0) {
+    rex(false, dst, dst);
+    byte(0x31);
+    modrm(dst, dst);
+  } else if (imm > 0 && imm <= UINT32_MAX) {
+    rex(false, 0, dst);
+    byte(0xB8 + (dst & 7));
+    imm32(static_cast<int32_t>(imm));
+  } else if (imm >= INT32_MIN && imm <= INT32_MAX) {
+    rex(true, 0, dst);
+    byte(0xC7);
+    modrm(0, dst);
+    imm32(static_cast<int32_t>(imm));
+  } else {
+    rex(true, 0, dst);
+    byte(0xB8 + (dst & 7));
+    uint8_t bytes[8];
+    std::memcpy(bytes, &imm, sizeof(bytes));
+    m_code.insert(m_code.end(), bytes, bytes + 8);
+  }
+}
+
+void assembler::load(reg dst, reg base, int32_t disp, unsigned size,
+                     bool is_signed) {
+  switch (size) {
+  case 1:
+  case 2:
+    rex(is_signed, dst, base);
+    byte(0x0F);
+    byte((is_signed ? 0xBE : 0xB6) + (size == 2));
+    break;
+  case 4:
+    rex(is_signed, dst, base);
+    byte(is_signed ? 0x63 : 0x8B);
+    break;
+  case 8:
+    rex(true, dst, base);
+    byte(0x8B);
+    break;
+  default:
+    throw std::logic_error("bad load size");
+  }
+  modrm_mem(dst, base, disp);
+}
+
+void assembler::store(reg base, int32_t disp, reg src, unsigned size) {
+  switch (size) {
+  case 1:
+    rex(false, src, base, true);
+    byte(0x88);
+    break;
+  case 2:
+    byte(0x66);
+    rex(false, src, base);
+    byte(0x89);
+    break;
+  case 4:
+  case 8:
+    rex(size == 8, src, base);
+    byte(0x89);
+    break;
+  default:
+    throw std::logic_error("bad store size");
+  }
+  modrm_mem(src, base, disp);
+}
+
+void assembler::lea(reg dst, reg base, int32_t disp) {
+  rex(true, dst, base);
+  byte(0x8D);
+  modrm_mem(dst, base, disp);
+}
+
+size_t assembler::lea_rip(reg dst) {
+  rex(true, dst, 0);
+  byte(0x8D);
+  byte(0x05 | ((dst & 7) << 3));
+  imm32(0);
+  return pos() - 4;
+}
+
+size_t assembler::load_rip(reg dst) {
+  rex(true, dst, 0);
+  byte(0x8B);
+  byte(0x05 | ((dst & 7) << 3));
+  imm32(0);
+  return pos() - 4;
+}
+
+void assembler::alu(alu_op op, reg dst, reg src) {
+  rex(true, src, dst);
+  byte((op << 3) | 0x01);
+  modrm(src, dst);
+}
+
+void assembler::alu_imm(alu_op op, reg dst, int32_t imm) {
+  rex(true, 0, dst);
+  if (imm >= -128 && imm <= 127) {
+    byte(0x83);
+    modrm(op, dst);
+    byte(static_cast<uint8_t>(imm));
+  } else {
+    byte(0x81);
+    modrm(op, dst);
+    imm32(imm);
+  }
+}
+
+void assembler::shift(shift_op op, reg dst) {
+  rex(true, 0, dst);
+  byte(0xD3);
+  modrm(op, dst);
+}
+
+void assembler::shift_imm(shift_op op, reg dst, uint8_t count) {
+  rex(true, 0, dst);
+  byte(0xC1);
+  modrm(op, dst);
+  byte(count);
+}
+
+void assembler::imul(reg dst, reg src) {
+  rex(true, dst, src);
+  byte(0x0F);
+  byte(0xAF);
+  modrm(dst, src);
+}
+
+void assembler::imul_imm(reg dst, int32_t imm) {
+  rex(true, dst, dst);
+  if (imm >= -128 && imm <= 127) {
+    byte(0x6B);
+    modrm(dst, dst);
+    byte(static_cast<uint8_t>(imm));
+  } else {
+    byte(0x69);
+    modrm(dst, dst);
+    imm32(imm);
+  }
+}
+
+void assembler::cqo() {
+  byte(0x48);
+  byte(0x99);
+}
+
+void assembler::idiv(reg divisor) {
+  rex(true, 0, divisor);
+  byte(0xF7);
+  modrm(7, divisor);
+}
+
+void assembler::neg(reg r) {
+  rex(true, 0, r);
+  byte(0xF7);
+  modrm(3, r);
+}
+
+void assembler::not_(reg r) {
+  rex(true, 0, r);
+  byte(0xF7);
+  modrm(2, r);
+}
+
+void assembler::test(reg a, reg b) {
+  rex(true, b, a);
+  byte(0x85);
+  modrm(b, a);
+}
+
+void assembler::setcc(cond c, reg dst) {
+  rex(false, 0, dst, true);
+  byte(0x0F);
+  byte(0x90 + c);
+  modrm(0, dst);
+}
+
+void assembler::movzx8(reg dst, reg src) {
+  rex(false, dst, src, true);
+  byte(0x0F);
+  byte(0xB6);
+  modrm(dst, src);
+}
+
+void assembler::movsx(reg dst, reg src, unsigned size) {
+  switch (size) {
+  case 1:
+  case 2:
+    rex(true, dst, src);
+    byte(0x0F);
+    byte(size == 1 ? 0xBE : 0xBF);
+    break;
+  case 4:
+    rex(true, dst, src);
+    byte(0x63);
+    break;
+  default:
+    throw std::logic_error("bad extension size");
+  }
+  modrm(dst, src);
+}
+
+size_t assembler::jcc(cond c) {
+  byte(0x0F);
+  byte(0x80 + c);
+  imm32(0);
+  return pos() - 4;
+}
+
+size_t assembler::jmp() {
+  byte(0xE9);
+  imm32(0);
+  return pos() - 4;
+}
+
+size_t assembler::call() {
+  byte(0xE8);
+  imm32(0);
+  return pos() - 4;
+}
+
+void assembler::patch_rel32(size_t at, size_t target) {
+  patch_imm32(at, static_cast<int32_t>(target - (at + 4)));
+}
+
+void assembler::push(reg r) {
+  rex(false, 0, r);
+  byte(0x50 + (r & 7));
+}
+
+void assembler::pop(reg r) {
+  rex(false, 0, r);
+  byte(0x58 + (r & 7));
+}
+
+size_t assembler::sub_rsp() {
+  rex(true, 0, rsp);
+  byte(0x81);
+  modrm(alu_sub, rsp);
+  imm32(0);
+  return pos() - 4;
+}
+
+void assembler::patch_imm32(size_t at, int32_t value) {
+  std::memcpy(m_code.data() + at, &value, sizeof(value));
+}
+} // namespace cc::x86_64
@@ -0,0 +1,129 @@
+#ifndef CPPPROJECT_X86_64_H
+#define CPPPROJECT_X86_64_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace cc::x86_64 {
+enum reg : uint8_t {
+  rax,
+  rcx,
+  rdx,
+  rbx,
+  rsp,
+  rbp,
+  rsi,
+  rdi,
+  r8,
+  r9,
+  r10,
+  r11,
+  r12,
+  r13,
+  r14,
+  r15,
+};
+
+// Condition codes in their encoding order.
+enum cond : uint8_t {
+  cc_o,
+  cc_no,
+  cc_b,
+  cc_ae,
+  cc_e,
+  cc_ne,
+  cc_be,
+  cc_a,
+  cc_s,
+  cc_ns,
+  cc_p,
+  cc_np,
+  cc_l,
+  cc_ge,
+  cc_le,
+  cc_g,
+};
+
+inline cond invert(cond c) { return static_cast<cond>(c ^ 1); }
+
+// Two-operand ALU instructions, numbered by their /digit in the 0x81 group.
+enum alu_op : uint8_t {
+  alu_add = 0,
+  alu_or = 1,
+  alu_and = 4,
+  alu_sub = 5,
+  alu_xor = 6,
+  alu_cmp = 7,
+};
+
+// Shifts, numbered by their /digit in the 0xC1 and 0xD3 groups.
+enum shift_op : uint8_t {
+  shift_shl = 4,
+  shift_sar = 7,
+};
+
+// Appends machine code to a growable buffer. Instructions operate on 64-bit
+// registers unless a size in bytes is given; memory operands are always
+// [base + disp].
+class assembler {
+public:
+  explicit assembler(std::vector<uint8_t> &code) : m_code(code) {}
+
+  size_t pos() const { return m_code.size(); }
+
+  void mov(reg dst, reg src);
+  void mov_imm(reg dst, int64_t imm);
+  // Sign- or zero-extends `size` bytes from memory into a 64-bit register.
+  void load(reg dst, reg base, int32_t disp, unsigned size, bool is_signed);
+  void store(reg base, int32_t disp, reg src, unsigned size);
+  void lea(reg dst, reg base, int32_t disp);
+  // `lea dst, [rip + disp32]` and `mov dst, [rip + disp32]`. Both return
+  // the offset of the displacement for the caller to relocate.
+  size_t lea_rip(reg dst);
+  size_t load_rip(reg dst);
+
+  void alu(alu_op op, reg dst, reg src);
+  void alu_imm(alu_op op, reg dst, int32_t imm);
+  // Shifts `dst` by cl.
+  void shift(shift_op op, reg dst);
+  void shift_imm(shift_op op, reg dst, uint8_t count);
+  void imul(reg dst, reg src);
+  void imul_imm(reg dst, int32_t imm);
+  void cqo();
+  void idiv(reg divisor);
+  void neg(reg r);
+  void not_(reg r);
+  void test(reg a, reg b);
+  void setcc(cond c, reg dst);
+  // Zero-extends the low byte of `src`.
+  void movzx8(reg dst, reg src);
+  // Sign-extends the low `size` bytes of `src` to 64 bits.
+  void movsx(reg dst, reg src, unsigned size);
+
+  // Jumps and calls return the offset of their rel32 field.
+  size_t jcc(cond c);
+  size_t jmp();
+  size_t call();
+  void patch_rel32(size_t at, size_t target);
+
+  void push(reg r);
+  void pop(reg r);
+  void leave() { byte(0xC9); }
+  void ret() { byte(0xC3); }
+  // `sub rsp, imm32` with an immediate to be patched later.
+  size_t sub_rsp();
+  void patch_imm32(size_t at, int32_t value);
+
+private:
+  void byte(uint8_t b) { m_code.push_back(b); }
+  void imm32(int32_t v);
+  void rex(bool w, unsigned r, unsigned b, bool byte_regs = false);
+  void modrm(unsigned r, unsigned rm);
+  void modrm_mem(unsigned r, reg base, int32_t disp);
+
+  std::vector<uint8_t> &m_code;
+};
+} // namespace cc::x86_64
+
+#endif // CPPPROJECT_X86_64_H
@@ -0,0 +1,386 @@
+// Lexer throughput gate. Lexes fixed, generated corpora in a number of
+// rounds, keeps the fastest run of each and compares tokens/s and bytes/s
+// with a recorded baseline. Interference from other processes only ever
+// slows a run down, so the fastest run varies far less between invocations
+// than the median does:
+//
+//   perf_lexer --baseline <file> [--tolerance F] [--runs N] [--record]
+//
+// A corpus fails when either rate stays below (1 - F) times its baseline
+// over k_attempts measurements.
+// --record measures and rewrites the baseline instead, noting the CPU and
+// compiler it was recorded with. Unoptimized builds exit with k_skipped,
+// which CTest reports as a skipped test.
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "file.h"
+#include "lexer.h"
+
+static constexpr int k_skipped = 77;
+static constexpr size_t k_corpus_size = size_t{4} << 20;
+static constexpr int k_attempts = 3;
+
+struct corpus {
+  std::string m_name;
+  std::string m_text;
+};
+
+struct rates {
+  double m_tokens = 0;
+  double m_bytes = 0;
+};
+
+// The raw output of mt19937_64 is fixed by the standard, unlike that of
+// the distributions, so the corpora are the same with every library.
+class generator {
+public:
+  size_t below(size_t n) { return m_engine() % n; }
+  template <typename T, size_t N> const T &pick(const T (&items)[N]) {
+    return items[below(N)];
+  }
+  std::string identifier() {
+    static const char k_chars[] = "abcdefghijklmnopqrstuvwxyz_0123456789";
+    std::string s(1, k_chars[below(26)]);
+    for (size_t n = below(12); n > 0; --n) {
+      s += k_chars[below(sizeof(k_chars) - 1)];
+    }
+    return s;
+  }
+
+private:
+  std::mt19937_64 m_engine{0x5eed};
+};
+
+static std::string c_code(generator &g) {
+  static const char *k_types[] = {"int", "long", "unsigned", "char *",
+                                  "double", "struct node *"};
+  static const char *k_ops[] = {"+", "-", "*", "/", "%", "<<", ">>", "&",
+                                "|", "^", "==", "!=", "<=", "&&", "||"};
+  std::string s;
+  while (s.size() < k_corpus_size) {
+    s += std::format("static {} {}({} a, {} b) {{\n", g.pick(k_types),
+                     g.identifier(), g.pick(k_types), g.pick(k_types));
+    for (size_t n = 1 + g.below(8); n > 0; --n) {
+      switch (g.below(4)) {
+      case 0:
+        s += std::format("  {} {} = a {} {};\n", g.pick(k_types),
+                         g.identifier(), g.pick(k_ops), g.below(100000));
+        break;
+      case 1:
+        s += std::format("  for (i = 0; i < {}; ++i) b += a[i] {} 0x{:x};",
+                         g.below(1000), g.pick(k_ops), g.below(1 << 20));
+        s += '\n';
+        break;
+      case 2:
+        s += std::format("  if ({} {} b) return \"{}\\n\";\n",
+                         g.identifier(), g.pick(k_ops), g.identifier());
+        break;
+      default:
+        s += std::format("  /* {} */ {}->{} = {}.{}f;\n", g.identifier(),
+                         g.identifier(), g.identifier(), g.below(1000),
+                         g.below(1000));
+      }
+    }
+    s += "  return a;\n}\n\n";
+  }
+  return s;
+}
+
+static std::string identifiers(generator &g) {
+  static const char *k_keywords[] = {"int",    "return", "while", "struct",
+                                     "static", "const",  "if",    "else"};
+  std::string s;
+  while (s.size() < k_corpus_size) {
+    s += g.below(4) == 0 ? g.pick(k_keywords) : g.identifier();
+    s += g.below(8) == 0 ? '\n' : ' ';
+  }
+  return s;
+}
+
+static std::string numbers(generator &g) {
+  static const char *k_suffixes[] = {"", "", "u", "l", "ul", "UL"};
+  std::string s;
+  while (s.size() < k_corpus_size) {
+    switch (g.below(4)) {
+    case 0:
+      s += std::format("{}{}", g.below(1000000000), g.pick(k_suffixes));
+      break;
+    case 1:
+      s += std::format("0x{:X}{}", g.below(1u << 31), g.pick(k_suffixes));
+      break;
+    case 2:
+      s += std::format("{}.{}e-{}", g.below(10000), g.below(10000),
+                       g.below(30));
+      break;
+    default:
+      s += std::format("0{:o}", g.below(1 << 20));
+    }
+    s += ", ";
+  }
+  return s;
+}
+
+static std::string comments(generator &g) {
+  std::string s;
+  while (s.size() < k_corpus_size) {
+    bool block = g.below(2) == 0;
+    s += block ? "/*" : "//";
+    for (size_t n = 1 + g.below(10); n > 0; --n) {
+      s += ' ';
+      s += g.identifier();
+    }
+    s += block ? " */\n" : "\n";
+    s += std::format("\"{} {}\";\n", g.identifier(), g.identifier());
+  }
+  return s;
+}
+
+static std::string utf8(generator &g) {
+  static const char *k_words[] = {"größe", "π_2", "naïve", "λ", "名前",
+                                  "x\xCC\x81", "Ωmega", "данные"};
+  std::string s;
+  while (s.size() < k_corpus_size) {
+    s += g.pick(k_words);
+    s += g.identifier();
+    s += g.below(6) == 0 ? " /* コメント */\n" : " = ";
+  }
+  return s;
+}
+
+static std::vector<corpus> make_corpora() {
+  generator g;
+  return {{"c_code", c_code(g)},
+          {"identifiers", identifiers(g)},
+          {"numbers", numbers(g)},
+          {"comments", comments(g)},
+          {"utf8", utf8(g)}};
+}
+
+static size_t lex(std::string &text) {
+  file f(text.data(), text.size());
+  cc::lexer l(f);
+  size_t tokens = 0;
+  while (l.get_next_token().m_token_class != cc::token_class::T_EOF) {
+    ++tokens;
+  }
+  return tokens;
+}
+
+// Lexes every corpus once per round, so that the runs of each corpus are
+// spread over the whole measurement instead of sharing one slow stretch.
+static std::vector<rates> measure(std::vector<corpus> &corpora, int runs) {
+  using clock = std::chrono::steady_clock;
+  std::vector<size_t> tokens;
+  for (auto &c : corpora) {
+    tokens.push_back(lex(c.m_text));
+  }
+  std::vector<double> fastest(corpora.size(),
+                              std::numeric_limits<double>::infinity());
+  for (int k = 0; k < runs; ++k) {
+    for (size_t n = 0; n < corpora.size(); ++n) {
+      auto start = clock::now();
+      lex(corpora[n].m_text);
+      fastest[n] = std::min(
+          fastest[n],
+          std::chrono::duration<double>(clock::now() - start).count());
+    }
+  }
+  std::vector<rates> measured;
+  for (size_t n = 0; n < corpora.size(); ++n) {
+    measured.push_back({tokens[n] / fastest[n],
+                        corpora[n].m_text.size() / fastest[n]});
+  }
+  return measured;
+}
+
+static std::map<std::string, rates> read_baseline(const std::string &path) {
+  std::ifstream in(path);
+  if (!in) {
+    throw std::runtime_error(std::format("Failed to open '{}'", path));
+  }
+  std::map<std::string, rates> baseline;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream fields(line);
+    std::string name;
+    rates r;
+    if (!(fields >> name >> r.m_tokens >> r.m_bytes)) {
+      throw std::runtime_error(
+          std::format("Malformed baseline line '{}' in '{}'", line, path));
+    }
+    baseline[name] = r;
+  }
+  return baseline;
+}
+
+// The CPU and compiler a baseline was recorded with, since its numbers
+// mean nothing on another host.
+static std::string host() {
+  std::ifstream in("/proc/cpuinfo");
+  std::string line;
+  std::string cpu = "unknown CPU";
+  while (std::getline(in, line)) {
+    if (line.starts_with("model name")) {
+      cpu = line.substr(line.find(':') + 2);
+      break;
+    }
+  }
+#if defined(__clang__)
+  std::string compiler = "clang " __clang_version__;
+#elif defined(__GNUC__)
+  std::string compiler = "gcc " __VERSION__;
+#else
+  std::string compiler = "unknown compiler";
+#endif
+#ifdef FMT_VERSION
+  // <format> comes from {fmt} where the standard library lacks it.
+  compiler += std::format(" with {{fmt}} {}.{}.{}", FMT_VERSION / 10000,
+                          FMT_VERSION / 100 % 100, FMT_VERSION % 100);
+#endif
+  return std::format("{}, {}", cpu, compiler);
+}
+
+static void write_baseline(const std::string &path,
+                           const std::vector<corpus> &corpora,
+                           const std::vector<rates> &measured) {
+  std::ofstream out(path, std::ios::trunc);
+  out << "# Lexer throughput of an optimized build, recorded with\n"
+         "# `perf_lexer --record`. Columns: corpus, tokens/s, bytes/s.\n"
+      << std::format("# Host: {}\n", host());
+  for (size_t k = 0; k < corpora.size(); ++k) {
+    out << std::format("{} {:.0f} {:.0f}\n", corpora[k].m_name,
+                       measured[k].m_tokens, measured[k].m_bytes);
+  }
+  if (!out) {
+    throw std::runtime_error(std::format("Failed to write '{}'", path));
+  }
+}
+
+int main(int argc, char **argv) {
+  std::string baseline_path;
+  double tolerance = 0.35;
+  int runs = 40;
+  bool record = false;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    if (arg == "--baseline" && i + 1 < argc) {
+      baseline_path = argv[++i];
+    } else if (arg == "--tolerance" && i + 1 < argc) {
+      tolerance = std::atof(argv[++i]);
+    } else if (arg == "--runs" && i + 1 < argc) {
+      runs = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--record") {
+      record = true;
+    } else {
+      baseline_path.clear();
+      break;
+    }
+  }
+  if (baseline_path.empty()) {
+    std::cerr << "usage: perf_lexer --baseline <file> [--tolerance F] "
+                 "[--runs N] [--record]"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+#ifndef __OPTIMIZE__
+  // Timings of unoptimized code say nothing about the baseline.
+  std::cout << "perf_lexer: unoptimized build, skipping" << std::endl;
+  return k_skipped;
+#endif
+
+  try {
+    auto corpora = make_corpora();
+    auto measured = measure(corpora, runs);
+    if (record) {
+      write_baseline(baseline_path, corpora, measured);
+      std::cout << std::format("perf_lexer: recorded '{}'", baseline_path)
+                << std::endl;
+      return EXIT_SUCCESS;
+    }
+
+    auto baseline = read_baseline(baseline_path);
+    auto slower = [&](size_t k) {
+      auto it = baseline.find(corpora[k].m_name);
+      return it != baseline.end() &&
+             std::min(measured[k].m_tokens / it->second.m_tokens,
+                      measured[k].m_bytes / it->second.m_bytes) <
+                 1 - tolerance;
+    };
+    // A slow stretch of a shared host can outlast every round, while a
+    // regression slows every attempt down; so a corpus only fails if it
+    // stays below the baseline when measured again.
+    for (int attempt = 1; attempt < k_attempts; ++attempt) {
+      bool any = false;
+      for (size_t k = 0; k < corpora.size(); ++k) {
+        any |= slower(k);
+      }
+      if (!any) {
+        break;
+      }
+      std::cout << "perf_lexer: below the baseline, measuring again"
+                << std::endl;
+      auto again = measure(corpora, runs);
+      for (size_t k = 0; k < corpora.size(); ++k) {
+        measured[k].m_tokens =
+            std::max(measured[k].m_tokens, again[k].m_tokens);
+        measured[k].m_bytes = std::max(measured[k].m_bytes, again[k].m_bytes);
+      }
+    }
+
+    bool ok = true;
+    std::cout << std::format("{:<12} {:>14} {:>14} {:>7} {:>14} {:>14} {:>7}",
+                             "corpus", "tokens/s", "baseline", "ratio",
+                             "bytes/s", "baseline", "ratio")
+              << std::endl;
+    for (size_t k = 0; k < corpora.size(); ++k) {
+      const auto &name = corpora[k].m_name;
+      auto it = baseline.find(name);
+      if (it == baseline.end()) {
+        std::cout << std::format("{:<12} FAIL: no baseline; rerun with "
+                                 "--record",
+                                 name)
+                  << std::endl;
+        ok = false;
+        continue;
+      }
+      const rates &now = measured[k];
+      const rates &then = it->second;
+      double token_ratio = now.m_tokens / then.m_tokens;
+      double byte_ratio = now.m_bytes / then.m_bytes;
+      bool failed = slower(k);
+      ok &= !failed;
+      std::cout << std::format("{:<12} {:>14.0f} {:>14.0f} {:>7.2f} "
+                               "{:>14.0f} {:>14.0f} {:>7.2f}{}",
+                               name, now.m_tokens, then.m_tokens, token_ratio,
+                               now.m_bytes, then.m_bytes, byte_ratio,
+                               failed ? "  FAIL" : "")
+                << std::endl;
+    }
+    if (!ok) {
+      std::cout << std::format("perf_lexer: throughput fell below {:.0f}% of "
+                               "the baseline",
+                               100 * (1 - tolerance))
+                << std::endl;
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+  } catch (const std::exception &e) {
+    std::cerr << "perf_lexer: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,212 @@
+#include "test_support.h"
+#include "x86_64.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <format>
+#include <string>
+#include <vector>
+
+using namespace cc;
+using namespace cc::test;
+using namespace cc::x86_64;
+
+namespace {
+std::vector<uint8_t> encode(void (*emit)(assembler &)) {
+  std::vector<uint8_t> code;
+  assembler a(code);
+  emit(a);
+  return code;
+}
+} // namespace
+
+TEST_CASE("Encodes instructions", "[codegen]") {
+  using bytes = std::vector<uint8_t>;
+  REQUIRE(encode([](assembler &a) { a.mov(rbp, rsp); }) ==
+          bytes{0x48, 0x89, 0xE5});
+  REQUIRE(encode([](assembler &a) { a.mov(r11, rax); }) ==
+          bytes{0x49, 0x89, 0xC3});
+  REQUIRE(encode([](assembler &a) { a.mov_imm(rax, 0); }) ==
+          bytes{0x31, 0xC0});
+  REQUIRE(encode([](assembler &a) { a.mov_imm(rcx, -1); }) ==
+          bytes{0x48, 0xC7, 0xC1, 0xFF, 0xFF, 0xFF, 0xFF});
+  REQUIRE(encode([](assembler &a) { a.load(rax, rbp, -4, 4, true); }) ==
+          bytes{0x48, 0x63, 0x45, 0xFC});
+  REQUIRE(encode([](assembler &a) { a.load(rdx, r12, 0, 1, false); }) ==
+          bytes{0x41, 0x0F, 0xB6, 0x14, 0x24});
+  REQUIRE(encode([](assembler &a) { a.store(rbp, -8, rsi, 1); }) ==
+          bytes{0x40, 0x88, 0x75, 0xF8});
+  REQUIRE(encode([](assembler &a) { a.alu_imm(alu_cmp, rax, 2); }) ==
+          bytes{0x48, 0x83, 0xF8, 0x02});
+  REQUIRE(encode([](assembler &a) { a.imul(rcx, r9); }) ==
+          bytes{0x49, 0x0F, 0xAF, 0xC9});
+  REQUIRE(encode([](assembler &a) { a.shift(shift_shl, rax); }) ==
+          bytes{0x48, 0xD3, 0xE0});
+  REQUIRE(encode([](assembler &a) { a.shift_imm(shift_sar, r9, 3); }) ==
+          bytes{0x49, 0xC1, 0xF9, 0x03});
+  REQUIRE(encode([](assembler &a) { a.setcc(cc_l, rsi); }) ==
+          bytes{0x40, 0x0F, 0x9C, 0xC6});
+  REQUIRE(encode([](assembler &a) { a.push(r12); }) == bytes{0x41, 0x54});
+}
+
+TEST_CASE("Patches jumps", "[codegen]") {
+  std::vector<uint8_t> code;
+  assembler a(code);
+  size_t at = a.jmp();
+  a.ret();
+  a.patch_rel32(at, a.pos());
+  REQUIRE(code == std::vector<uint8_t>{0xE9, 0x01, 0x00, 0x00, 0x00, 0xC3});
+}
+
+TEST_CASE("Compiled functions run", "[codegen]") {
+  auto module = compile(R"(
+    int fib(int n) { if (n < 2) return n; return fib(n - 1) + fib(n - 2); }
+    long sum(long n, long step) {
+      long s = 0;
+      for (long i = 0; i < n; i++) { if (i % 3 == 0) continue; s += i * step; }
+      return s;
+    }
+    int squares(int n) {
+      int a[10]; int *p = a; int t = 0;
+      for (int i = 0; i < 10; ++i) a[i] = i * i;
+      while (p < a + 10) t += *p++;
+      return t + (n > 3 && n < 10) * 1000 + (n == 0 || n == 2) * 100;
+    }
+    int divide(int a, int b) { return a / b * 100 + a % b; }
+    typedef char byte;
+    int narrow(int n) { byte c = n; c += 1; return c; }
+    int wrap(int n) {
+      char c = n; int r = c++; char d = -128; int s = d--;
+      return r * 1000 + s + c - d;
+    }
+    long shift(long a, int b) {
+      long x = a << 3; x >>= b; int y = -a; y <<= b + 1;
+      return x + (y >> 1) + (1 + 2 << 3) + (a << b << b);
+    }
+  )");
+  loaded_module code(module);
+  REQUIRE(code.call("fib", 20) == 6765);
+  REQUIRE(code.call("sum", 10, 2) == 54);
+  REQUIRE(code.call("squares", 5) == 1285);
+  REQUIRE(code.call("squares", 2) == 385);
+  REQUIRE(code.call("divide", -47, 5) == -902);
+  REQUIRE(code.call("narrow", 127) == -128);
+  REQUIRE(code.call("shift", 5, 1) == 54);
+  REQUIRE(code.call("shift", -64, 3) == -3624);
+  REQUIRE(code.call("wrap", 127) == 126617);
+}
+
+TEST_CASE("Typedef names shadowed in a for loop come back after it",
+          "[codegen]") {
+  auto module = compile(R"(
+    typedef int T;
+    int f(int n) { for (int T = 0; T < n; T++); T x = 3; return x; }
+    int g(int n) { for (int T = 0; T < n; T++) { } T y = 4; return y; }
+  )");
+  loaded_module code(module);
+  REQUIRE(code.call("f", 2) == 3);
+  REQUIRE(code.call("g", 2) == 4);
+}
+
+TEST_CASE("Parameter qualifiers only bind inside the definition",
+          "[codegen]") {
+  auto module = compile(R"(
+    int f(const int);
+    int f(int x) { x = x + 1; return x; }
+    long g(long *);
+    long g(long *const p) { return *p; }
+  )");
+  loaded_module code(module);
+  REQUIRE(code.call("f", 41) == 42);
+  long value = 7;
+  REQUIRE(code.call("g", reinterpret_cast<long>(&value)) == 7);
+  REQUIRE_THROWS_WITH(compile("int f(int);\nint f(const int x) { x = 1; }"),
+                      "Expression is not assignable at 2:24");
+}
+
+TEST_CASE("Folds constant conditions without emitting code", "[codegen]") {
+  for (bool optimize : {false, true}) {
+    auto module = compile(R"(
+      int f();
+      int x = 1 ? 2 : f();
+      long y = 0 ? f() : 0 || 3;
+      int z = 0 && f() || 1 && 0;
+      char a[1 && 2 ? 5 : 1];
+      char b[0 || 0 ? 1 : 3];
+    )",
+                          optimize);
+    REQUIRE(module.section(section_id::text).empty());
+    REQUIRE(module.relocations().empty());
+    REQUIRE(module.bss_size() == 8);
+    jit_image image(module);
+    REQUIRE(*static_cast<int *>(image.symbol("x")) == 2);
+    REQUIRE(*static_cast<long *>(image.symbol("y")) == 1);
+    REQUIRE(*static_cast<int *>(image.symbol("z")) == 0);
+
+    // g is never defined, so loading fails if a call to it is emitted.
+    loaded_module code(compile(R"(
+      int g();
+      long h(long n) {
+        char c[2 > 1 ? 3 : g()];
+        return (1 ? n : g()) * 100 + (0 && g()) + (1 || g()) * 10 +
+               (1 && n) + sizeof(int[1 ? 2 : 3]);
+      }
+    )",
+                               optimize));
+    REQUIRE(code.call("h", 4) == 419);
+  }
+}
+
+TEST_CASE("Loads through pointers before using them", "[codegen]") {
+  auto module = compile(R"(
+    long deref(long x) { long *p = &x; return *p; }
+    long quotient(long x, long d) { long *p = &x; return *p / d; }
+  )");
+  loaded_module code(module);
+  REQUIRE(code.call("deref", 42) == 42);
+  REQUIRE(code.call("quotient", 42, 6) == 7);
+}
+
+TEST_CASE("Deep expressions spill registers", "[codegen]") {
+  std::string expr = "a";
+  for (int i = 0; i < 20; ++i) {
+    expr = std::format("(b - {} * ({}))", i, expr);
+  }
+  auto module = compile("long f(long a, long b) { return " + expr + "; }");
+  long expected = 3;
+  for (int i = 0; i < 20; ++i) {
+    expected = 5 - i * expected;
+  }
+  REQUIRE(loaded_module(module).call("f", 3, 5) == expected);
+}
+
+TEST_CASE("Records symbols and relocations", "[codegen]") {
+  auto module = compile(R"(
+    int puts(const char *s);
+    extern int errno_value;
+    static int counter = 3;
+    long total;
+    int main() { counter++; total = errno_value; return puts("hi"); }
+  )");
+  REQUIRE(module.section(section_id::data).size() == 4);
+  REQUIRE(module.bss_size() == 8);
+  REQUIRE(module.section(section_id::rodata).size() == 3);
+  int gotpcrel = 0;
+  int plt32 = 0;
+  for (const auto &r : module.relocations()) {
+    gotpcrel += r.m_type == reloc_type::gotpcrel;
+    plt32 += r.m_type == reloc_type::plt32;
+  }
+  REQUIRE(gotpcrel == 1);
+  REQUIRE(plt32 == 1);
+}
+
+TEST_CASE("Reports parse errors with locations", "[codegen]") {
+  REQUIRE_THROWS_WITH(compile("int f() {\n  return 1\n}"),
+                      "Expected ';' at 3:1");
+  REQUIRE_THROWS_WITH(compile("int f() { return y; }"),
+                      "Undeclared identifier 'y' at 1:18");
+  REQUIRE_THROWS_WITH(compile("int f(int a);\nlong f(int a);"),
+                      "Conflicting types for 'f' at 2:14");
+  REQUIRE_THROWS_WITH(compile("unsigned x;"),
+                      "'unsigned' is not supported at 1:1");
+}
@@ -0,0 +1,144 @@
+#include "elf_writer.h"
+#include "test_support.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <elf.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <string>
+#include <vector>
+
+using namespace cc;
+using namespace cc::test;
+
+namespace {
+// A read-only view over an object produced by build_object.
+class elf_view {
+public:
+  explicit elf_view(std::vector<uint8_t> image) : m_image(std::move(image)) {
+    REQUIRE(m_image.size() >= sizeof(Elf64_Ehdr));
+    std::memcpy(&m_header, m_image.data(), sizeof(m_header));
+  }
+
+  const Elf64_Ehdr &header() const { return m_header; }
+
+  Elf64_Shdr section(size_t index) const {
+    Elf64_Shdr sh;
+    std::memcpy(&sh, m_image.data() + m_header.e_shoff + index * sizeof(sh),
+                sizeof(sh));
+    return sh;
+  }
+
+  const Elf64_Shdr *find(std::string_view name) {
+    Elf64_Shdr names = section(m_header.e_shstrndx);
+    for (size_t i = 0; i < m_header.e_shnum; ++i) {
+      m_found = section(i);
+      if (string_at(names, m_found.sh_name) == name) {
+        return &m_found;
+      }
+    }
+    return nullptr;
+  }
+
+  std::string_view string_at(const Elf64_Shdr &table, uint32_t offset) const {
+    return reinterpret_cast<const char *>(m_image.data() + table.sh_offset +
+                                          offset);
+  }
+
+  template <typename T> std::vector<T> entries(const Elf64_Shdr &sh) const {
+    std::vector<T> out(sh.sh_size / sizeof(T));
+    std::memcpy(out.data(), m_image.data() + sh.sh_offset, sh.sh_size);
+    return out;
+  }
+
+private:
+  std::vector<uint8_t> m_image;
+  Elf64_Ehdr m_header;
+  Elf64_Shdr m_found;
+};
+
+const char *k_program = R"(
+  int printf(const char *fmt, ...);
+  static int counter = 40;
+  long total;
+  static int bump() { return ++counter; }
+  int main() {
+    bump();
+    total = counter + 1;
+    printf("%ld %s\n", total, "done");
+    return total - 42;
+  }
+)";
+} // namespace
+
+TEST_CASE("Writes a well-formed relocatable object", "[elf]") {
+  elf_view elf(elf::build_object(compile(k_program)));
+  const auto &h = elf.header();
+  REQUIRE(std::memcmp(h.e_ident, ELFMAG, SELFMAG) == 0);
+  REQUIRE(h.e_ident[EI_CLASS] == ELFCLASS64);
+  REQUIRE(h.e_type == ET_REL);
+  REQUIRE(h.e_machine == EM_X86_64);
+
+  const Elf64_Shdr *bss = elf.find(".bss");
+  REQUIRE(bss);
+  REQUIRE(bss->sh_type == SHT_NOBITS);
+  REQUIRE(bss->sh_size == 8);
+  REQUIRE(elf.find(".rela.text"));
+  REQUIRE_FALSE(elf.find(".rela.data"));
+  REQUIRE(elf.find(".note.GNU-stack"));
+
+  Elf64_Shdr symtab = *elf.find(".symtab");
+  Elf64_Shdr strtab = elf.section(symtab.sh_link);
+  auto symbols = elf.entries<Elf64_Sym>(symtab);
+  for (size_t i = 1; i < symbols.size(); ++i) {
+    bool is_local = ELF64_ST_BIND(symbols[i].st_info) == STB_LOCAL;
+    REQUIRE(is_local == (i < symtab.sh_info));
+    std::string_view name = elf.string_at(strtab, symbols[i].st_name);
+    REQUIRE_FALSE(name.starts_with(".L"));
+    if (name == "printf") {
+      REQUIRE(symbols[i].st_shndx == SHN_UNDEF);
+      REQUIRE_FALSE(is_local);
+    } else if (name == "bump" || name == "counter") {
+      REQUIRE(is_local);
+    } else if (name == "main") {
+      REQUIRE(ELF64_ST_TYPE(symbols[i].st_info) == STT_FUNC);
+      REQUIRE(symbols[i].st_size > 0);
+    }
+  }
+
+  auto relocations = elf.entries<Elf64_Rela>(*elf.find(".rela.text"));
+  bool has_plt = false;
+  for (const auto &r : relocations) {
+    REQUIRE(ELF64_R_SYM(r.r_info) < symbols.size());
+    has_plt |= ELF64_R_TYPE(r.r_info) == R_X86_64_PLT32;
+  }
+  REQUIRE(has_plt);
+}
+
+TEST_CASE("Written objects link with the system toolchain", "[elf]") {
+  if (std::system("cc --version > /dev/null 2>&1") != 0) {
+    WARN("no system C compiler to link with");
+    return;
+  }
+  auto dir = std::filesystem::temp_directory_path() /
+             std::format("acc_elf_{}", getpid());
+  std::filesystem::create_directories(dir);
+  auto object = (dir / "prog.o").string();
+  auto binary = (dir / "prog").string();
+  auto out = (dir / "out.txt").string();
+  elf::write_object(compile(k_program), object);
+
+  REQUIRE(std::system(std::format("cc -o {} {}", binary, object).c_str()) ==
+          0);
+  int status = std::system(std::format("{} > {}", binary, out).c_str());
+  REQUIRE(WIFEXITED(status));
+  REQUIRE(WEXITSTATUS(status) == 0);
+  file result(out);
+  REQUIRE(std::string_view(result.begin(), result.size()) == "42 done\n");
+  std::filesystem::remove_all(dir);
+}
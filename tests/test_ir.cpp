@@ -0,0 +1,234 @@
+#include "ir.h"
+#include "ir_builder.h"
+#include "regalloc.h"
+#include "test_support.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <format>
+#include <string>
+#include <vector>
+
+using namespace cc;
+
+namespace {
+struct compiled {
+  object_module m_module;
+  ir::function m_last;
+};
+
+compiled compile(std::string source, bool optimize = true) {
+  compiled out;
+  ir::builder gen(out.m_module, optimize);
+  test::parse(source, gen);
+  out.m_last = gen.last_function();
+  return out;
+}
+
+size_t count(const ir::function &fn, ir::opcode op) {
+  size_t n = 0;
+  for (const ir::inst &i : fn.m_insts) {
+    n += i.m_op == op;
+  }
+  return n;
+}
+
+// Checks that no two pieces share a register at the same time and that
+// nothing stays in a caller-saved register across a call.
+void check_allocation(const ir::function &fn,
+                      const x86_64::allocation &alloc) {
+  std::vector<const x86_64::interval *> by_reg[16];
+  for (const auto &piece : alloc.m_intervals) {
+    REQUIRE(piece.m_start < piece.m_end);
+    if (piece.m_reg != x86_64::k_spilled) {
+      by_reg[piece.m_reg].push_back(&piece);
+    }
+  }
+  for (auto &pieces : by_reg) {
+    std::ranges::sort(pieces, {}, &x86_64::interval::m_start);
+    for (size_t k = 1; k < pieces.size(); ++k) {
+      REQUIRE(pieces[k - 1]->m_end <= pieces[k]->m_start);
+    }
+  }
+  for (ir::ref n = 0; n < fn.m_insts.size(); ++n) {
+    if (fn.m_insts[n].m_op != ir::opcode::call) {
+      continue;
+    }
+    for (const auto &piece : alloc.m_intervals) {
+      if (piece.m_start <= 2 * n && piece.m_end >= 2 * n + 2 &&
+          piece.m_reg != x86_64::k_spilled) {
+        REQUIRE(x86_64::is_callee_saved(x86_64::reg(piece.m_reg)));
+      }
+    }
+  }
+}
+
+const char *k_functions = R"(
+  int fib(int n) { if (n < 2) return n; return fib(n - 1) + fib(n - 2); }
+  long sum(long n, long step) {
+    long s = 0;
+    for (long i = 0; i < n; i++) { if (i % 3 == 0) continue; s += i * step; }
+    return s;
+  }
+  int squares(int n) {
+    int a[10]; int *p = a; int t = 0;
+    for (int i = 0; i < 10; ++i) a[i] = i * i;
+    while (p < a + 10) t += *p++;
+    return t + (n > 3 && n < 10) * 1000 + (n == 0 || n == 2) * 100;
+  }
+  int divide(int a, int b) { return a / b * 100 + a % b; }
+  typedef char byte;
+  int narrow(int n) { byte c = n; c += 1; return c; }
+  int wrap(int n) {
+    char c = n; int r = c++; char d = -128; int s = d--;
+    return r * 1000 + s + c - d;
+  }
+  long shift(long a, int b) {
+    long x = a << 3; x >>= b; int y = -a; y <<= b + 1;
+    return x + (y >> 1) + (1 + 2 << 3) + (a << b << b);
+  }
+  long swap(long a, long b) {
+    long i = 0;
+    while (i < 3) { long t = a; a = b; b = t; i++; }
+    return a * 10 + b;
+  }
+)";
+} // namespace
+
+TEST_CASE("Promotes locals to SSA values", "[ir]") {
+  auto out = compile(R"(
+    int f(int n) {
+      int s = 0;
+      for (int i = 0; i < n; i++) s += i;
+      return s;
+    }
+  )");
+  const ir::function &fn = out.m_last;
+  REQUIRE(count(fn, ir::opcode::load_slot) == 0);
+  REQUIRE(count(fn, ir::opcode::store_slot) == 0);
+  REQUIRE(count(fn, ir::opcode::phi) == 2);
+  for (uint32_t b = 0; b < fn.m_blocks.size(); ++b) {
+    REQUIRE(ir::is_terminator(fn.terminator(b).m_op));
+  }
+}
+
+TEST_CASE("Keeps locals whose address is taken in memory", "[ir]") {
+  auto out =
+      compile("long f() { long x = 1; long *p = &x; *p = 5; return x; }");
+  REQUIRE(count(out.m_last, ir::opcode::load_slot) == 1);
+  REQUIRE(test::loaded_module(out.m_module).call("f") == 5);
+}
+
+TEST_CASE("Folds constants through promoted locals", "[ir]") {
+  auto out = compile(R"(
+    int f(int n) { int a = 2; int b = a * 3; int unused = n * 5; return b + 1; }
+  )");
+  const ir::function &fn = out.m_last;
+  REQUIRE(count(fn, ir::opcode::mul) == 0);
+  REQUIRE(count(fn, ir::opcode::add) == 0);
+  REQUIRE(count(fn, ir::opcode::param) == 0);
+  REQUIRE(fn.m_insts[fn.terminator(0).m_a].m_op == ir::opcode::constant);
+  REQUIRE(fn.m_insts[fn.terminator(0).m_a].m_imm == 7);
+}
+
+TEST_CASE("Optimized functions run", "[ir]") {
+  for (bool optimize : {false, true}) {
+    auto out = compile(k_functions, optimize);
+    test::loaded_module code(out.m_module);
+    REQUIRE(code.call("fib", 20) == 6765);
+    REQUIRE(code.call("sum", 10, 2) == 54);
+    REQUIRE(code.call("squares", 5) == 1285);
+    REQUIRE(code.call("squares", 2) == 385);
+    REQUIRE(code.call("divide", -47, 5) == -902);
+    REQUIRE(code.call("narrow", 127) == -128);
+    REQUIRE(code.call("swap", 1, 2) == 21);
+    REQUIRE(code.call("shift", 5, 1) == 54);
+    REQUIRE(code.call("shift", -64, 3) == -3624);
+    REQUIRE(code.call("wrap", 127) == 126617);
+  }
+}
+
+TEST_CASE("Lays loops out after their header", "[ir]") {
+  auto out = compile(R"(
+    long f(long n) {
+      long s = 0;
+      for (long i = 0; i < n; i++) s += i;
+      return s;
+    }
+  )");
+  const ir::function &fn = out.m_last;
+  int back_edges = 0;
+  for (uint32_t b = 0; b < fn.m_blocks.size(); ++b) {
+    ir::for_each_successor(fn, b, [&](uint32_t s) { back_edges += s <= b; });
+  }
+  REQUIRE(back_edges == 1);
+}
+
+TEST_CASE("Keeps loop values in registers", "[regalloc]") {
+  auto out = compile(R"(
+    long f(long n, long step) {
+      long s = 0;
+      for (long i = 0; i < n; i++) { if (i % 3 == 0) continue; s += i * step; }
+      return s;
+    }
+  )");
+  auto alloc = x86_64::allocate_registers(out.m_last);
+  check_allocation(out.m_last, alloc);
+  REQUIRE(alloc.m_spill_slots == 0);
+  REQUIRE(alloc.m_callee_saved == 0);
+}
+
+TEST_CASE("Keeps values live across calls in callee-saved registers",
+          "[regalloc]") {
+  auto out = compile(R"(
+    long g(long x);
+    long f(long a, long b) { long c = g(a); return a + b + c + g(b); }
+  )");
+  auto alloc = x86_64::allocate_registers(out.m_last);
+  check_allocation(out.m_last, alloc);
+  REQUIRE(alloc.m_callee_saved != 0);
+}
+
+TEST_CASE("Spills when registers run out", "[regalloc]") {
+  std::string source = "long f(long a, long b) {\n";
+  for (int k = 0; k < 16; ++k) {
+    source += std::format("  long v{} = a * {} + b;\n", k, k + 1);
+  }
+  source += "  for (long i = 0; i < 3; i++) {\n";
+  for (int k = 0; k < 16; ++k) {
+    source += std::format("    v{} = v{} + v{};\n", k, (k + 5) % 16, k);
+  }
+  source += "  }\n  return v0";
+  for (int k = 1; k < 16; ++k) {
+    source += std::format(" + v{} * {}", k, k);
+  }
+  source += ";\n}\n";
+  auto out = compile(source);
+  auto alloc = x86_64::allocate_registers(out.m_last);
+  check_allocation(out.m_last, alloc);
+  REQUIRE(alloc.m_spill_slots > 0);
+
+  long v[16];
+  for (long k = 0; k < 16; ++k) {
+    v[k] = 7 * (k + 1) - 2;
+  }
+  for (int i = 0; i < 3; ++i) {
+    for (int k = 0; k < 16; ++k) {
+      v[k] = v[(k + 5) % 16] + v[k];
+    }
+  }
+  long expected = v[0];
+  for (long k = 1; k < 16; ++k) {
+    expected += v[k] * k;
+  }
+  REQUIRE(test::loaded_module(out.m_module).call("f", 7, -2) == expected);
+}
+
+TEST_CASE("Dumps functions as text", "[ir]") {
+  auto out = compile("int f(int a) { return a + 1; }");
+  REQUIRE(ir::dump(out.m_last) == "b0:\n"
+                                  "  %0 = const 1\n"
+                                  "  %1 = param 0\n"
+                                  "  %2 = add %1, %0\n"
+                                  "  ret %2\n");
+}
@@ -0,0 +1,81 @@
+#include "jit.h"
+#include "test_support.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+using namespace cc;
+using namespace cc::test;
+
+namespace {
+// The permissions column of /proc/self/maps for the mapping holding `p`.
+std::string permissions(const void *p) {
+  auto address = reinterpret_cast<uintptr_t>(p);
+  std::ifstream maps("/proc/self/maps");
+  std::string line;
+  while (std::getline(maps, line)) {
+    unsigned long lo, hi;
+    char perms[5];
+    if (std::sscanf(line.c_str(), "%lx-%lx %4s", &lo, &hi, perms) == 3 &&
+        lo <= address && address < hi) {
+      return perms;
+    }
+  }
+  return "";
+}
+} // namespace
+
+TEST_CASE("Runs main in memory", "[jit]") {
+  jit_image image(compile("int main() { return 6 * 7; }"));
+  REQUIRE(image.run_main(0, nullptr) == 42);
+}
+
+TEST_CASE("Passes arguments to main", "[jit]") {
+  jit_image image(compile(R"(
+    int main(int argc, char **argv) { return argc * 10 + argv[1][0] - '0'; }
+  )"));
+  char arg0[] = "prog";
+  char arg1[] = "7";
+  char *argv[] = {arg0, arg1, nullptr};
+  REQUIRE(image.run_main(2, argv) == 27);
+}
+
+TEST_CASE("Resolves libc symbols and module data", "[jit]") {
+  jit_image image(compile(R"(
+    long strlen(const char *s);
+    int atoi(const char *s);
+    extern char **environ;
+    static int base = 100;
+    long total;
+    long f() {
+      total = strlen("hello") + base;
+      return total + atoi("20") + (environ != 0);
+    }
+  )"));
+  auto *f = reinterpret_cast<long (*)()>(image.symbol("f"));
+  REQUIRE(f);
+  REQUIRE(f() == 126);
+  REQUIRE(*static_cast<long *>(image.symbol("total")) == 105);
+  REQUIRE(image.symbol("base") == nullptr);
+}
+
+TEST_CASE("Maps text read+execute and never writable", "[jit]") {
+  jit_image image(compile("int answer() { return 42; } long counter;"));
+  REQUIRE(permissions(image.symbol("answer")).substr(0, 3) == "r-x");
+  REQUIRE(permissions(image.symbol("counter")).substr(0, 3) == "rw-");
+}
+
+TEST_CASE("Uses a custom resolver", "[jit]") {
+  static auto twice = +[](long x) { return 2 * x; };
+  jit_image image(compile("long twice(long x); long f() { return twice(21); }"),
+                  [](std::string_view name) -> void * {
+                    return name == "twice" ? reinterpret_cast<void *>(twice)
+                                           : nullptr;
+                  });
+  REQUIRE(reinterpret_cast<long (*)()>(image.symbol("f"))() == 42);
+  REQUIRE_THROWS_WITH(
+      jit_image(compile("int nope(); int main() { return nope(); }")),
+      "Undefined symbol 'nope'");
+}
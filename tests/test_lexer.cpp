@@ -3,6 +3,9 @@
 #include "lexer.h"
 #include <catch2/catch_test_macros.hpp>
 
+#include <filesystem>
+#include <fstream>
+
 TEST_CASE("get_next_token multichar", "[lexer]") {
   char test_data[] =
       "... >>= <<= == != ++ -- && || += -= *= /= %= &= ^= |= <= >=";
@@ -250,3 +253,239 @@ int main() {
   t = l.get_next_token();
   REQUIRE(t.m_token_class == cc::token_class::T_EOF);
 }
+
+TEST_CASE("get_next_token windowed file", "[lexer]") {
+  auto path = std::filesystem::temp_directory_path() / "acc_windowed.c";
+  const int count = 5000;
+  {
+    std::ofstream out(path);
+    for (int i = 0; i < count; ++i) {
+      out << "identifier_" << i << " = " << i << ";\n";
+    }
+  }
+  file f(path.string(), 4096);
+  REQUIRE(f.is_windowed());
+  cc::lexer l(f);
+  for (int i = 0; i < count; ++i) {
+    auto t = l.get_next_token();
+    REQUIRE(t.m_token_class == cc::token_class::IDENTIFIER);
+    REQUIRE(t.m_value == "identifier_" + std::to_string(i));
+    REQUIRE(l.get_next_token().m_token_class == static_cast<int>('='));
+    t = l.get_next_token();
+    REQUIRE(t.m_value == std::to_string(i));
+    REQUIRE(l.get_next_token().m_token_class == static_cast<int>(';'));
+  }
+  REQUIRE(l.get_next_token().m_token_class == cc::token_class::T_EOF);
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("get_next_token utf-8 identifiers", "[lexer]") {
+  char test_data[] = "größe = π_2 + x\xCC\x81 /* コメント */ \"naïve\" 'é'";
+  file f(test_data, sizeof(test_data) - 1);
+  cc::lexer l(f);
+
+  auto t = l.get_next_token();
+  REQUIRE(t.m_token_class == cc::token_class::IDENTIFIER);
+  REQUIRE(t.m_value == "größe");
+  REQUIRE(l.get_next_token().m_token_class == static_cast<int>('='));
+  t = l.get_next_token();
+  REQUIRE(t.m_token_class == cc::token_class::IDENTIFIER);
+  REQUIRE(t.m_value == "π_2");
+  REQUIRE(l.get_next_token().m_token_class == static_cast<int>('+'));
+  // U+0301 COMBINING ACUTE ACCENT may continue but not start an identifier.
+  t = l.get_next_token();
+  REQUIRE(t.m_token_class == cc::token_class::IDENTIFIER);
+  REQUIRE(t.m_value == "x\xCC\x81");
+  t = l.get_next_token();
+  REQUIRE(t.m_token_class == cc::token_class::STRING_LITERAL);
+  REQUIRE(t.m_value == "\"naïve\"");
+  t = l.get_next_token();
+  REQUIRE(t.m_token_class == cc::token_class::CHAR_CONSTANT);
+  REQUIRE(t.m_value == "'é'");
+}
+
+TEST_CASE("get_next_token invalid utf-8", "[lexer]") {
+  std::vector<std::string> invalid = {
+      "\xCC\x81",             // combining mark cannot start an identifier
+      "a\xC3",                // truncated sequence
+      "\"\xC0\xAF\"",         // overlong encoding
+      "/* \xED\xA0\x80 */ x", // surrogate
+      "\"abc\xFF\"",          // invalid lead byte
+      "\xE2\x82\xAC",         // U+20AC EURO SIGN is not XID_Start
+  };
+  for (const auto &s : invalid) {
+    file f(const_cast<char *>(s.c_str()), s.size());
+    cc::lexer l(f);
+    REQUIRE_THROWS_AS(l.get_next_token(), std::runtime_error);
+  }
+}
+
+TEST_CASE("get_next_token line splices", "[lexer]") {
+  char test_data[] = "ret\\\nurn ident\\\r\nifier \"split \\\nstring\" +\\\n= "
+                     "// comment \\\ncontinued\nafter";
+  file f(test_data, sizeof(test_data) - 1);
+  cc::lexer l(f);
+
+  auto t = l.get_next_token();
+  REQUIRE(t.m_token_class == cc::token_class::KEYWORD);
+  REQUIRE(t.m_value == "return");
+  t = l.get_next_token();
+  REQUIRE(t.m_token_class == cc::token_class::IDENTIFIER);
+  REQUIRE(t.m_value == "identifier");
+  t = l.get_next_token();
+  REQUIRE(t.m_token_class == cc::token_class::STRING_LITERAL);
+  REQUIRE(t.m_value == "\"split string\"");
+  t = l.get_next_token();
+  REQUIRE(t.m_token_class == cc::token_class::ADD_ASSIGN);
+  REQUIRE(t.m_value == "+=");
+  t = l.get_next_token();
+  REQUIRE(t.m_token_class == cc::token_class::IDENTIFIER);
+  REQUIRE(t.m_value == "after");
+  REQUIRE(l.get_next_token().m_token_class == cc::token_class::T_EOF);
+}
+
+TEST_CASE("get_next_token unspliced tokens are views", "[lexer]") {
+  char test_data[] = "first \\\n second";
+  file f(test_data, sizeof(test_data) - 1);
+  cc::lexer l(f);
+
+  auto t = l.get_next_token();
+  REQUIRE(t.m_value.data() == test_data);
+  t = l.get_next_token();
+  REQUIRE(t.m_value == "second");
+  REQUIRE(t.m_value.data() == test_data + 9);
+}
+
+TEST_CASE("get_next_token trigraphs", "[lexer]") {
+  char test_data[] = "?\?< a?\?(1?\?) ?\?! \"?\?=\" ?\?/\nb ?\?>";
+  file f(test_data, sizeof(test_data) - 1);
+  cc::lexer l(f);
+
+  REQUIRE(l.get_next_token().m_token_class == static_cast<int>('{'));
+  REQUIRE(l.get_next_token().m_value == "a");
+  REQUIRE(l.get_next_token().m_token_class == static_cast<int>('['));
+  REQUIRE(l.get_next_token().m_value == "1");
+  REQUIRE(l.get_next_token().m_token_class == static_cast<int>(']'));
+  REQUIRE(l.get_next_token().m_token_class == static_cast<int>('|'));
+  auto t = l.get_next_token();
+  REQUIRE(t.m_token_class == cc::token_class::STRING_LITERAL);
+  REQUIRE(t.m_value == "\"#\"");
+  REQUIRE(l.get_next_token().m_value == "b");
+  REQUIRE(l.get_next_token().m_token_class == static_cast<int>('}'));
+  REQUIRE(l.get_next_token().m_token_class == cc::token_class::T_EOF);
+}
+
+TEST_CASE("get_next_token dialect keywords", "[lexer]") {
+  char test_data[] = "register inline _Static_assert nullptr";
+  auto classes = [&]<typename Dialect>() {
+    file f(test_data, sizeof(test_data) - 1);
+    cc::basic_lexer<Dialect> l(f);
+    std::vector<int> result;
+    for (int i = 0; i < 4; ++i) {
+      result.push_back(l.get_next_token().m_token_class);
+    }
+    return result;
+  };
+  using cc::token_class::IDENTIFIER;
+  using cc::token_class::KEYWORD;
+  REQUIRE(classes.operator()<cc::c89>() ==
+          std::vector<int>{KEYWORD, IDENTIFIER, IDENTIFIER, IDENTIFIER});
+  REQUIRE(classes.operator()<cc::c99>() ==
+          std::vector<int>{KEYWORD, KEYWORD, IDENTIFIER, IDENTIFIER});
+  REQUIRE(classes.operator()<cc::c11>() ==
+          std::vector<int>{KEYWORD, KEYWORD, KEYWORD, IDENTIFIER});
+  REQUIRE(classes.operator()<cc::c23>() ==
+          std::vector<int>{KEYWORD, KEYWORD, KEYWORD, KEYWORD});
+}
+
+TEST_CASE("get_next_token c89 has no digraphs or line comments", "[lexer]") {
+  char test_data[] = "<: %> // x";
+  file f(test_data, sizeof(test_data) - 1);
+  cc::basic_lexer<cc::c89> l(f);
+  REQUIRE(l.get_next_token().m_token_class == static_cast<int>('<'));
+  REQUIRE(l.get_next_token().m_token_class == static_cast<int>(':'));
+  REQUIRE(l.get_next_token().m_token_class == static_cast<int>('%'));
+  REQUIRE(l.get_next_token().m_token_class == static_cast<int>('>'));
+  REQUIRE(l.get_next_token().m_token_class == static_cast<int>('/'));
+  REQUIRE(l.get_next_token().m_token_class == static_cast<int>('/'));
+  REQUIRE(l.get_next_token().m_value == "x");
+}
+
+TEST_CASE("get_next_token c99 digraphs", "[lexer]") {
+  char test_data[] = "<: :> <% %>";
+  file f(test_data, sizeof(test_data) - 1);
+  cc::lexer l(f);
+  REQUIRE(l.get_next_token().m_token_class == static_cast<int>('['));
+  REQUIRE(l.get_next_token().m_token_class == static_cast<int>(']'));
+  REQUIRE(l.get_next_token().m_token_class == static_cast<int>('{'));
+  REQUIRE(l.get_next_token().m_token_class == static_cast<int>('}'));
+}
+
+TEST_CASE("get_next_token c23 binary constants and no trigraphs", "[lexer]") {
+  char test_data[] = "0b1011u \"?\?=\"";
+  file f(test_data, sizeof(test_data) - 1);
+  cc::basic_lexer<cc::c23> l(f);
+  auto t = l.get_next_token();
+  REQUIRE(t.m_token_class == cc::token_class::BIN_CONSTANT);
+  REQUIRE(t.m_value == "0b1011u");
+  t = l.get_next_token();
+  REQUIRE(t.m_token_class == cc::token_class::STRING_LITERAL);
+  REQUIRE(t.m_value == "\"?\?=\"");
+}
+
+TEST_CASE("get_next_token highlighting keeps comments", "[lexer]") {
+  char test_data[] = "int /* block */ x; // line";
+  file f(test_data, sizeof(test_data) - 1);
+  cc::basic_lexer<cc::c23_highlight> l(f);
+  REQUIRE(l.get_next_token().m_value == "int");
+  auto t = l.get_next_token();
+  REQUIRE(t.m_token_class == cc::token_class::COMMENT);
+  REQUIRE(t.m_value == "/* block */");
+  REQUIRE(l.get_next_token().m_value == "x");
+  REQUIRE(l.get_next_token().m_token_class == static_cast<int>(';'));
+  t = l.get_next_token();
+  REQUIRE(t.m_token_class == cc::token_class::COMMENT);
+  REQUIRE(t.m_value == "// line");
+  REQUIRE(l.get_next_token().m_token_class == cc::token_class::T_EOF);
+}
+
+TEST_CASE("get_next_token long identifiers and literals", "[lexer]") {
+  std::string ident(100, 'a');
+  ident += "_Z9";
+  std::string body;
+  for (int i = 0; i < 20; ++i) {
+    body += "text \\\" with \\\\ escapes \\n ";
+  }
+  std::string text = ident + " \"" + body + "\" '\\x41' \"" + body +
+                     "\\\ncontinued\" " + ident;
+  file f(text.data(), text.size());
+  cc::lexer l(f);
+
+  auto t = l.get_next_token();
+  REQUIRE(t.m_token_class == cc::token_class::IDENTIFIER);
+  REQUIRE(t.m_value == ident);
+  t = l.get_next_token();
+  REQUIRE(t.m_token_class == cc::token_class::STRING_LITERAL);
+  REQUIRE(t.m_value == "\"" + body + "\"");
+  t = l.get_next_token();
+  REQUIRE(t.m_token_class == cc::token_class::CHAR_CONSTANT);
+  REQUIRE(t.m_value == "'\\x41'");
+  t = l.get_next_token();
+  REQUIRE(t.m_token_class == cc::token_class::STRING_LITERAL);
+  REQUIRE(t.m_value == "\"" + body + "continued\"");
+  // The last identifier ends exactly at the end of the buffer.
+  t = l.get_next_token();
+  REQUIRE(t.m_value == ident);
+  REQUIRE(l.get_next_token().m_token_class == cc::token_class::T_EOF);
+}
+
+TEST_CASE("get_next_token newline ends an unterminated literal",
+          "[lexer]") {
+  std::vector<std::string> invalid = {"\"abc\ndef\"", "'a\n'",
+                                      "\"no closing quote"};
+  for (const auto &s : invalid) {
+    file f(const_cast<char *>(s.c_str()), s.size());
+    cc::lexer l(f);
+    REQUIRE_THROWS_AS(l.get_next_token(), std::runtime_error);
+  }
+}
@@ -0,0 +1,69 @@
+#include "loader.h"
+#include "lexer.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+static std::vector<std::string> write_sources(const fs::path &dir,
+                                              int count) {
+  fs::create_directories(dir);
+  std::vector<std::string> paths;
+  for (int i = 0; i < count; ++i) {
+    auto path = dir / ("source" + std::to_string(i) + ".c");
+    std::ofstream(path) << "int value" << i << " = " << i << ";";
+    paths.push_back(path.string());
+  }
+  // An empty file must be delivered as well.
+  auto empty = dir / "empty.h";
+  std::ofstream{empty};
+  paths.push_back(empty.string());
+  return paths;
+}
+
+static void check_load(unsigned queue_depth, const char *dir_name) {
+  auto dir = fs::temp_directory_path() / dir_name;
+  auto paths = write_sources(dir, 100);
+
+  std::map<std::string, std::string> identifiers;
+  loader ld(queue_depth);
+  ld.load(paths, [&](std::string_view path, file &f) {
+    cc::lexer l(f);
+    auto tok = l.get_next_token();
+    if (tok.m_token_class == cc::token_class::T_EOF) {
+      identifiers[std::string(path)] = "";
+      return;
+    }
+    tok = l.get_next_token();
+    identifiers[std::string(path)] = std::string(tok.m_value);
+  });
+
+  REQUIRE(identifiers.size() == paths.size());
+  REQUIRE(identifiers[paths[42]] == "value42");
+  REQUIRE(identifiers[paths.back()].empty());
+  fs::remove_all(dir);
+}
+
+TEST_CASE("loader reads a batch of files", "[loader]") {
+  check_load(64, "acc_loader_ring");
+}
+
+TEST_CASE("loader threaded fallback", "[loader]") {
+  loader ld(0);
+  REQUIRE_FALSE(ld.uses_io_uring());
+  check_load(0, "acc_loader_threads");
+}
+
+TEST_CASE("loader reports missing files", "[loader]") {
+  std::vector<std::string> paths = {"/nonexistent/acc/source.c"};
+  for (unsigned depth : {64u, 0u}) {
+    loader ld(depth);
+    REQUIRE_THROWS_AS(ld.load(paths, [](std::string_view, file &) {}),
+                      std::runtime_error);
+  }
+}
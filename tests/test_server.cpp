@@ -0,0 +1,193 @@
+#include "elf_writer.h"
+#include "server.h"
+#include "test_support.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <unistd.h>
+
+#include <chrono>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace cc;
+using namespace cc::test;
+namespace fs = std::filesystem;
+
+namespace {
+std::vector<uint8_t> object(std::string source) {
+  return elf::build_object(compile(source));
+}
+
+void write_file(const fs::path &path, std::string_view text) {
+  std::ofstream(path, std::ios::binary | std::ios::trunc) << text;
+}
+
+std::vector<uint8_t> read_file(const fs::path &path) {
+  std::ifstream in(path, std::ios::binary);
+  return {std::istreambuf_iterator<char>(in), {}};
+}
+
+// Runs a server on a socket in a fresh directory for the scope of a test.
+struct running_server {
+  fs::path m_dir = fs::temp_directory_path() /
+                   std::format("acc_server_{}", getpid());
+  std::string m_socket = (m_dir / "acc.sock").string();
+  std::unique_ptr<compile_server> m_server;
+  std::thread m_thread;
+
+  explicit running_server(
+      size_t capacity = compile_server::k_default_capacity) {
+    fs::create_directories(m_dir);
+    m_server = std::make_unique<compile_server>(m_socket, capacity);
+    m_thread = std::thread([this] { m_server->run(); });
+  }
+  ~running_server() {
+    m_server->stop();
+    m_thread.join();
+    m_server.reset();
+    fs::remove_all(m_dir);
+  }
+
+  std::vector<uint8_t> compile(const fs::path &source,
+                               std::string_view name = "out.o") {
+    auto output = m_dir / name;
+    bool served = compile_remote(m_socket, source.string(), false,
+                                 output.string());
+    REQUIRE(served);
+    return read_file(output);
+  }
+};
+
+const char *k_first = "int f(int a) { return a + 1; }\n";
+const char *k_second =
+    "int f(int a) { return a * 2; }\nint g() { return 3; }\n";
+} // namespace
+
+TEST_CASE("Serves objects and reuses them while sources are unchanged",
+          "[server]") {
+  running_server server;
+  auto source = server.m_dir / "a.c";
+  write_file(source, k_first);
+  REQUIRE(server.compile(source) == object(k_first));
+  REQUIRE(server.m_server->cache_hits() == 0);
+  REQUIRE(server.compile(source) == object(k_first));
+  REQUIRE(server.m_server->cache_hits() == 1);
+}
+
+TEST_CASE("Recompiles sources after they change", "[server]") {
+  running_server server;
+  auto source = server.m_dir / "a.c";
+  write_file(source, k_first);
+  REQUIRE(server.compile(source) == object(k_first));
+
+  write_file(source, k_second);
+  REQUIRE(server.compile(source) == object(k_second));
+
+  // Editors often save by renaming a new file over the old one.
+  auto replacement = server.m_dir / "a.c.new";
+  write_file(replacement, k_first);
+  fs::rename(replacement, source);
+  REQUIRE(server.compile(source) == object(k_first));
+  REQUIRE(server.m_server->cache_hits() == 0);
+}
+
+TEST_CASE("Reports compile errors to the client", "[server]") {
+  running_server server;
+  auto source = server.m_dir / "bad.c";
+  write_file(source, "int f( { return; }\n");
+  REQUIRE_THROWS(server.compile(source));
+  REQUIRE_FALSE(fs::exists(server.m_dir / "out.o"));
+  REQUIRE_THROWS(server.compile(server.m_dir / "missing.c"));
+  // The server keeps going after a failed request.
+  write_file(source, k_first);
+  REQUIRE(server.compile(source) == object(k_first));
+}
+
+TEST_CASE("Survives sources truncated while they compile", "[server]") {
+  running_server server;
+  auto source = server.m_dir / "big.c";
+  std::string text;
+  for (int k = 0; text.size() < (size_t{2} << 20); ++k) {
+    text += std::format("long f{}(long a, long b) {{ return a * b + {}; }}\n",
+                        k, k);
+  }
+  for (int attempt = 0; attempt < 3; ++attempt) {
+    write_file(source, text);
+    std::jthread client([&] {
+      try {
+        compile_remote(server.m_socket, source.string(), false,
+                       (server.m_dir / "big.o").string());
+      } catch (...) {
+      }
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20 * attempt));
+    fs::resize_file(source, 0);
+  }
+  write_file(source, k_first);
+  REQUIRE(server.compile(source) == object(k_first));
+}
+
+TEST_CASE("Evicts the least recently used sources", "[server]") {
+  running_server server(1);
+  auto first = server.m_dir / "a.c";
+  auto second = server.m_dir / "b.c";
+  write_file(first, k_first);
+  write_file(second, k_second);
+  for (int k = 0; k < 2; ++k) {
+    REQUIRE(server.compile(first) == object(k_first));
+    REQUIRE(server.compile(second) == object(k_second));
+  }
+  REQUIRE(server.m_server->cache_hits() == 0);
+  REQUIRE(server.m_server->cached_sources() == 1);
+  REQUIRE(server.compile(second) == object(k_second));
+  REQUIRE(server.m_server->cache_hits() == 1);
+}
+
+TEST_CASE("Serves clients concurrently", "[server]") {
+  running_server server;
+  std::vector<fs::path> sources;
+  for (int k = 0; k < 4; ++k) {
+    sources.push_back(server.m_dir / std::format("{}.c", k));
+    write_file(sources.back(), k % 2 ? k_second : k_first);
+  }
+  // Assertions are not thread-safe, so the clients only record results.
+  std::vector<int> served(sources.size());
+  {
+    std::vector<std::jthread> clients;
+    for (size_t k = 0; k < sources.size(); ++k) {
+      clients.emplace_back([&, k] {
+        auto output = server.m_dir / std::format("{}.o", k);
+        for (int n = 0; n < 8; ++n) {
+          try {
+            served[k] += compile_remote(server.m_socket, sources[k].string(),
+                                        false, output.string());
+          } catch (...) {
+          }
+        }
+      });
+    }
+  }
+  for (size_t k = 0; k < sources.size(); ++k) {
+    REQUIRE(served[k] == 8);
+    REQUIRE(read_file(server.m_dir / std::format("{}.o", k)) ==
+            object(k % 2 ? k_second : k_first));
+  }
+}
+
+TEST_CASE("Falls back when no server is listening", "[server]") {
+  auto socket = fs::temp_directory_path() /
+                std::format("acc_no_server_{}.sock", getpid());
+  auto output = fs::temp_directory_path() /
+                std::format("acc_no_server_{}.o", getpid());
+  write_file(output, "stale");
+  REQUIRE_FALSE(
+      compile_remote(socket.string(), "a.c", false, output.string()));
+  // The driver compiles locally next and must find the output untouched.
+  REQUIRE(read_file(output) == std::vector<uint8_t>{'s', 't', 'a', 'l', 'e'});
+  fs::remove(output);
+}
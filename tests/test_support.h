@@ -0,0 +1,45 @@
+#ifndef CPPPROJECT_TEST_SUPPORT_H
+#define CPPPROJECT_TEST_SUPPORT_H
+
+#include "compile.h"
+#include "jit.h"
+#include "parser.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <string_view>
+
+namespace cc::test {
+// Parses `source` as a translation unit, generating code with `gen`.
+inline void parse(std::string source, generator &gen) {
+  file f(source.data(), source.size());
+  lexer lex(f);
+  symbol_table symbols;
+  type_context types;
+  parser p(lex, symbols, types, gen);
+  p.parse_translation_unit();
+}
+
+// Compiles `source` the way the driver compiles a file.
+inline object_module compile(std::string source, bool optimize = false) {
+  file f(source.data(), source.size());
+  return cc::compile(f, optimize);
+}
+
+// Runs functions of a module taking and returning up to two longs.
+class loaded_module {
+public:
+  explicit loaded_module(const object_module &module) : m_image(module) {}
+
+  long call(std::string_view name, long a = 0, long b = 0) const {
+    void *fn = m_image.symbol(name);
+    REQUIRE(fn != nullptr);
+    return reinterpret_cast<long (*)(long, long)>(fn)(a, b);
+  }
+
+private:
+  jit_image m_image;
+};
+} // namespace cc::test
+
+#endif // CPPPROJECT_TEST_SUPPORT_H
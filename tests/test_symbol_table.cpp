@@ -0,0 +1,81 @@
+#include "symbol_table.h"
+#include "lexer.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+
+using namespace cc;
+
+TEST_CASE("Interned names are stable", "[symbol_table]") {
+  symbol_table table;
+  auto a = table.intern("alpha");
+  auto b = table.intern("beta");
+  REQUIRE(a != b);
+  REQUIRE(table.intern(std::string("alpha")) == a);
+  REQUIRE(table.name(b) == "beta");
+  REQUIRE(table.find("gamma") == symbol_table::k_no_name);
+}
+
+TEST_CASE("Inner scopes shadow and restore", "[symbol_table]") {
+  symbol_table table;
+  REQUIRE(table.declare("x", symbol_kind::object, 1));
+  REQUIRE(table.declare("T", symbol_kind::typedef_name, 2));
+  REQUIRE(table.declare("x", symbol_kind::object) == nullptr);
+
+  table.push_scope();
+  REQUIRE(table.depth() == 1);
+  REQUIRE(table.lookup("x")->m_value == 1);
+  REQUIRE(table.declare("x", symbol_kind::object, 3));
+  REQUIRE(table.declare("T", symbol_kind::object, 4));
+  REQUIRE(table.declare("y", symbol_kind::object, 5));
+  REQUIRE(table.lookup("x")->m_value == 3);
+  REQUIRE(table.lookup("x")->m_scope == 1);
+  REQUIRE_FALSE(table.is_typedef_name("T"));
+
+  table.pop_scope();
+  REQUIRE(table.lookup("x")->m_value == 1);
+  REQUIRE(table.is_typedef_name("T"));
+  REQUIRE(table.lookup("y") == nullptr);
+  REQUIRE(table.lookup("unknown") == nullptr);
+  REQUIRE_THROWS_AS(table.pop_scope(), std::logic_error);
+}
+
+TEST_CASE("Table grows past its initial capacity", "[symbol_table]") {
+  symbol_table table;
+  table.push_scope();
+  for (int i = 0; i < 10000; ++i) {
+    REQUIRE(table.declare("name" + std::to_string(i), symbol_kind::object, i));
+  }
+  for (uint32_t i = 0; i < 10000u; i += 997) {
+    REQUIRE(table.lookup("name" + std::to_string(i))->m_value == i);
+  }
+  table.pop_scope();
+  REQUIRE(table.lookup("name0") == nullptr);
+  REQUIRE(table.find("name9999") != symbol_table::k_no_name);
+}
+
+TEST_CASE("Lexer reports typedef names", "[symbol_table]") {
+  char test_data[] = "size_t n; { int size_t; }";
+  file f(test_data, sizeof(test_data) - 1);
+  symbol_table table;
+  table.declare("size_t", symbol_kind::typedef_name);
+  lexer lex(f);
+  lex.set_symbol_table(&table);
+
+  auto tok = lex.get_next_token();
+  REQUIRE(tok.m_token_class == TYPEDEF_NAME);
+  REQUIRE(tok.m_value == "size_t");
+  REQUIRE(lex.get_next_token().m_token_class == IDENTIFIER);
+  REQUIRE(lex.get_next_token().m_token_class == ';');
+  REQUIRE(lex.get_next_token().m_token_class == '{');
+  table.push_scope();
+  REQUIRE(lex.get_next_token().m_token_class == KEYWORD);
+  tok = lex.get_next_token();
+  REQUIRE(tok.m_token_class == TYPEDEF_NAME);
+  // The parser sees the declarator and rebinds the name as an object.
+  table.declare(tok.m_value, symbol_kind::object);
+  REQUIRE(lex.get_next_token().m_token_class == ';');
+  table.pop_scope();
+  REQUIRE(lex.get_next_token().m_token_class == '}');
+  REQUIRE(lex.get_next_token().m_token_class == T_EOF);
+}
@@ -0,0 +1,86 @@
+#include "types.h"
+#include <catch2/catch_test_macros.hpp>
+
+#include <vector>
+
+using namespace cc;
+
+TEST_CASE("Derived types are hash-consed", "[types]") {
+  type_context ctx;
+  const type *int_t = ctx.builtin(type_kind::int_);
+  const type *char_t = ctx.builtin(type_kind::char_);
+
+  REQUIRE(ctx.pointer_to(int_t) == ctx.pointer_to(int_t));
+  REQUIRE(ctx.pointer_to(int_t) != ctx.pointer_to(char_t));
+  REQUIRE(ctx.pointer_to({int_t, q_const}) != ctx.pointer_to(int_t));
+  REQUIRE(ctx.array_of(int_t, 4) == ctx.array_of(int_t, 4));
+  REQUIRE(ctx.array_of(int_t, 4) != ctx.array_of(int_t, 5));
+
+  std::vector<qual_type> params{ctx.pointer_to(char_t), int_t};
+  const type *f = ctx.function(int_t, params, true);
+  params.push_back(int_t);
+  REQUIRE(ctx.function(int_t, std::span(params).first(2), true) == f);
+  REQUIRE(ctx.function(int_t, std::span(params).first(2), false) != f);
+  REQUIRE(ctx.function(int_t, params, true) != f);
+  REQUIRE(f->m_params.size() == 2);
+  REQUIRE(f->m_base == qual_type(int_t));
+
+  qual_type qualified[] = {{ctx.pointer_to(char_t), q_const | q_restrict},
+                           {int_t, q_volatile}};
+  REQUIRE(ctx.function(int_t, qualified, true) == f);
+}
+
+TEST_CASE("Repeated prototypes add no types", "[types]") {
+  type_context ctx;
+  auto make_prototype = [&] {
+    qual_type cchar{ctx.builtin(type_kind::char_), q_const};
+    qual_type params[] = {ctx.pointer_to(cchar),
+                          ctx.builtin(type_kind::ulong)};
+    return ctx.function(ctx.builtin(type_kind::int_), params);
+  };
+  const type *first = make_prototype();
+  size_t count = ctx.derived_count();
+  for (int i = 0; i < 10000; ++i) {
+    REQUIRE(make_prototype() == first);
+  }
+  REQUIRE(ctx.derived_count() == count);
+}
+
+TEST_CASE("Qualifiers are packed into the pointer", "[types]") {
+  type_context ctx;
+  const type *int_t = ctx.builtin(type_kind::int_);
+  qual_type q(int_t, q_const | q_volatile);
+  REQUIRE(sizeof(qual_type) == sizeof(void *));
+  REQUIRE(q.get() == int_t);
+  REQUIRE(q.is_const());
+  REQUIRE(q.is_volatile());
+  REQUIRE_FALSE(q.is_restrict());
+  REQUIRE(q.unqualified() == qual_type(int_t));
+  REQUIRE(q.with(q_restrict).quals() == (q_const | q_volatile | q_restrict));
+}
+
+TEST_CASE("Records are nominal and laid out", "[types]") {
+  type_context ctx;
+  type *a = ctx.record(type_kind::struct_, "s");
+  type *b = ctx.record(type_kind::struct_, "s");
+  REQUIRE(a != b);
+  REQUIRE_FALSE(a->m_complete);
+  REQUIRE_THROWS(ctx.array_of(a, 2));
+
+  field fields[] = {{"c", ctx.builtin(type_kind::char_)},
+                    {"l", ctx.builtin(type_kind::long_)},
+                    {"s", ctx.builtin(type_kind::short_)}};
+  ctx.complete(a, fields);
+  REQUIRE(a->m_complete);
+  REQUIRE(a->m_fields[1].m_offset == 8);
+  REQUIRE(a->m_fields[2].m_offset == 16);
+  REQUIRE(a->m_size == 24);
+  REQUIRE(a->m_align == 8);
+  REQUIRE_THROWS(ctx.complete(a, fields));
+  REQUIRE(ctx.array_of(a, 2)->m_size == 48);
+
+  type *u = ctx.record(type_kind::union_, "u");
+  ctx.complete(u, fields);
+  REQUIRE(u->m_size == 8);
+  REQUIRE(u->m_fields[1].m_offset == 0);
+}
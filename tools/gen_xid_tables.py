@@ -0,0 +1,66 @@
+#!/usr/bin/env python3
+"""Generates src/xid_tables.inc, the XID_Start/XID_Continue lookup tables
+used by src/utf8.cpp.
+
+Code points are split into blocks of 256. Each property maps a block number
+to an entry of a shared pool of deduplicated 256-bit block bitmaps. ASCII is
+left out of the tables because the lexer classifies it directly.
+
+Usage: tools/gen_xid_tables.py > src/xid_tables.inc
+"""
+
+import sys
+import unicodedata
+
+BLOCK_BITS = 8
+BLOCK_COUNT = 0x110000 >> BLOCK_BITS
+
+
+def xid_start(cp):
+    return cp >= 0x80 and chr(cp).isidentifier()
+
+
+def xid_continue(cp):
+    return cp >= 0x80 and ("a" + chr(cp)).isidentifier()
+
+
+def build(predicate, pool, index):
+    for block in range(BLOCK_COUNT):
+        bits = 0
+        for low in range(1 << BLOCK_BITS):
+            if predicate((block << BLOCK_BITS) | low):
+                bits |= 1 << low
+        index.append(pool.setdefault(bits, len(pool)))
+
+
+def emit_index(out, name, index):
+    out.write(f"static constexpr uint8_t {name}[{len(index)}] = {{\n")
+    for i in range(0, len(index), 16):
+        row = ", ".join(str(v) for v in index[i:i + 16])
+        out.write(f"    {row},\n")
+    out.write("};\n\n")
+
+
+def main():
+    pool = {}
+    start_index = []
+    continue_index = []
+    build(xid_start, pool, start_index)
+    build(xid_continue, pool, continue_index)
+    assert len(pool) <= 256
+
+    out = sys.stdout
+    out.write("// Generated by tools/gen_xid_tables.py from Unicode "
+              f"{unicodedata.unidata_version}. Do not edit.\n\n")
+    emit_index(out, "xid_start_index", start_index)
+    emit_index(out, "xid_continue_index", continue_index)
+    out.write(f"static constexpr uint64_t xid_blocks[{len(pool)}][4] = {{\n")
+    for bits in sorted(pool, key=pool.get):
+        words = ", ".join(f"0x{(bits >> (64 * i)) & (2**64 - 1):016x}"
+                          for i in range(4))
+        out.write(f"    {{{words}}},\n")
+    out.write("};\n")
+
+
+if __name__ == "__main__":
+    main()